@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Accuracy of LocalTangentFrame against reference points
+ *
+ * - both directions on the axes, where the WGS84 constants give the
+ *   coordinates exactly,
+ * - ECEF to geodetic against a fixed point iteration in long double, over
+ *   all latitudes and from below sea level to low orbit,
+ * - local ENU to geodetic and back around the default home, out to 150 km,
+ * - time per point of the batch conversion the GPS plugin uses.
+ *
+ * Exits non-zero when an error is over its bound.
+ *
+ *   geodesy_check
+ */
+
+#include <geodesy.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using gazebo::LocalTangentFrame;
+
+namespace {
+
+const double kDeg = M_PI / 180.0;
+int failures = 0;
+
+void report(const char *what, double err, double bound, const char *unit)
+{
+  const bool ok = err <= bound;
+  printf("%-44s max %10.3e %s (bound %.0e) %s\n", what, err, unit, bound, ok ? "ok" : "FAIL");
+  failures += ok ? 0 : 1;
+}
+
+// latitude by fixed point iteration on tan(lat) = (z + e2 N sin(lat)) / p,
+// run in long double until it stops moving
+void referenceGeodetic(const double ecef[3], long double *lat, long double *alt)
+{
+  const long double a = LocalTangentFrame::kSemiMajorAxis;
+  const long double e2 = LocalTangentFrame::kE2;
+  const long double p = std::sqrt((long double)ecef[0] * ecef[0] + (long double)ecef[1] * ecef[1]);
+  const long double z = ecef[2];
+  long double phi = std::atan2(z, p * (1.0L - e2));
+  for (int i = 0; i < 100; ++i) {
+    const long double s = std::sin(phi);
+    const long double n = a / std::sqrt(1.0L - e2 * s * s);
+    const long double next = std::atan2(z + e2 * n * s, p);
+    if (next == phi) {
+      break;
+    }
+    phi = next;
+  }
+  const long double s = std::sin(phi);
+  const long double c = std::cos(phi);
+  *lat = phi;
+  *alt = p * c + z * s - a * std::sqrt(1.0L - e2 * s * s);
+}
+
+}  // namespace
+
+int main()
+{
+  // points fixed by the WGS84 definition alone, on the axes, a and b
+  const double a = LocalTangentFrame::kSemiMajorAxis;
+  const double b = LocalTangentFrame::kSemiMinorAxis;
+  const struct {
+    double lat, lon, alt;
+    double x, y, z;
+  } points[] = {
+    {0.0, 0.0, 0.0, a, 0.0, 0.0},
+    {0.0, 90.0, 0.0, 0.0, a, 0.0},
+    {0.0, 180.0, -400.0, -(a - 400.0), 0.0, 0.0},
+    {0.0, -90.0, 40000.0, 0.0, -(a + 40000.0), 0.0},
+    {90.0, 0.0, 0.0, 0.0, 0.0, b},
+    {-90.0, 0.0, 1000.0, 0.0, 0.0, -(b + 1000.0)},
+  };
+  double ecef_err = 0.0, axis_err = 0.0;
+  for (const auto &pt : points) {
+    double ecef[3];
+    LocalTangentFrame::GeodeticToEcef(std::sin(pt.lat * kDeg), std::cos(pt.lat * kDeg),
+                                      std::sin(pt.lon * kDeg), std::cos(pt.lon * kDeg), pt.alt, ecef);
+    ecef_err = std::fmax(ecef_err, std::fmax(std::fabs(ecef[0] - pt.x),
+                                             std::fmax(std::fabs(ecef[1] - pt.y), std::fabs(ecef[2] - pt.z))));
+    const double ref[3] = {pt.x, pt.y, pt.z};
+    double lat, lon, alt;
+    LocalTangentFrame::EcefToGeodetic(ref, &lat, &lon, &alt);
+    axis_err = std::fmax(axis_err, std::fmax(std::fabs(lat - pt.lat * kDeg) * a, std::fabs(alt - pt.alt)));
+  }
+  // sin(pi) and cos(pi/2) are 1e-16, not 0, which puts a metre-scale
+  // ECEF coordinate some 1e-9 m off the axis
+  report("geodetic to ECEF, points on the axes", ecef_err, 1e-8, "m");
+  report("ECEF to geodetic, points on the axes", axis_err, 1e-8, "m");
+
+  // horizontal error as distance on the ellipsoid surface
+  double lat_err_m = 0.0, alt_err = 0.0, orbit_lat_err_m = 0.0, orbit_alt_err = 0.0;
+  for (double lat = -90.0; lat <= 90.0; lat += 0.25) {
+    for (double alt : {-400.0, 0.0, 488.0, 5000.0, 20000.0, 40000.0, 400000.0, 1000000.0}) {
+      double ecef[3];
+      LocalTangentFrame::GeodeticToEcef(std::sin(lat * kDeg), std::cos(lat * kDeg),
+                                        std::sin(0.3), std::cos(0.3), alt, ecef);
+      double lat_rad, lon_rad, h;
+      LocalTangentFrame::EcefToGeodetic(ecef, &lat_rad, &lon_rad, &h);
+      long double ref_lat, ref_alt;
+      referenceGeodetic(ecef, &ref_lat, &ref_alt);
+      const double dlat = std::fabs((double)(lat_rad - ref_lat)) * LocalTangentFrame::kSemiMajorAxis;
+      const double dalt = std::fabs((double)(h - ref_alt));
+      if (alt <= 40000.0) {
+        lat_err_m = std::fmax(lat_err_m, dlat);
+        alt_err = std::fmax(alt_err, dalt);
+      } else {
+        orbit_lat_err_m = std::fmax(orbit_lat_err_m, dlat);
+        orbit_alt_err = std::fmax(orbit_alt_err, dalt);
+      }
+    }
+  }
+  report("ECEF to geodetic, -400 m to 40 km, horizontal", lat_err_m, 2e-5, "m");
+  report("ECEF to geodetic, -400 m to 40 km, vertical", alt_err, 1e-8, "m");
+  report("ECEF to geodetic, 400 to 1000 km, horizontal", orbit_lat_err_m, 1e-2, "m");
+  report("ECEF to geodetic, 400 to 1000 km, vertical", orbit_alt_err, 1e-8, "m");
+
+  // ENU round trip around the default home
+  const LocalTangentFrame frame(gazebo::kDefaultHomeLatitude * kDeg, gazebo::kDefaultHomeLongitude * kDeg,
+                                gazebo::kDefaultHomeAltitude);
+  double round_trip = 0.0;
+  for (double r : {1.0, 100.0, 10000.0, 150000.0}) {
+    for (int k = 0; k < 16; ++k) {
+      const double az = k * M_PI / 8.0;
+      const double east = r * std::sin(az), north = r * std::cos(az), up = (k % 4) * 1000.0 - 300.0;
+      double lat, lon, alt, e, n, u;
+      frame.EnuToGeodetic(east, north, up, &lat, &lon, &alt);
+      frame.GeodeticToEnu(lat, lon, alt, &e, &n, &u);
+      round_trip = std::fmax(round_trip, std::sqrt((e - east) * (e - east) + (n - north) * (n - north) +
+                                                   (u - up) * (u - up)));
+    }
+  }
+  report("ENU to geodetic and back, out to 150 km", round_trip, 1e-6, "m");
+
+  double lat0, lon0, alt0;
+  frame.EnuToGeodetic(0.0, 0.0, 0.0, &lat0, &lon0, &alt0);
+  report("home maps to home",
+         std::fmax(std::fabs(lat0 - frame.LatHome()) * LocalTangentFrame::kSemiMajorAxis,
+                   std::fmax(std::fabs(lon0 - frame.LonHome()) * LocalTangentFrame::kSemiMajorAxis,
+                             std::fabs(alt0 - frame.AltHome()))),
+         1e-6, "m");
+
+  // batch conversion, two points per call as the GPS plugin does
+  const int n = 1 << 20;
+  std::vector<double> enu(3 * n), lla(3 * n);
+  for (int i = 0; i < n; ++i) {
+    enu[3 * i] = (i % 1000) * 0.7;
+    enu[3 * i + 1] = (i % 777) * -1.3;
+    enu[3 * i + 2] = (i % 50) * 2.0;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i += 2) {
+    frame.EnuToGeodetic(&enu[3 * i], &lla[3 * i], 2);
+  }
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+  double sum = 0.0;
+  for (int i = 0; i < 3 * n; ++i) {
+    sum += lla[i];
+  }
+  printf("ENU to geodetic %.1f ns per point (checksum %.6g)\n", ns, sum);
+
+  return failures ? 1 : 0;
+}
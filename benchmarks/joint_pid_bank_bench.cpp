@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief JointPidBank against one PID object per channel
+ *
+ * 16 channels, the size of the mavlink interface output table, driven with
+ * the same errors through the bank and through per-channel controllers that
+ * follow gazebo::common::PID::Update line by line. Reports the largest
+ * command difference and the time per step of both.
+ *
+ *   joint_pid_bank_bench [steps]
+ */
+
+#include <joint_pid_bank.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+constexpr int kChannels = 16;
+
+// common::PID::Update of Gazebo 7, without the common::Time conversion
+class ScalarPid {
+public:
+  ScalarPid(double p, double i, double d, double i_max, double i_min, double cmd_max, double cmd_min)
+    : p_gain_(p), i_gain_(i), d_gain_(d), i_max_(i_max), i_min_(i_min),
+      cmd_max_(cmd_max), cmd_min_(cmd_min), p_err_last_(0.0), i_err_(0.0) {}
+
+  double Update(double error, double dt)
+  {
+    if (dt == 0.0 || std::isnan(error) || std::isinf(error)) {
+      return 0.0;
+    }
+    i_err_ = i_err_ + dt * error;
+    double i_term = i_gain_ * i_err_;
+    if (i_term > i_max_) {
+      i_term = i_max_;
+      i_err_ = i_term / i_gain_;
+    } else if (i_term < i_min_) {
+      i_term = i_min_;
+      i_err_ = i_term / i_gain_;
+    }
+    const double d_err = (error - p_err_last_) / dt;
+    p_err_last_ = error;
+    double cmd = -p_gain_ * error - i_term - d_gain_ * d_err;
+    if (std::fabs(cmd_max_) >= 1e-6 && cmd > cmd_max_) {
+      cmd = cmd_max_;
+    }
+    if (std::fabs(cmd_min_) >= 1e-6 && cmd < cmd_min_) {
+      cmd = cmd_min_;
+    }
+    return cmd;
+  }
+
+private:
+  double p_gain_, i_gain_, d_gain_, i_max_, i_min_, cmd_max_, cmd_min_;
+  double p_err_last_, i_err_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int steps = argc > 1 ? atoi(argv[1]) : 1000000;
+  const double dt = 0.004;
+
+  gazebo::JointPidBank<kChannels> bank;
+  std::vector<ScalarPid> pids;
+  for (int k = 0; k < kChannels; ++k) {
+    // a mix of limited and unlimited channels, as the models configure them
+    const double p = 0.5 + 0.1 * k, i = 0.02 * (k % 3), d = 0.01 * (k % 4);
+    const double lim = k % 2 ? 2.0 : 0.0;
+    bank.Add(p, i, d, 1.0, -1.0, lim, -lim);
+    pids.emplace_back(p, i, d, 1.0, -1.0, lim, -lim);
+  }
+
+  // errors precomputed so both loops time only the controller
+  const int n_err = 4096;
+  std::vector<double> err(n_err * kChannels);
+  for (int s = 0; s < n_err; ++s) {
+    for (int k = 0; k < kChannels; ++k) {
+      err[s * kChannels + k] = 3.0 * std::sin(0.01 * s + 0.7 * k);
+    }
+  }
+
+  double cmd_bank[kChannels];
+  double cmd_scalar[kChannels];
+  double max_diff = 0.0;
+  volatile double sink = 0.0;  // keeps the loops from being optimised out
+
+  auto start = std::chrono::steady_clock::now();
+  for (int s = 0; s < steps; ++s) {
+    bank.Update(&err[(s % n_err) * kChannels], cmd_bank, dt);
+    sink += cmd_bank[s % kChannels];
+  }
+  const double bank_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / steps;
+
+  start = std::chrono::steady_clock::now();
+  for (int s = 0; s < steps; ++s) {
+    const double *e = &err[(s % n_err) * kChannels];
+    for (int k = 0; k < kChannels; ++k) {
+      cmd_scalar[k] = pids[k].Update(e[k], dt);
+    }
+    sink += cmd_scalar[s % kChannels];
+  }
+  const double scalar_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / steps;
+
+  // both ran the same sequence, so their states and last commands agree
+  for (int k = 0; k < kChannels; ++k) {
+    max_diff = std::fmax(max_diff, std::fabs(cmd_bank[k] - cmd_scalar[k]));
+  }
+
+  // a negative step is integrated, not zeroed, by both
+  bank.Update(&err[0], cmd_bank, -dt);
+  for (int k = 0; k < kChannels; ++k) {
+    max_diff = std::fmax(max_diff, std::fabs(cmd_bank[k] - pids[k].Update(err[k], -dt)));
+  }
+
+  printf("%d channels, %d steps\n", kChannels, steps);
+  printf("bank       %7.1f ns per step\n", bank_ns);
+  printf("per joint  %7.1f ns per step\n", scalar_ns);
+  printf("max command difference %g\n", max_diff);
+  return max_diff < 1e-9 ? 0 : 1;
+}
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Lift drag kernel against LiftDragPlugin, standard_vtol surfaces
+ *
+ * The four surfaces of models/standard_vtol (both wings, elevator, rudder)
+ * at random attitudes, velocities up to 50 m/s in every direction and
+ * control deflections, every tenth step radially symmetric, and now and
+ * then below the 1 cm/s cutoff. Each surface goes through ComputeLiftDrag
+ * and through a port of the analytic path of LiftDragPlugin::OnUpdate,
+ * asin, acos and the normalization loops included, and the forces are
+ * compared. Then both are timed per surface.
+ *
+ * Given a coefficient table of the wing, the same inputs also go through
+ * the table path, every surface with the wing parameters, against the
+ * analytic kernel, and both paths are timed. A table from the liftdrag
+ * model reproduces the analytic model up to the interpolation between
+ * grid points. The generator defaults to the standard_vtol wing, the
+ * sweep factor wants a finer sideslip grid than the default and the
+ * control term is linear, so
+ *   scripts/aero_table_gen.py wing.atbl --model liftdrag \
+ *     --alpha-points 721 --beta-points 181 --delta-points 2
+ *
+ *   liftdrag_kernel_check [steps] [wing.atbl]
+ */
+
+#include <liftdrag_plugin/liftdrag_kernel.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using gazebo::AeroTable;
+using gazebo::LiftDragSurfaces;
+
+namespace {
+
+// the parts of math::Vector3 LiftDragPlugin uses
+struct Vec3 {
+  double x, y, z;
+  Vec3 operator+(const Vec3 &o) const { return {x + o.x, y + o.y, z + o.z}; }
+  Vec3 operator-(const Vec3 &o) const { return {x - o.x, y - o.y, z - o.z}; }
+  Vec3 operator-() const { return {-x, -y, -z}; }
+  Vec3 operator*(double s) const { return {x * s, y * s, z * s}; }
+  double Dot(const Vec3 &o) const { return x * o.x + y * o.y + z * o.z; }
+  Vec3 Cross(const Vec3 &o) const { return {y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x}; }
+  double GetLength() const { return std::sqrt(Dot(*this)); }
+  Vec3 &Normalize()
+  {
+    const double d = GetLength();
+    if (!(std::fabs(d) < 1e-6)) {
+      x /= d;
+      y /= d;
+      z /= d;
+    }
+    return *this;
+  }
+};
+
+Vec3 operator*(double s, const Vec3 &v) { return v * s; }
+
+double clamp(double v, double lo, double hi) { return std::max(lo, std::min(hi, v)); }
+
+struct Surface {
+  const char *name;
+  double alpha0, cla, cda, alpha_stall, cla_stall, cda_stall, control_joint_rad_to_cl, area, rho;
+  Vec3 forward, upward;
+};
+
+// models/standard_vtol/standard_vtol.sdf, the wing is what the table
+// generator defaults to
+const Surface kSurfaces[] = {
+  {"left_wing", 0.05984281113, 4.752798721, 0.6417112299, 0.3391428111, -3.85, -0.9233984055, -0.5, 0.12, 1.2041,
+   {1, 0, 0}, {0, 0, 1}},
+  {"right_wing", 0.05984281113, 4.752798721, 0.6417112299, 0.3391428111, -3.85, -0.9233984055, -0.5, 0.12, 1.2041,
+   {1, 0, 0}, {0, 0, 1}},
+  {"elevator", -0.2, 4.752798721, 0.6417112299, 0.3391428111, -3.85, -0.9233984055, -4.0, 0.01, 1.2041,
+   {1, 0, 0}, {0, 0, 1}},
+  {"rudder", 0.0, 4.752798721, 0.6417112299, 0.3391428111, -3.85, -0.9233984055, 0.0, 0.02, 1.2041,
+   {1, 0, 0}, {0, 1, 0}},
+};
+const int kCount = sizeof(kSurfaces) / sizeof(kSurfaces[0]);
+
+// LiftDragPlugin::OnUpdate without a coefficient table, world frame force
+Vec3 LiftDragPlugin(const Surface &p, bool radial, const Vec3 &vel, const Vec3 &forwardI, const Vec3 &upward,
+                    double control_angle)
+{
+  Vec3 velI = vel;
+  velI.Normalize();
+  if (vel.GetLength() <= 0.01)
+    return {0, 0, 0};
+
+  Vec3 upwardI;
+  if (radial) {
+    Vec3 tmp = forwardI.Cross(velI);
+    upwardI = forwardI.Cross(tmp).Normalize();
+  } else {
+    upwardI = upward;
+  }
+  Vec3 spanwiseI = forwardI.Cross(upwardI).Normalize();
+
+  double sinSweepAngle = clamp(spanwiseI.Dot(velI), -1.0, 1.0);
+  double cosSweepAngle = 1.0 - sinSweepAngle * sinSweepAngle;
+  double sweep = asin(sinSweepAngle);
+  while (fabs(sweep) > 0.5 * M_PI)
+    sweep = sweep > 0 ? sweep - M_PI : sweep + M_PI;
+
+  Vec3 velInLDPlane = vel - vel.Dot(spanwiseI) * velI;
+  Vec3 dragDirection = -velInLDPlane;
+  dragDirection.Normalize();
+  Vec3 liftI = spanwiseI.Cross(velInLDPlane);
+  liftI.Normalize();
+
+  double cosAlpha = clamp(liftI.Dot(upwardI), -1.0, 1.0);
+  double alpha = liftI.Dot(forwardI) >= 0.0 ? p.alpha0 + acos(cosAlpha) : p.alpha0 - acos(cosAlpha);
+  while (fabs(alpha) > 0.5 * M_PI)
+    alpha = alpha > 0 ? alpha - M_PI : alpha + M_PI;
+
+  double speedInLDPlane = velInLDPlane.GetLength();
+  double q = 0.5 * p.rho * speedInLDPlane * speedInLDPlane;
+
+  double cl;
+  if (alpha > p.alpha_stall) {
+    cl = (p.cla * p.alpha_stall + p.cla_stall * (alpha - p.alpha_stall)) * cosSweepAngle;
+    cl = std::max(0.0, cl);
+  } else if (alpha < -p.alpha_stall) {
+    cl = (-p.cla * p.alpha_stall + p.cla_stall * (alpha + p.alpha_stall)) * cosSweepAngle;
+    cl = std::min(0.0, cl);
+  } else {
+    cl = p.cla * alpha * cosSweepAngle;
+  }
+  cl = cl + p.control_joint_rad_to_cl * control_angle;
+  Vec3 lift = cl * q * p.area * liftI;
+
+  double cd;
+  if (alpha > p.alpha_stall)
+    cd = (p.cda * p.alpha_stall + p.cda_stall * (alpha - p.alpha_stall)) * cosSweepAngle;
+  else if (alpha < -p.alpha_stall)
+    cd = (-p.cda * p.alpha_stall + p.cda_stall * (alpha + p.alpha_stall)) * cosSweepAngle;
+  else
+    cd = (p.cda * alpha) * cosSweepAngle;
+  cd = fabs(cd);
+  Vec3 drag = cd * q * p.area * dragDirection;
+
+  return lift + drag;
+}
+
+void SetParameters(const Surface &p, int i, LiftDragSurfaces *s)
+{
+  s->alpha0[i] = p.alpha0;
+  s->cla[i] = p.cla;
+  s->cda[i] = p.cda;
+  s->alpha_stall[i] = p.alpha_stall;
+  s->cla_stall[i] = p.cla_stall;
+  s->cda_stall[i] = p.cda_stall;
+  s->control_to_cl[i] = p.control_joint_rad_to_cl;
+  s->half_rho_area[i] = 0.5 * p.rho * p.area;
+  s->table[i] = nullptr;
+}
+
+void CopyInputs(const LiftDragSurfaces &from, LiftDragSurfaces *to)
+{
+  for (int i = 0; i < from.count; ++i) {
+    to->radial[i] = from.radial[i];
+    to->control[i] = from.control[i];
+    for (int j = 0; j < 3; ++j) {
+      to->vel[j][i] = from.vel[j][i];
+      to->forward[j][i] = from.forward[j][i];
+      to->upward[j][i] = from.upward[j][i];
+    }
+  }
+}
+
+// time per surface of ComputeLiftDrag over the inputs in s
+double TimeKernel(LiftDragSurfaces *s, int reps)
+{
+  volatile double sink = 0.0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r) {
+    s->vel[0][r % s->count] += 1e-9;
+    gazebo::ComputeLiftDrag(s);
+    sink = sink + s->force[2][r % s->count];
+  }
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / (double(reps) * s->count);
+}
+
+// rotate v by the unit quaternion (w, x, y, z)
+Vec3 Rotate(const double q[4], const Vec3 &v)
+{
+  const Vec3 u{q[1], q[2], q[3]};
+  const Vec3 t = 2.0 * u.Cross(v);
+  return v + q[0] * t + u.Cross(t);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int steps = argc > 1 ? atoi(argv[1]) : 200000;
+
+  AeroTable table;
+  if (argc > 2) {
+    std::string error;
+    if (!table.Load(argv[2], &error)) {
+      printf("%s\n", error.c_str());
+      return 1;
+    }
+  }
+
+  // the model, and the wing on every surface analytic and from the table
+  LiftDragSurfaces s = LiftDragSurfaces();
+  LiftDragSurfaces analytic = LiftDragSurfaces();
+  LiftDragSurfaces tabulated = LiftDragSurfaces();
+  s.count = analytic.count = tabulated.count = kCount;
+  for (int i = 0; i < kCount; ++i) {
+    SetParameters(kSurfaces[i], i, &s);
+    SetParameters(kSurfaces[0], i, &analytic);
+    SetParameters(kSurfaces[0], i, &tabulated);
+    tabulated.table[i] = &table;
+  }
+  std::vector<double> table_rel;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uni(-1.0, 1.0);
+  double max_err = 0.0, max_rel = 0.0, max_force = 0.0;
+  const char *worst = "";
+  for (int t = 0; t < steps; ++t) {
+    double q[4] = {uni(rng), uni(rng), uni(rng), uni(rng)};
+    const double norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (double &c : q) {
+      c /= norm;
+    }
+    const bool radial = t % 10 == 0;
+    for (int i = 0; i < kCount; ++i) {
+      const Vec3 f = Rotate(q, kSurfaces[i].forward);
+      const Vec3 up = Rotate(q, kSurfaces[i].upward);
+      Vec3 vel{50.0 * uni(rng), 50.0 * uni(rng), 50.0 * uni(rng)};
+      if (t % 97 == 0) {
+        vel = vel * 1e-4;  // around the 1 cm/s cutoff
+      }
+      s.radial[i] = radial;
+      s.control[i] = 0.3 * uni(rng);
+      s.vel[0][i] = vel.x;
+      s.vel[1][i] = vel.y;
+      s.vel[2][i] = vel.z;
+      s.forward[0][i] = f.x;
+      s.forward[1][i] = f.y;
+      s.forward[2][i] = f.z;
+      s.upward[0][i] = up.x;
+      s.upward[1][i] = up.y;
+      s.upward[2][i] = up.z;
+    }
+    gazebo::ComputeLiftDrag(&s);
+    for (int i = 0; i < kCount; ++i) {
+      const Vec3 ref = LiftDragPlugin(kSurfaces[i], radial, Vec3{s.vel[0][i], s.vel[1][i], s.vel[2][i]},
+                                      Vec3{s.forward[0][i], s.forward[1][i], s.forward[2][i]},
+                                      Vec3{s.upward[0][i], s.upward[1][i], s.upward[2][i]}, s.control[i]);
+      const double err = (ref - Vec3{s.force[0][i], s.force[1][i], s.force[2][i]}).GetLength();
+      // relative to the force, with a 1 mN floor for the near zero ones
+      const double rel = err / std::max(ref.GetLength(), 1e-3);
+      if (rel > max_rel) {
+        max_rel = rel;
+        worst = kSurfaces[i].name;
+      }
+      max_err = std::max(max_err, err);
+      max_force = std::max(max_force, ref.GetLength());
+    }
+
+    if (!table.Empty()) {
+      CopyInputs(s, &analytic);
+      CopyInputs(s, &tabulated);
+      gazebo::ComputeLiftDrag(&analytic);
+      gazebo::ComputeLiftDrag(&tabulated);
+      for (int i = 0; i < kCount; ++i) {
+        const Vec3 ref{analytic.force[0][i], analytic.force[1][i], analytic.force[2][i]};
+        const Vec3 tab{tabulated.force[0][i], tabulated.force[1][i], tabulated.force[2][i]};
+        table_rel.push_back((ref - tab).GetLength() / std::max(ref.GetLength(), 1e-3));
+      }
+    }
+  }
+
+  // the acos polynomial is good to 1e-7 rad, which is amplified where the
+  // lift coefficient passes through zero
+  bool ok = max_rel < 1e-4;
+  printf("%d steps of %d surfaces, forces up to %.1f N\n", steps, kCount, max_force);
+  printf("max error %.3g N, max relative %.3g (%s) %s\n", max_err, max_rel, worst, ok ? "ok" : "FAIL");
+
+  if (!table_rel.empty()) {
+    // the largest errors are at the stall breaks and where the sweep
+    // takes the force to nothing, the bulk is well below
+    std::sort(table_rel.begin(), table_rel.end());
+    const double median = table_rel[table_rel.size() / 2];
+    const double p99 = table_rel[table_rel.size() * 99 / 100];
+    const bool table_ok = median < 1e-3 && p99 < 2e-2;
+    printf("table against analytic, relative: median %.3g, p99 %.3g, max %.3g %s\n",
+           median, p99, table_rel.back(), table_ok ? "ok" : "FAIL");
+    ok = ok && table_ok;
+  }
+
+  // time per surface over the last step's inputs
+  const int reps = 1000000;
+  const double kernel_ns = TimeKernel(&s, reps);
+  volatile double sink = 0.0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r) {
+    s.vel[0][r % kCount] += 1e-9;
+    for (int i = 0; i < kCount; ++i) {
+      const Vec3 f = LiftDragPlugin(kSurfaces[i], s.radial[i] != 0.0, Vec3{s.vel[0][i], s.vel[1][i], s.vel[2][i]},
+                                    Vec3{s.forward[0][i], s.forward[1][i], s.forward[2][i]},
+                                    Vec3{s.upward[0][i], s.upward[1][i], s.upward[2][i]}, s.control[i]);
+      sink = sink + f.z;
+    }
+  }
+  const double plugin_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / (double(reps) * kCount);
+
+  printf("kernel         %6.1f ns per surface\n", kernel_ns);
+  printf("LiftDragPlugin %6.1f ns per surface\n", plugin_ns);
+  if (!table.Empty()) {
+    printf("wing analytic  %6.1f ns per surface\n", TimeKernel(&analytic, reps));
+    printf("wing table     %6.1f ns per surface\n", TimeKernel(&tabulated, reps));
+  }
+  return ok ? 0 : 1;
+}
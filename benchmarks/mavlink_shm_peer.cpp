@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Stand-in autopilot for the shared memory MAVLink transport
+ *
+ * Attaches to the segment of a gazebo_mavlink_interface running with
+ * <transport>shm</transport> and answers every HIL_SENSOR with an armed
+ * HIL_ACTUATOR_CONTROLS carrying the same timestamp and a fixed control
+ * value, so a world in lockstep steps without PX4. Prints the frame counts
+ * once per second.
+ *
+ *   mavlink_shm_peer [segment name] [control value]
+ */
+
+#include <mavlink/v2.0/common/mavlink.h>
+#include <mavlink_shm_transport.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace gazebo;
+
+int main(int argc, char** argv)
+{
+  const std::string name = argc > 1 ? argv[1] : "/sitl_gazebo_mavlink_14560";
+  const float control = argc > 2 ? atof(argv[2]) : 0.0f;
+
+  MavlinkShmTransport shm;
+  while (!shm.Open(name)) {
+    // the simulator creates the segment when the model loads
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+  printf("[mavlink_shm_peer] attached to %s\n", name.c_str());
+
+  uint64_t received = 0, sensors = 0, replies = 0;
+  auto report_time = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  uint8_t buf[kMavlinkShmFrameSize];
+
+  while (true) {
+    ssize_t len = shm.Receive(buf, sizeof(buf));
+    if (len == 0) {
+      shm.WaitReadable(100);
+    } else if (len > 0) {
+      ++received;
+      // frames arrive whole, so a fresh parser per frame is enough
+      mavlink_message_t msg, rx_msg = {};
+      mavlink_status_t status, rx_status = {};
+      for (ssize_t i = 0; i < len; ++i) {
+        if (mavlink_frame_char_buffer(&rx_msg, &rx_status, buf[i], &msg, &status) != MAVLINK_FRAMING_OK ||
+            msg.msgid != MAVLINK_MSG_ID_HIL_SENSOR) {
+          continue;
+        }
+        ++sensors;
+
+        mavlink_hil_actuator_controls_t controls = {};
+        controls.time_usec = mavlink_msg_hil_sensor_get_time_usec(&msg);
+        controls.mode = MAV_MODE_FLAG_SAFETY_ARMED;
+        for (int c = 0; c < 16; ++c) {
+          controls.controls[c] = control;
+        }
+
+        mavlink_message_t reply;
+        mavlink_msg_hil_actuator_controls_encode_chan(1, 1, MAVLINK_COMM_0, &reply, &controls);
+        uint8_t out[MAVLINK_MAX_PACKET_LEN];
+        const uint16_t out_len = mavlink_msg_to_send_buffer(out, &reply);
+        replies += shm.Send(out, out_len) ? 1 : 0;
+      }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= report_time) {
+      report_time = now + std::chrono::seconds(1);
+      printf("[mavlink_shm_peer] %llu frames, %llu HIL_SENSOR, %llu replies, %llu corrupt slots\n",
+             (unsigned long long)received, (unsigned long long)sensors,
+             (unsigned long long)replies, (unsigned long long)shm.CorruptSlots());
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Round trip latency of the same-host MAVLink transports
+ *
+ * A forked child echoes every frame back, the parent times the round trip
+ * over the shared memory transport, UDP on loopback and a Unix datagram
+ * socket. Both sides block between frames like a lockstep simulator and
+ * autopilot do. Frames default to the size of a MAVLink 2 HIL_SENSOR.
+ *
+ *   mavlink_transport_bench [round trips] [frame bytes]
+ */
+
+#include <mavlink_shm_transport.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace gazebo;
+
+namespace {
+
+struct Endpoint {
+  std::function<bool(const uint8_t*, size_t)> send;
+  std::function<ssize_t(uint8_t*, size_t)> receive;   ///< blocking
+};
+
+void report(const char* name, std::vector<double>& rtt_us)
+{
+  if (rtt_us.empty()) {
+    printf("%-12s failed\n", name);
+    return;
+  }
+  std::sort(rtt_us.begin(), rtt_us.end());
+  printf("%-12s round trip median %7.2f us, p99 %7.2f us, max %8.2f us\n", name,
+         rtt_us[rtt_us.size() / 2], rtt_us[rtt_us.size() * 99 / 100], rtt_us.back());
+}
+
+// runs echo in a child process and times n round trips of a len byte frame
+std::vector<double> measure(const std::function<Endpoint(bool)>& connect, int n, size_t len)
+{
+  std::vector<double> rtt_us;
+  pid_t child = fork();
+  if (child < 0) {
+    return rtt_us;
+  }
+
+  if (child == 0) {
+    Endpoint echo = connect(false);
+    uint8_t buf[kMavlinkShmFrameSize];
+    while (true) {
+      ssize_t got = echo.receive(buf, sizeof(buf));
+      if (got > 0) {
+        echo.send(buf, got);
+      }
+    }
+  }
+
+  Endpoint ep = connect(true);
+  std::vector<uint8_t> frame(len, 0x55);
+  frame[0] = 0xFD;
+  uint8_t buf[kMavlinkShmFrameSize];
+  rtt_us.reserve(n);
+
+  // the first round trips fault pages in and wake the child, not timed
+  for (int i = -100; i < n; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    if (!ep.send(frame.data(), frame.size()) || ep.receive(buf, sizeof(buf)) != static_cast<ssize_t>(len)) {
+      rtt_us.clear();
+      break;
+    }
+    if (i >= 0) {
+      rtt_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+  }
+
+  kill(child, SIGKILL);
+  waitpid(child, nullptr, 0);
+  return rtt_us;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int n = argc > 1 ? atoi(argv[1]) : 100000;
+  const size_t len = std::min<size_t>(argc > 2 ? atoi(argv[2]) : 76, kMavlinkShmFrameSize);
+
+  // shared memory: the parent creates the segment like the plugin does,
+  // the child attaches like the autopilot, which has to wait for it
+  const std::string shm_name = "/mavlink_transport_bench_" + std::to_string(getpid());
+  MavlinkShmTransport shm;
+  std::vector<double> shm_rtt = measure([&] (bool parent) {
+    if (parent) {
+      shm.Create(shm_name);
+    } else {
+      usleep(100000);
+      shm.Open(shm_name);
+    }
+    Endpoint ep;
+    ep.send = [&] (const uint8_t* buf, size_t size) { return shm.Send(buf, size); };
+    ep.receive = [&] (uint8_t* buf, size_t size) {
+      ssize_t got;
+      while ((got = shm.Receive(buf, size)) == 0 || got == MavlinkShmTransport::kCorruptSlot) {
+        shm.WaitReadable(1000);
+      }
+      return got;
+    };
+    return ep;
+  }, n, len);
+  shm.Close();
+  report("shm", shm_rtt);
+
+  // UDP on loopback, two bound sockets that only talk to each other
+  int udp[2];
+  struct sockaddr_in addr[2];
+  for (int i = 0; i < 2; ++i) {
+    udp[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr[i], 0, sizeof(addr[i]));
+    addr[i].sin_family = AF_INET;
+    addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr[i]);
+    bind(udp[i], (struct sockaddr*)&addr[i], sizeof(addr[i]));
+    getsockname(udp[i], (struct sockaddr*)&addr[i], &addrlen);
+  }
+  std::vector<double> udp_rtt = measure([&] (bool parent) {
+    const int self = parent ? 0 : 1;
+    Endpoint ep;
+    ep.send = [&, self] (const uint8_t* buf, size_t size) {
+      return sendto(udp[self], buf, size, 0, (struct sockaddr*)&addr[1 - self], sizeof(addr[1 - self])) > 0;
+    };
+    ep.receive = [&, self] (uint8_t* buf, size_t size) { return recv(udp[self], buf, size, 0); };
+    return ep;
+  }, n, len);
+  report("udp", udp_rtt);
+
+  // Unix datagram socket pair
+  int unix_pair[2];
+  socketpair(AF_UNIX, SOCK_DGRAM, 0, unix_pair);
+  std::vector<double> unix_rtt = measure([&] (bool parent) {
+    const int fd = unix_pair[parent ? 0 : 1];
+    Endpoint ep;
+    ep.send = [fd] (const uint8_t* buf, size_t size) { return send(fd, buf, size, 0) > 0; };
+    ep.receive = [fd] (uint8_t* buf, size_t size) { return recv(fd, buf, size, 0); };
+    return ep;
+  }, n, len);
+  report("unix socket", unix_rtt);
+
+  return 0;
+}
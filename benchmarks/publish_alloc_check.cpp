@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Heap allocations of the per-step message fills
+ *
+ * Counts calls to a replaced global operator new while the outgoing
+ * messages of an iris step are refilled the way the plugins do it:
+ *
+ * - GazeboImuPlugin::OnUpdate, orientation and both vectors per instance,
+ * - GazeboControllerInterface::OnUpdate, the motor speed references,
+ * - GazeboMultirotorBasePlugin::OnUpdate, the measured motor speeds,
+ * - GazeboMavlinkInterface, the motor speed references of OnUpdate, and
+ *   the joint command and per-channel gztopic targets of handle_control.
+ *
+ * Publish() is left out, transport serializes into a buffer of its own.
+ * The first step may allocate as the messages grow, every later one must
+ * not. Exits non-zero otherwise.
+ *
+ *   publish_alloc_check [steps]
+ */
+
+#include <common.h>
+
+#include <CommandMotorSpeed.pb.h>
+#include <JointCommand.pb.h>
+#include <MotorSpeed.pb.h>
+#include <SensorImu.pb.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace {
+
+long allocations = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+  ++allocations;
+  void *p = std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  ++allocations;
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+  return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using namespace gazebo;
+
+constexpr int kRotors = 4;         // iris
+constexpr int kImuInstances = 2;
+constexpr int kGztopicChannels = 2;
+
+// the messages the plugins keep as members, and the references they get
+struct Messages {
+  Eigen::VectorXd input_reference;
+  sensor_msgs::msgs::Imu imu;
+  mav_msgs::msgs::CommandMotorSpeed controller_reference;
+  mav_msgs::msgs::MotorSpeed motor_speed;
+  mav_msgs::msgs::CommandMotorSpeed mavlink_reference;
+  joint_msgs::msgs::JointCommand joint_command;
+  msgs::Any joint_control;
+};
+
+// GazeboMavlinkInterface::Load
+void LoadJointCommand(joint_msgs::msgs::JointCommand *msg)
+{
+  msg->Clear();
+  for (int i = 0; i < kGztopicChannels; ++i) {
+    msg->add_channel(4 + i);
+    msg->add_position(0.0);
+    msg->add_topic("control_position_gztopic_" + std::to_string(4 + i));
+  }
+}
+
+void Step(int t, Messages *m)
+{
+  const double s = 1e-3 * t;
+  m->input_reference.setConstant(600.0 + s);
+  const Eigen::VectorXd &reference = m->input_reference;
+
+  // GazeboImuPlugin::OnUpdate
+  const math::Quaternion C_W_I(1.0, 0.1 * s, 0.0, 0.0);
+  msgs::Quaternion *orientation = m->imu.mutable_orientation();
+  orientation->set_x(C_W_I.x);
+  orientation->set_y(C_W_I.y);
+  orientation->set_z(C_W_I.z);
+  orientation->set_w(C_W_I.w);
+  Eigen::Matrix<double, 6, kImuInstances> measurements;
+  measurements.setConstant(s);
+  for (int k = 0; k < kImuInstances; ++k) {
+    setVector3d(m->imu.mutable_linear_acceleration(), measurements.col(k).tail<3>());
+    setVector3d(m->imu.mutable_angular_velocity(), measurements.col(k).head<3>());
+  }
+
+  // GazeboControllerInterface::OnUpdate
+  resizeRepeated(m->controller_reference.mutable_motor_speed(), reference.size());
+  for (int i = 0; i < reference.size(); i++)
+    m->controller_reference.set_motor_speed(i, reference[i]);
+
+  // GazeboMultirotorBasePlugin::OnUpdate
+  resizeRepeated(m->motor_speed.mutable_motor_speed(), kRotors);
+  for (int i = 0; i < kRotors; ++i) {
+    m->motor_speed.set_motor_speed(i, 0.9 * reference[i]);
+  }
+
+  // GazeboMavlinkInterface::OnUpdate and handle_control
+  resizeRepeated(m->mavlink_reference.mutable_motor_speed(), reference.size());
+  const bool stale = t % 100 == 0;
+  for (int i = 0; i < reference.size(); i++) {
+    m->mavlink_reference.set_motor_speed(i, stale ? 0 : reference[i]);
+  }
+  for (int k = 0; k < kGztopicChannels; ++k) {
+    m->joint_command.set_position(k, 0.1 * s);
+    m->joint_control.set_type(msgs::Any_ValueType_DOUBLE);
+    m->joint_control.set_double_value(0.1 * s);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int steps = argc > 1 ? atoi(argv[1]) : 10000;
+
+  // the counter sees what the message code allocates
+  allocations = 0;
+  {
+    sensor_msgs::msgs::Imu fresh;
+    fresh.set_allocated_orientation(new msgs::Quaternion());
+  }
+  const long hook = allocations;
+
+  Messages *messages = new Messages();
+  messages->input_reference.resize(kRotors);
+  LoadJointCommand(&messages->joint_command);
+
+  allocations = 0;
+  Step(0, messages);
+  const long first = allocations;
+
+  allocations = 0;
+  for (int t = 1; t < steps; ++t) {
+    Step(t, messages);
+  }
+  const long steady = allocations;
+
+  const bool ok = hook > 0 && steady == 0;
+  printf("hook counted %ld allocation(s) for a fresh sub-message\n", hook);
+  printf("first step %ld allocation(s), next %d steps %ld %s\n", first, steps - 1, steady, ok ? "ok" : "FAIL");
+  delete messages;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Rotor kernel against the GazeboMotorModel formulas
+ *
+ * Random vehicles of 16 tilted rotors on one parent, at random attitudes,
+ * rotor angles, velocities and speeds. Every rotor goes once through the
+ * per-motor formulas of GazeboMotorModel::UpdateForcesAndMoments, with the
+ * pose difference to the parent taken every step, and once through
+ * ComputeRotorForces with the inputs the rotor bank plugin builds from the
+ * directions it caches in the parent frame at load. Compared in the world
+ * frame:
+ *  - thrust, AddRelativeForce on the rotor link,
+ *  - rotor drag, AddForce on the rotor link,
+ *  - drag torque, rotated into the parent frame and applied relative to it,
+ *  - rolling moment, AddTorque on the parent,
+ * for the analytic model and for a rotor table. Then both are timed.
+ *
+ *   rotor_kernel_check [vehicles]
+ */
+
+#include <rotor_kernel.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+using gazebo::RotorSet;
+using gazebo::RotorTable;
+
+namespace {
+
+// the parts of math::Vector3 and math::Quaternion the motor model uses
+struct Vec3 {
+  double x, y, z;
+  Vec3 operator+(const Vec3 &o) const { return {x + o.x, y + o.y, z + o.z}; }
+  Vec3 operator-(const Vec3 &o) const { return {x - o.x, y - o.y, z - o.z}; }
+  Vec3 operator*(double s) const { return {x * s, y * s, z * s}; }
+  double Dot(const Vec3 &o) const { return x * o.x + y * o.y + z * o.z; }
+  double GetLength() const { return std::sqrt(Dot(*this)); }
+};
+
+struct Quat {
+  double w, x, y, z;
+  Quat operator*(const Quat &q) const
+  {
+    return {w * q.w - x * q.x - y * q.y - z * q.z, w * q.x + x * q.w + y * q.z - z * q.y,
+            w * q.y - x * q.z + y * q.w + z * q.x, w * q.z + x * q.y - y * q.x + z * q.w};
+  }
+  Quat GetInverse() const { return {w, -x, -y, -z}; }
+  Vec3 RotateVector(const Vec3 &v) const
+  {
+    const Quat r = *this * Quat{0.0, v.x, v.y, v.z} * GetInverse();
+    return {r.x, r.y, r.z};
+  }
+  Vec3 RotateVectorReverse(const Vec3 &v) const { return GetInverse().RotateVector(v); }
+};
+
+Quat AxisAngle(Vec3 axis, double angle)
+{
+  axis = axis * (1.0 / axis.GetLength());
+  const double s = std::sin(0.5 * angle);
+  return {std::cos(0.5 * angle), axis.x * s, axis.y * s, axis.z * s};
+}
+
+struct Rotor {
+  double motor_constant, moment_constant, rotor_drag_coefficient, rolling_moment_coefficient;
+  int turning_direction;
+  double diameter;
+};
+
+struct Wrench {
+  Vec3 thrust, drag, drag_torque, rolling_moment;
+};
+
+// GazeboMotorModel::UpdateForcesAndMoments, forces and torques in the world frame
+Wrench MotorModel(const Rotor &m, const RotorTable *table, double air_density, double real_motor_velocity,
+                  const Vec3 &body_velocity, const Quat &link_rot, const Quat &parent_rot, const Vec3 &joint_axis)
+{
+  Wrench out;
+  double force;
+  double drag_torque_magnitude;
+  if (!table) {
+    force = real_motor_velocity * real_motor_velocity * m.motor_constant;
+    drag_torque_magnitude = force * m.moment_constant;
+    double scalar = 1 - body_velocity.GetLength() / 25.0;
+    scalar = scalar < 0.0 ? 0.0 : scalar > 1.0 ? 1.0 : scalar;
+    out.thrust = link_rot.RotateVector(Vec3{0, 0, force * scalar});
+  } else {
+    const Vec3 thrust_axis = link_rot.RotateVector(Vec3{0, 0, 1});
+    const double v_axial = body_velocity.Dot(thrust_axis);
+    const double v_inplane = (body_velocity - thrust_axis * v_axial).GetLength();
+    table->Evaluate(real_motor_velocity, v_axial, v_inplane, air_density, m.diameter, &force,
+                    &drag_torque_magnitude);
+    out.thrust = link_rot.RotateVector(Vec3{0, 0, force});
+  }
+
+  const Vec3 body_velocity_perpendicular = body_velocity - joint_axis * body_velocity.Dot(joint_axis);
+  out.drag = body_velocity_perpendicular * (-std::abs(real_motor_velocity) * m.rotor_drag_coefficient);
+
+  // math::Pose::operator- gives the rotation parent^-1 * link
+  const Quat pose_difference = parent_rot.GetInverse() * link_rot;
+  const Vec3 drag_torque{0, 0, -m.turning_direction * drag_torque_magnitude};
+  const Vec3 drag_torque_parent_frame = pose_difference.RotateVector(drag_torque);
+  out.drag_torque = parent_rot.RotateVector(drag_torque_parent_frame);  // AddRelativeTorque
+
+  out.rolling_moment = body_velocity_perpendicular * (-std::abs(real_motor_velocity) * m.rolling_moment_coefficient);
+  return out;
+}
+
+double Distance(const Vec3 &a, double x, double y, double z)
+{
+  return std::sqrt((a.x - x) * (a.x - x) + (a.y - y) * (a.y - y) + (a.z - z) * (a.z - z));
+}
+
+// a smooth version 2 table over axial advance ratio -2..2 and in-plane 0..2
+bool WriteTable(const std::string &path)
+{
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  const uint32_t header[3] = {2, 41, 21};
+  const double range[4] = {-2.0, 2.0, 0.0, 2.0};
+  fwrite("RTBL", 1, 4, file);
+  fwrite(header, sizeof(uint32_t), 3, file);
+  fwrite(range, sizeof(double), 4, file);
+  for (uint32_t i = 0; i < header[1]; ++i) {
+    for (uint32_t j = 0; j < header[2]; ++j) {
+      const double axial = range[0] + (range[1] - range[0]) * i / (header[1] - 1);
+      const double inplane = range[2] + (range[3] - range[2]) * j / (header[2] - 1);
+      const float c[2] = {static_cast<float>(0.1 - 0.08 * axial + 0.01 * inplane * inplane),
+                          static_cast<float>(0.005 + 0.003 * axial)};
+      fwrite(c, sizeof(float), 2, file);
+    }
+  }
+  return fclose(file) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int vehicles = argc > 1 ? atoi(argv[1]) : 2000;
+  const double air_density = 1.2041;
+
+  char path[] = "/tmp/rotor_kernel_check_XXXXXX";
+  const int fd = mkstemp(path);
+  RotorTable table;
+  std::string error;
+  if (fd < 0 || close(fd) != 0 || !WriteTable(path) || !table.Load(path, &error)) {
+    printf("cannot write a rotor table: %s\n", error.c_str());
+    return 1;
+  }
+  unlink(path);
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uni(-1.0, 1.0);
+  auto random_vec = [&](double scale) { return Vec3{uni(rng) * scale, uni(rng) * scale, uni(rng) * scale}; };
+  auto random_rot = [&](double max_angle) {
+    return AxisAngle(Vec3{uni(rng), uni(rng), uni(rng) + 1e-3}, uni(rng) * max_angle);
+  };
+
+  const int n = RotorSet::kMaxRotors;
+  double err_thrust = 0.0, err_drag = 0.0, err_drag_torque = 0.0, err_rolling = 0.0, err_load = 0.0;
+  double scale_thrust = 0.0, scale_torque = 0.0, scale_load = 0.0;
+  RotorSet set = RotorSet();
+  set.count = n;
+  set.air_density = air_density;
+
+  for (int v = 0; v < vehicles; ++v) {
+    const bool tabulated = v % 2;
+    set.table = tabulated ? &table : nullptr;
+
+    // load: rotors tilted up to 30 deg on the parent, directions cached
+    Rotor rotors[n];
+    Quat mount[n];
+    Vec3 spin_parent[n], axis_parent[n];
+    const Quat load_parent = random_rot(M_PI);
+    for (int k = 0; k < n; ++k) {
+      Rotor &m = rotors[k];
+      m.motor_constant = 5.84e-06 * (1.0 + 0.5 * uni(rng));
+      m.moment_constant = 0.06 * (1.0 + 0.5 * uni(rng));
+      m.rotor_drag_coefficient = 0.000175 * (1.0 + 0.5 * uni(rng));
+      m.rolling_moment_coefficient = 1e-06 * (1.0 + 0.5 * uni(rng));
+      m.turning_direction = k % 2 ? 1 : -1;
+      m.diameter = 0.25 * (1.0 + 0.5 * uni(rng));
+      set.motor_constant[k] = m.motor_constant;
+      set.moment_constant[k] = m.moment_constant;
+      set.rotor_drag_coefficient[k] = m.rotor_drag_coefficient;
+      set.rolling_moment_coefficient[k] = m.rolling_moment_coefficient;
+      set.turning_direction[k] = m.turning_direction;
+      set.diameter[k] = m.diameter;
+
+      mount[k] = random_rot(M_PI / 6.0);
+      const Quat link = load_parent * mount[k] * AxisAngle(Vec3{0, 0, 1}, uni(rng) * M_PI);
+      const Quat pose_difference = load_parent.GetInverse() * link;
+      spin_parent[k] = pose_difference.RotateVector(Vec3{0, 0, 1});
+      axis_parent[k] = load_parent.RotateVectorReverse(link.RotateVector(Vec3{0, 0, 1}));
+    }
+
+    // a later step: new attitude, rotors turned on their axes
+    const Quat parent = random_rot(M_PI);
+    Wrench ref[n];
+    for (int k = 0; k < n; ++k) {
+      const Quat link = parent * mount[k] * AxisAngle(Vec3{0, 0, 1}, uni(rng) * M_PI);
+      const Vec3 joint_axis = link.RotateVector(Vec3{0, 0, 1});
+      const Vec3 vel = random_vec(v % 4 < 2 ? 5.0 : 30.0);
+      const double w = 1100.0 * (0.5 + 0.5 * uni(rng)) * rotors[k].turning_direction;
+      ref[k] = MotorModel(rotors[k], set.table, air_density, w, vel, link, parent, joint_axis);
+
+      const Vec3 spin = parent.RotateVector(spin_parent[k]);
+      const Vec3 axis = parent.RotateVector(axis_parent[k]);
+      set.rot_vel[k] = w;
+      set.vel[0][k] = vel.x;
+      set.vel[1][k] = vel.y;
+      set.vel[2][k] = vel.z;
+      set.spin[0][k] = spin.x;
+      set.spin[1][k] = spin.y;
+      set.spin[2][k] = spin.z;
+      set.axis[0][k] = axis.x;
+      set.axis[1][k] = axis.y;
+      set.axis[2][k] = axis.z;
+    }
+
+    // drag torque and rolling moment one at a time, then the sum
+    double rolling[n];
+    for (int k = 0; k < n; ++k) {
+      rolling[k] = set.rolling_moment_coefficient[k];
+      set.rolling_moment_coefficient[k] = 0.0;
+    }
+    gazebo::ComputeRotorForces(&set);
+    for (int k = 0; k < n; ++k) {
+      err_drag_torque = std::fmax(err_drag_torque, Distance(ref[k].drag_torque, set.torque[0][k], set.torque[1][k],
+                                                            set.torque[2][k]));
+      set.rolling_moment_coefficient[k] = rolling[k];
+    }
+
+    gazebo::ComputeRotorForces(&set);
+    for (int k = 0; k < n; ++k) {
+      const Vec3 spin{set.spin[0][k], set.spin[1][k], set.spin[2][k]};
+      const Vec3 thrust = spin * set.thrust[k];
+      err_thrust = std::fmax(err_thrust, Distance(ref[k].thrust, thrust.x, thrust.y, thrust.z));
+      err_drag = std::fmax(err_drag, Distance(ref[k].drag, set.drag[0][k], set.drag[1][k], set.drag[2][k]));
+      const Vec3 torque = ref[k].drag_torque + ref[k].rolling_moment;
+      err_rolling = std::fmax(err_rolling, Distance(torque, set.torque[0][k], set.torque[1][k], set.torque[2][k]));
+      scale_thrust = std::fmax(scale_thrust, ref[k].thrust.GetLength());
+      scale_torque = std::fmax(scale_torque, torque.GetLength());
+
+      // the load the electric model sees, drag torque over speed squared,
+      // the analytic one also for a table near standstill
+      const double w2 = set.rot_vel[k] * set.rot_vel[k];
+      const double drag_torque = -rotors[k].turning_direction * ref[k].drag_torque.Dot(spin);
+      const double load = tabulated && w2 > 1.0 ? drag_torque / w2
+                                                : rotors[k].motor_constant * rotors[k].moment_constant;
+      err_load = std::fmax(err_load, std::fabs(set.load[k] - load));
+      scale_load = std::fmax(scale_load, std::fabs(load));
+    }
+  }
+
+  const double tol = 1e-12;
+  int failures = 0;
+  auto report = [&](const char *what, double err, double scale) {
+    const bool ok = err <= tol * scale;
+    printf("%-34s max error %10.3e of %9.3e %s\n", what, err, scale, ok ? "ok" : "FAIL");
+    failures += ok ? 0 : 1;
+  };
+  printf("%d vehicles of %d rotors, analytic and tabulated\n", vehicles, n);
+  report("thrust [N]", err_thrust, scale_thrust);
+  report("rotor drag [N]", err_drag, scale_thrust);
+  report("drag torque, parent frame [Nm]", err_drag_torque, scale_torque);
+  report("with rolling moment [Nm]", err_rolling, scale_torque);
+  report("load [Nm s^2]", err_load, scale_load);
+
+  // time per rotor, the last vehicle over and over
+  const int reps = 200000;
+  volatile double sink = 0.0;
+  for (int tabulated = 0; tabulated < 2; ++tabulated) {
+    set.table = tabulated ? &table : nullptr;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r) {
+      set.rot_vel[r % n] += 1e-9;
+      gazebo::ComputeRotorForces(&set);
+      sink = sink + set.torque[2][r % n];
+    }
+    const double kernel_ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / (double(reps) * n);
+    printf("%-10s kernel %6.1f ns per rotor\n", tabulated ? "tabulated" : "analytic", kernel_ns);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Rotor table against the analytic rotor formula
+ *
+ * Thrust and drag torque per rotor from a rotor table and from the
+ * GazeboMotorModel formula (k_f w^2 with the linear fade over airspeed,
+ * k_m times thrust), over the same precomputed rotor speeds and
+ * velocities. Prints both at a few flight conditions, then the time per
+ * rotor of each.
+ *
+ * Forward flight is checked against the table's own static thrust at the
+ * same rotor speed: a multirotor pitches nose down into the wind, so the
+ * rotor moves along its thrust axis (v_axial > 0) at V sin(tilt) and in
+ * plane at V cos(tilt). Thrust there must stay within 0.6 to 1.3 times
+ * static, exits non-zero otherwise.
+ *
+ *   rotor_table_bench table.rtbl [motor constant] [moment constant] [diameter]
+ *
+ * The constants default to the iris rotors, a table for them is
+ *   scripts/rotor_table_gen.py iris.rtbl --motor-constant 5.84e-06 \
+ *     --moment-constant 0.06 --diameter 0.254
+ */
+
+#include <rotor_table.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using gazebo::RotorTable;
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    printf("usage: %s table.rtbl [motor constant] [moment constant] [diameter]\n", argv[0]);
+    return 1;
+  }
+  const double motor_constant = argc > 2 ? atof(argv[2]) : 5.84e-06;
+  const double moment_constant = argc > 3 ? atof(argv[3]) : 0.06;
+  const double diameter = argc > 4 ? atof(argv[4]) : 0.254;
+  const double air_density = 1.225;
+
+  RotorTable table;
+  std::string error;
+  if (!table.Load(argv[1], &error)) {
+    printf("%s\n", error.c_str());
+    return 1;
+  }
+
+  auto analytic = [&](double w, double v_axial, double v_inplane, double *thrust, double *torque) {
+    const double force = w * w * motor_constant;
+    *torque = force * moment_constant;
+    double scalar = 1.0 - std::sqrt(v_axial * v_axial + v_inplane * v_inplane) / 25.0;
+    scalar = scalar < 0.0 ? 0.0 : scalar > 1.0 ? 1.0 : scalar;
+    *thrust = force * scalar;
+  };
+
+  printf("%-28s %10s %10s %10s %10s\n", "", "T formula", "T table", "Q formula", "Q table");
+  const double kDegree = M_PI / 180.0;
+  const struct {
+    const char *name;
+    double w, speed, tilt;
+    bool forward;
+  } cases[] = {
+    {"hover", 650.0, 0.0, 0.0, false},
+    {"climb 5 m/s", 700.0, 5.0, 90.0 * kDegree, false},
+    {"descent 5 m/s", 600.0, -5.0, 90.0 * kDegree, false},
+    {"forward 10 m/s, 8 deg tilt", 700.0, 10.0, 8.0 * kDegree, true},
+    {"forward 20 m/s, 20 deg tilt", 800.0, 20.0, 20.0 * kDegree, true},
+  };
+  bool ok = true;
+  for (const auto &c : cases) {
+    const double v_axial = c.speed * std::sin(c.tilt);
+    const double v_inplane = std::fabs(c.speed * std::cos(c.tilt));
+    double t0, q0, t1, q1;
+    analytic(c.w, v_axial, v_inplane, &t0, &q0);
+    table.Evaluate(c.w, v_axial, v_inplane, air_density, diameter, &t1, &q1);
+    printf("%-28s %10.3f %10.3f %10.4f %10.4f", c.name, t0, t1, q0, q1);
+    if (c.forward) {
+      double t_static, q_static;
+      table.Evaluate(c.w, 0.0, 0.0, air_density, diameter, &t_static, &q_static);
+      const double ratio = t1 / t_static;
+      const bool bounded = ratio >= 0.6 && ratio <= 1.3;
+      ok = ok && bounded;
+      printf("  %.2f of static %s", ratio, bounded ? "ok" : "FAIL");
+    }
+    printf("\n");
+  }
+
+  // inputs drawn once, both models run over the same arrays
+  const int n = 4096;
+  const int reps = 2000;
+  std::vector<double> w(n), v_axial(n), v_inplane(n), thrust(n), torque(n);
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  for (int i = 0; i < n; ++i) {
+    w[i] = 300.0 + 800.0 * uni(rng);
+    v_axial[i] = -8.0 + 16.0 * uni(rng);
+    v_inplane[i] = 20.0 * uni(rng);
+  }
+
+  double sum = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r) {
+    for (int i = 0; i < n; ++i) {
+      analytic(w[i], v_axial[i], v_inplane[i], &thrust[i], &torque[i]);
+    }
+    sum += thrust[r % n];
+  }
+  const double analytic_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / (double(reps) * n);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r) {
+    for (int i = 0; i < n; ++i) {
+      table.Evaluate(w[i], v_axial[i], v_inplane[i], air_density, diameter, &thrust[i], &torque[i]);
+    }
+    sum += thrust[r % n];
+  }
+  const double table_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / (double(reps) * n);
+
+  printf("formula %6.1f ns per rotor\n", analytic_ns);
+  printf("table   %6.1f ns per rotor (checksum %.6g)\n", table_ns, sum);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Binary record log written from a background thread
+ *
+ * The physics thread copies fixed size records into a ring, a writer
+ * thread drains it to disk in batches. The file is the plain sequence of
+ * records in host byte order, without header. When the disk cannot keep up
+ * records are dropped and counted rather than stalling the simulation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include <spsc_ring.h>
+
+namespace gazebo {
+
+template <typename T, size_t Capacity>
+class AsyncBinaryLog {
+  static_assert(std::is_trivially_copyable<T>::value, "records are written as raw bytes");
+
+public:
+  AsyncBinaryLog() : file_(nullptr), running_(false), dropped_(0) {}
+  ~AsyncBinaryLog() { Close(); }
+
+  bool Open(const std::string &path)
+  {
+    Close();
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+      return false;
+    }
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread(&AsyncBinaryLog::Run, this);
+    return true;
+  }
+
+  bool IsOpen() const { return file_ != nullptr; }
+
+  /// \brief Queue one record, never blocks.
+  void Write(const T &record)
+  {
+    if (!ring_.push(record)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  /// \brief Flush what is queued and close the file.
+  void Close()
+  {
+    if (!file_) {
+      return;
+    }
+    running_.store(false, std::memory_order_release);
+    thread_.join();
+    fclose(file_);
+    file_ = nullptr;
+  }
+
+private:
+  static constexpr int kBatch = 64;
+
+  void Run()
+  {
+    T batch[kBatch];
+    for (;;) {
+      // read the flag first, so records queued before Close() still go out
+      const bool running = running_.load(std::memory_order_acquire);
+      int n = 0;
+      while (n < kBatch && ring_.pop(batch[n])) {
+        ++n;
+      }
+      if (n > 0) {
+        fwrite(batch, sizeof(T), n, file_);
+      } else if (!running) {
+        break;
+      } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+    fflush(file_);
+  }
+
+  SpscRing<T, Capacity> ring_;
+  FILE *file_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> dropped_;
+};
+
+}  // namespace gazebo
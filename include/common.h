@@ -59,6 +59,28 @@ double GetDegrees360(const math::Angle& angle) {
   return degrees;
 }
 
+/**
+ * \brief Resize a repeated scalar field of a message that is refilled every step.
+ * Truncate() keeps the capacity, so only the first fill allocates.
+ */
+template<class T>
+void resizeRepeated(google::protobuf::RepeatedField<T>* field, int size) {
+  if (field->size() > size)
+    field->Truncate(size);
+  while (field->size() < size)
+    field->Add(T());
+}
+
+/**
+ * \brief Copy a vector into a message field in place, no sub-message is allocated after the first.
+ */
+template<class Derived>
+void setVector3d(msgs::Vector3d* msg, const Eigen::MatrixBase<Derived>& v) {
+  msg->set_x(v[0]);
+  msg->set_y(v[1]);
+  msg->set_z(v[2]);
+}
+
 
 }  // namespace gazebo
 
@@ -81,24 +103,26 @@ discretized system (ZoH):
     FirstOrderFilter(double timeConstantUp, double timeConstantDown, T initialState):
       timeConstantUp_(timeConstantUp),
       timeConstantDown_(timeConstantDown),
-      previousState_(initialState) {}
+      previousState_(initialState),
+      samplingTime_(-1.0),
+      alphaUp_(0.0),
+      alphaDown_(0.0) {}
 
     T updateFilter(T inputState, double samplingTime) {
       /*
       This method will apply a first order filter on the inputState.
+      The discrete coefficients only depend on the sampling time, which is
+      constant for a fixed step world, so they are only recomputed when it changes.
       */
-      T outputState;
-      if(inputState > previousState_){
-        // Calcuate the outputState if accelerating.
-        double alphaUp = exp(- samplingTime / timeConstantUp_);
-        // x(k+1) = Ad*x(k) + Bd*u(k)
-        outputState = alphaUp * previousState_ + (1 - alphaUp) * inputState;
-
-      }else{
-        // Calculate the outputState if decelerating.
-        double alphaDown = exp(- samplingTime / timeConstantDown_);
-        outputState = alphaDown * previousState_ + (1 - alphaDown) * inputState;
+      if (samplingTime != samplingTime_) {
+        alphaUp_ = exp(- samplingTime / timeConstantUp_);
+        alphaDown_ = exp(- samplingTime / timeConstantDown_);
+        samplingTime_ = samplingTime;
       }
+
+      // Accelerating or decelerating, x(k+1) = Ad*x(k) + Bd*u(k)
+      const double alpha = inputState > previousState_ ? alphaUp_ : alphaDown_;
+      T outputState = alpha * previousState_ + (1 - alpha) * inputState;
       previousState_ = outputState;
       return outputState;
 
@@ -109,6 +133,9 @@ discretized system (ZoH):
     double timeConstantUp_;
     double timeConstantDown_;
     T previousState_;
+    double samplingTime_;
+    double alphaUp_;
+    double alphaDown_;
 };
 
 
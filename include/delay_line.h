@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Fixed capacity delay line of time stamped samples
+ *
+ * Preallocated ring that keeps the newest Capacity samples and returns the
+ * one a given delay behind. Samples arrive once per physics step, so the
+ * position of the delayed sample follows from the mean spacing and the
+ * lookup only has to correct by a step when the step size varied.
+ */
+
+#pragma once
+
+namespace gazebo {
+
+template <typename T, int Capacity>
+class DelayLine {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  DelayLine() : head_(0), count_(0) {}
+
+  void Clear() { head_ = 0; count_ = 0; }
+
+  int Size() const { return count_; }
+
+  /// \brief Append a sample, overwriting the oldest one when full.
+  void Push(double time, const T &sample)
+  {
+    if (count_ > 0 && time <= time_[Index(count_ - 1)]) {
+      // sim time went backwards, the world was reset
+      Clear();
+    }
+    if (count_ == Capacity) {
+      head_ = (head_ + 1) & kMask;
+      --count_;
+    }
+    const int i = Index(count_++);
+    time_[i] = time;
+    sample_[i] = sample;
+  }
+
+  /// \brief Oldest sample that is at most delay old at time now, nullptr if
+  /// every sample is older than that.
+  const T *Delayed(double now, double delay) const
+  {
+    if (count_ == 0) {
+      return nullptr;
+    }
+
+    int k = 0;
+    if (count_ > 1) {
+      const double first = time_[Index(0)];
+      const double span = time_[Index(count_ - 1)] - first;
+      const double guess = (now - delay - first) / span * (count_ - 1);
+      k = guess <= 0.0 ? 0 : guess >= count_ - 1 ? count_ - 1 : static_cast<int>(guess);
+    }
+    while (k < count_ - 1 && now - time_[Index(k)] > delay) {
+      ++k;
+    }
+    while (k > 0 && now - time_[Index(k - 1)] <= delay) {
+      --k;
+    }
+
+    if (now - time_[Index(k)] > delay) {
+      return nullptr;
+    }
+    return &sample_[Index(k)];
+  }
+
+private:
+  static constexpr int kMask = Capacity - 1;
+
+  int Index(int i) const { return (head_ + i) & kMask; }
+
+  double time_[Capacity];
+  T sample_[Capacity];
+  int head_;
+  int count_;
+};
+
+}  // namespace gazebo
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Battery, ESC and motor electrical model
+ *
+ * One battery feeding the ESCs of all motors of a vehicle:
+ *  - battery: open circuit voltage linear in the state of charge, behind an
+ *    internal resistance,
+ *  - ESC: ideal buck converter, motor voltage = duty * bus voltage and
+ *    bus current = duty * motor current. The commanded rotor speed is
+ *    turned into the duty that reaches it at the present bus voltage, so
+ *    the motors reach their command as long as the duty stays below 1 and
+ *    lose speed once the sagging or draining battery saturates it.
+ *    Negative commands are taken as 0, there is no reverse thrust,
+ *  - motor: brushed DC equivalent of a BLDC motor, back-EMF constant
+ *    Ke = 1 / Kv and torque constant Kt = Ke in SI units, winding
+ *    resistance and no-load current. No regeneration.
+ *
+ * The motor inductance and the bus capacitance are much faster than a
+ * physics step and are left out. The bus voltage is taken from the current
+ * of the previous step, which breaks the algebraic loop between battery and
+ * motors without an iteration.
+ *
+ * Step() evaluates all motors at once, a few dozen flops and one square
+ * root per motor.
+ */
+
+#pragma once
+
+#include <cmath>
+
+namespace gazebo {
+
+static constexpr int kDefaultBatteryCells = 4;
+static constexpr double kDefaultBatteryCapacity = 5000.0;           // [mAh]
+static constexpr double kDefaultBatteryResistance = 0.02;           // pack [Ohm]
+static constexpr double kDefaultCellVoltageFull = 4.2;              // [V]
+static constexpr double kDefaultCellVoltageEmpty = 3.3;             // [V]
+static constexpr double kDefaultAvionicsCurrent = 0.5;              // [A]
+static constexpr double kDefaultMotorKv = 920.0;                    // [rpm/V]
+static constexpr double kDefaultMotorResistance = 0.1;              // [Ohm]
+static constexpr double kDefaultMotorNoLoadCurrent = 0.5;           // [A]
+
+struct BatteryState {
+  double voltage;        ///< terminal voltage [V]
+  double current;        ///< drawn from the battery [A]
+  double consumed;       ///< charge drawn since start [mAh]
+  double remaining;      ///< state of charge, 0 to 1
+  int cells;
+};
+
+class ElectricDrive {
+public:
+  static constexpr int kMaxMotors = 16;
+
+  ElectricDrive() : motor_count_(0)
+  {
+    SetBattery(kDefaultBatteryCells, kDefaultBatteryCapacity, kDefaultBatteryResistance,
+               kDefaultCellVoltageFull, kDefaultCellVoltageEmpty, kDefaultAvionicsCurrent);
+  }
+
+  void SetBattery(int cells, double capacity_mah, double resistance, double cell_voltage_full,
+                  double cell_voltage_empty, double avionics_current)
+  {
+    cells_ = cells;
+    capacity_ = capacity_mah * 3.6;  // [As]
+    battery_resistance_ = resistance;
+    voltage_full_ = cells * cell_voltage_full;
+    voltage_empty_ = cells * cell_voltage_empty;
+    avionics_current_ = avionics_current;
+    Reset();
+  }
+
+  /// \brief Motor parameters, Kv in rpm/V.
+  void SetMotor(int k, double kv, double resistance, double no_load_current)
+  {
+    ke_[k] = 60.0 / (2.0 * M_PI * kv);
+    resistance_[k] = resistance;
+    no_load_current_[k] = no_load_current;
+    current_[k] = 0.0;
+    duty_[k] = 0.0;
+    if (k >= motor_count_) {
+      motor_count_ = k + 1;
+    }
+  }
+
+  /// \brief Full battery, no current.
+  void Reset()
+  {
+    charge_used_ = 0.0;
+    bus_current_ = 0.0;
+    open_circuit_voltage_ = voltage_full_;
+  }
+
+  /// \brief Advance by dt [s].
+  /// \param command commanded rotor speed of every motor [rad/s], negative is 0
+  /// \param rot_vel rotor speed of every motor [rad/s]
+  /// \param load load torque of every motor over its speed squared [Nm s^2]
+  /// \param speed out, steady state speed each motor reaches at its duty
+  ///        and the present bus voltage [rad/s]
+  void Step(double dt, const double *command, const double *rot_vel, const double *load, double *speed)
+  {
+    const double bus_voltage = BusVoltage();
+    double bus_current = avionics_current_;
+
+    for (int k = 0; k < motor_count_; ++k) {
+      const double ke = ke_[k];
+      const double r = resistance_[k];
+      const double a = r * load[k] / ke;
+      const double v0 = r * no_load_current_[k];
+
+      // steady state Ke w + R (I0 + load w^2 / Kt) = V, forwards for the
+      // duty, against the open circuit voltage less the last IR drop
+      const double w_cmd = command[k] > 0.0 ? command[k] : 0.0;
+      const double v_cmd = ke * w_cmd + a * w_cmd * w_cmd + v0;
+      const double duty = w_cmd > 0.0 ? (v_cmd < bus_voltage ? v_cmd / bus_voltage : 1.0) : 0.0;
+      duty_[k] = duty;
+
+      // and backwards for the speed, the positive root in the form that
+      // stays finite for a vanishing load
+      const double v = duty * bus_voltage;
+      const double c = v - v0;
+      speed[k] = c > 0.0 ? 2.0 * c / (ke + std::sqrt(ke * ke + 4.0 * a * c)) : 0.0;
+
+      double i = (v - ke * std::fabs(rot_vel[k])) / r;
+      i = i > 0.0 ? i : 0.0;
+      current_[k] = i;
+      bus_current += duty * i;
+    }
+
+    bus_current_ = bus_current;
+    if (dt > 0.0) {
+      charge_used_ += bus_current * dt;
+    }
+    open_circuit_voltage_ = voltage_empty_ + Remaining() * (voltage_full_ - voltage_empty_);
+  }
+
+  double BusVoltage() const
+  {
+    const double v = open_circuit_voltage_ - battery_resistance_ * bus_current_;
+    return v > 0.0 ? v : 0.0;
+  }
+
+  double Remaining() const
+  {
+    const double remaining = 1.0 - charge_used_ / capacity_;
+    return remaining > 0.0 ? remaining : 0.0;
+  }
+
+  /// \brief Winding current of motor k in the last step [A].
+  double MotorCurrent(int k) const { return current_[k]; }
+  double Duty(int k) const { return duty_[k]; }
+
+  BatteryState Battery() const
+  {
+    BatteryState state;
+    state.voltage = BusVoltage();
+    state.current = bus_current_;
+    state.consumed = charge_used_ / 3.6;
+    state.remaining = Remaining();
+    state.cells = cells_;
+    return state;
+  }
+
+private:
+  int cells_;
+  double capacity_;              ///< [As]
+  double battery_resistance_;
+  double voltage_full_;
+  double voltage_empty_;
+  double avionics_current_;
+
+  double charge_used_;           ///< [As]
+  double bus_current_;
+  double open_circuit_voltage_;
+
+  int motor_count_;
+  double ke_[kMaxMotors];        ///< back-EMF and torque constant [V s/rad]
+  double resistance_[kMaxMotors];
+  double no_load_current_[kMaxMotors];
+  double current_[kMaxMotors];
+  double duty_[kMaxMotors];
+};
+
+}  // namespace gazebo
@@ -75,6 +75,7 @@ class GazeboControllerInterface : public ModelPlugin {
 
   transport::NodePtr node_handle_;
   transport::PublisherPtr motor_velocity_reference_pub_;
+  mav_msgs::msgs::CommandMotorSpeed turning_velocities_msg_;
   transport::SubscriberPtr cmd_motor_sub_;
 
   physics::ModelPtr model_;
@@ -29,6 +29,7 @@
 #include <gazebo/physics/physics.hh>
 #include <gazebo/rendering/rendering.hh>
 #include <SITLGps.pb.h>
+#include <mavlink_reactor.h>
 
 namespace gazebo
 {
@@ -49,7 +50,8 @@ public:
 
     void OnNewFrame(const unsigned char *image);
     void OnNewGpsPosition(GpsPtr& gps_msg);
-    void cameraThread();
+    void OnWorldUpdate(const common::UpdateInfo& info);
+    void OnSocketReadable();
 
 private:
     void _handle_message(mavlink_message_t *msg, struct sockaddr* srcaddr);
@@ -92,6 +94,8 @@ private:
     rendering::CameraPtr        _camera;
     rendering::ScenePtr         _scene;
     event::ConnectionPtr        _newFrameConnection;
+    event::ConnectionPtr        _updateConnection;
+    physics::WorldPtr           _world;
     std::string                 _storageDir;
     math::Vector3               _lastGpsPosition;
     transport::NodePtr          _node_handle;
@@ -100,7 +104,8 @@ private:
     std::string                 _format;
     struct sockaddr_in          _myaddr;    ///< The locally bound address
     struct sockaddr_in          _gcsaddr;   ///< GCS target
-    struct pollfd               _fds[1];
+    mavlink_status_t            _status;
+    mavlink_message_t           _msg;
     std::mutex                  _captureMutex;
 };
 
@@ -32,10 +32,12 @@
 #include <gazebo/sensors/sensors.hh>
 
 #include "SensorImu.pb.h"
+#include "JointCommand.pb.h"
 
 namespace gazebo
 {
   typedef const boost::shared_ptr<const sensor_msgs::msgs::Imu> ImuPtr;
+  typedef const boost::shared_ptr<const joint_msgs::msgs::JointCommand> JointCommandPtr;
 
   class GAZEBO_VISIBLE GimbalControllerPlugin : public ModelPlugin
   {
@@ -50,6 +52,10 @@ namespace gazebo
 
     private: void ImuCallback(ImuPtr& imu_message);
 
+    /// \brief targets from the mavlink interface, the channels whose
+    /// gztopic is one of the command topics below drive the gimbal
+    private: void OnJointCommand(JointCommandPtr &_msg);
+
 #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
     /// only gazebo 7.4 and above support Any
     private: void OnPitchStringMsg(ConstAnyPtr &_msg);
@@ -84,6 +90,11 @@ namespace gazebo
     private: transport::SubscriberPtr pitchSub;
     private: transport::SubscriberPtr rollSub;
     private: transport::SubscriberPtr yawSub;
+    private: transport::SubscriberPtr jointCommandSub;
+
+    private: std::string pitchCmdTopic;
+    private: std::string rollCmdTopic;
+    private: std::string yawCmdTopic;
 
     private: transport::PublisherPtr pitchPub;
     private: transport::PublisherPtr rollPub;
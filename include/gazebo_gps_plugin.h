@@ -30,11 +30,14 @@
 #include <math.h>
 #include <cstdio>
 #include <cstdlib>
-#include <queue>
-#include <random>
 
 #include <sdf/sdf.hh>
 #include <common.h>
+#include <async_binary_log.h>
+#include <delay_line.h>
+#include <geodesy.h>
+#include <noise_generator.h>
+#include <sensor_bus.h>
 
 #include <gazebo/common/Plugin.hh>
 #include <gazebo/gazebo.hh>
@@ -49,6 +52,17 @@
 
 namespace gazebo
 {
+/// \brief One record of the binary groundtruth log
+struct GroundtruthRecord {
+  double time;            ///< sim time [s]
+  double latitude_rad;
+  double longitude_rad;
+  double altitude;        ///< [m]
+  double velocity_east;   ///< [m/s]
+  double velocity_north;
+  double velocity_up;
+};
+
 class GAZEBO_VISIBLE GpsPlugin : public ModelPlugin
 {
 public:
@@ -60,11 +74,8 @@ protected:
   virtual void OnUpdate(const common::UpdateInfo&);
 
 private:
-  std::pair<double, double> reproject(math::Vector3& pos);
-
   std::string namespace_;
-  std::default_random_engine random_generator_;
-  std::normal_distribution<float> standard_normal_distribution_;
+  NoiseGenerator noise_;
 
   bool gps_noise_;
 
@@ -75,37 +86,28 @@ private:
   transport::NodePtr node_handle_;
   transport::PublisherPtr gt_pub_;
   transport::PublisherPtr gps_pub_;
+  GpsSlot* gps_bus_;
 
   gps_msgs::msgs::SITLGps gps_msg;
   gps_msgs::msgs::Groundtruth groundtruth_msg;
 
   common::Time last_gps_time_;
-  common::Time last_time_;
+  common::Time last_gt_time_;
 
-  // Set global reference point
-  // Zurich Irchel Park: 47.397742, 8.545594, 488m
-  // Seattle downtown (15 deg declination): 47.592182, -122.316031, 86m
-  // Moscow downtown: 55.753395, 37.625427, 155m
-
-  // The home position can be specified using the environment variables:
-  // PX4_HOME_LAT, PX4_HOME_LON, and PX4_HOME_ALT
-
-  // Zurich Irchel Park
-  double lat_home = 47.397742 * M_PI / 180.0;  // rad
-  double lon_home = 8.545594 * M_PI / 180.0;   // rad
-  double alt_home = 488.0;                     // meters
-  // Seattle downtown (15 deg declination): 47.592182, -122.316031
-  // static const double lat_home = 47.592182 * M_PI / 180;    // rad
-  // static const double lon_home = -122.316031 * M_PI / 180;  // rad
-  // static const double alt_home = 86.0;                      // meters
+  // groundtruth publish rate [Hz], 0 disables the topic
+  double gt_rate_;
+  // every physics step, when groundtruthLog names a file
+  AsyncBinaryLog<GroundtruthRecord, 4096> gt_log_;
+  common::Time last_time_;
 
-  static constexpr const double earth_radius = 6353000.0;      // meters
+  // WGS84 frame anchored at home, Gazebo world axes are east, north, up
+  LocalTangentFrame home_frame_;
 
   // gps delay related
   static constexpr double gps_update_interval_ = 0.2; // 5hz
   static constexpr double gps_delay = 0.12;           // 120 ms
-  static constexpr int gps_buffer_size_max = 1000;
-  std::queue<gps_msgs::msgs::SITLGps> gps_delay_buffer;
+  // holds gps_delay at physics steps down to 0.12 ms
+  DelayLine<GpsSample, 1024> gps_delay_line_;
 
   math::Vector3 gps_bias;
   math::Vector3 noise_gps_pos;
@@ -117,8 +119,6 @@ private:
   // gps noise parameters
   double std_xy;    // meters
   double std_z;     // meters
-  std::default_random_engine rand_;
-  std::normal_distribution<float> randn_;
   static constexpr double gps_corellation_time = 60.0;    // s
   static constexpr double gps_xy_random_walk = 2.0;       // (m/s) / sqrt(hz)
   static constexpr double gps_z_random_walk = 4.0;        // (m/s) / sqrt(hz)
@@ -18,7 +18,6 @@
  * limitations under the License.
  */
 
-#include <random>
 
 #include <Eigen/Core>
 #include "SensorImu.pb.h"
@@ -30,6 +29,9 @@
 #include "gazebo/msgs/msgs.hh"
 
 #include "common.h"
+#include "imu_preintegrator.h"
+#include "noise_generator.h"
+#include "sensor_bus.h"
 
 namespace gazebo {
 //typedef const boost::shared_ptr<const sensor_msgs::msgs::Imu> ImuPtr;
@@ -56,6 +58,13 @@ static constexpr double kDefaultGravityMagnitude = 9.8068;
 
 static const std::string kDefaultImuTopic = "imu";
 
+//! Redundant IMUs one plugin can simulate, PX4 reads up to three
+static constexpr int kMaxImuInstances = 3;
+
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+//! One column per IMU instance, gyroscope x, y, z then accelerometer x, y, z
+typedef Eigen::Matrix<double, 6, kMaxImuInstances> ImuChannels;
+
 // A description of the parameters:
 // https://github.com/ethz-asl/kalibr/wiki/IMU-Noise-Model-and-Intrinsics
 // TODO(burrimi): Should I have a minimalistic description of the params here?
@@ -94,6 +103,16 @@ struct ImuParameters {
         gravity_magnitude(kDefaultGravityMagnitude) {}
 };
 
+/// \brief Discrete-time noise coefficients for one step size, per channel.
+struct ImuNoiseDiscretization {
+  double dt;               ///< step the coefficients were computed for [s]
+  Vector6d sigma_white;    ///< white noise standard deviation
+  Vector6d sigma_bias;     ///< bias driving noise standard deviation
+  Vector6d phi_bias;       ///< bias state transition
+
+  ImuNoiseDiscretization() : dt(-1.0) {}
+};
+
 class GazeboImuPlugin : public ModelPlugin {
  public:
 
@@ -106,10 +125,9 @@ class GazeboImuPlugin : public ModelPlugin {
  protected:
   void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
 
-  void addNoise(
-      Eigen::Vector3d* linear_acceleration,
-      Eigen::Vector3d* angular_velocity,
-      const double dt);
+  void updateDiscretization(const double dt);
+
+  void addNoise(ImuChannels* measurements, const double dt);
 
   void OnUpdate(const common::UpdateInfo&);
 
@@ -117,12 +135,16 @@ class GazeboImuPlugin : public ModelPlugin {
   std::string namespace_;
   std::string imu_topic_;
   transport::NodePtr node_handle_;
-  transport::PublisherPtr imu_pub_;
+  int instances_;
+  transport::PublisherPtr imu_pub_[kMaxImuInstances];
+  ImuSlot* imu_bus_[kMaxImuInstances];
   std::string frame_id_;
   std::string link_name_;
 
-  std::default_random_engine random_generator_;
-  std::normal_distribution<double> standard_normal_distribution_;
+  NoiseGenerator noise_;
+
+  double output_rate_;
+  ImuPreintegrator preintegrator_[kMaxImuInstances];
 
   // Pointer to the world
   physics::WorldPtr world_;
@@ -140,12 +162,15 @@ class GazeboImuPlugin : public ModelPlugin {
   math::Vector3 gravity_W_;
   math::Vector3 velocity_prev_W_;
 
-  Eigen::Vector3d gyroscope_bias_;
-  Eigen::Vector3d accelerometer_bias_;
-
-  Eigen::Vector3d gyroscope_turn_on_bias_;
-  Eigen::Vector3d accelerometer_turn_on_bias_;
+  ImuChannels bias_;
+  ImuChannels turn_on_bias_;
+  ImuChannels bias_noise_;
+  ImuChannels white_noise_;
+  ImuNoiseDiscretization discretization_;
 
   ImuParameters imu_parameters_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 }
@@ -21,12 +21,14 @@
 #include <vector>
 #include <thread>
 #include <mutex>
-#include <deque>
+#include <condition_variable>
+#include <map>
 #include <atomic>
 #include <chrono>
 #include <memory>
 #include <sstream>
 #include <cassert>
+#include <cerrno>
 #include <stdexcept>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -34,13 +36,17 @@
 #include <boost/system/system_error.hpp>
 
 #include <iostream>
-#include <random>
 #include <stdio.h>
 #include <math.h>
 #include <cstdlib>
+#include <fstream>
 #include <string>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <Eigen/Eigen>
 
@@ -62,16 +68,29 @@
 #include <sonarSens.pb.h>
 #include <SITLGps.pb.h>
 #include <irlock.pb.h>
-#include <Groundtruth.pb.h>
 #include <odom.pb.h>
+#include <HilLatency.pb.h>
+#include <JointCommand.pb.h>
+#include <Battery.pb.h>
 
 #include <mavlink/v2.0/common/mavlink.h>
-#include "msgbuffer.h"
 
 #include <geo_mag_declination.h>
+#include <geodesy.h>
+#include <hil_latency_tracker.h>
+#include <joint_pid_bank.h>
+#include <mavlink_framer.h>
+#include <mavlink_rate_scheduler.h>
+#include <mavlink_reactor.h>
+#include <mavlink_shm_transport.h>
+#include <noise_generator.h>
+#include <sensor_bus.h>
+#include <spsc_ring.h>
 
 static const uint32_t kDefaultMavlinkUdpPort = 14560;
 static const uint32_t kDefaultQGCUdpPort = 14550;
+static const uint32_t kDefaultLockstepTimeoutMs = 1000;
+static const int kDefaultMavlinkProtocolVersion = 1;
 
 using lock_guard = std::lock_guard<std::recursive_mutex>;
 static constexpr auto kDefaultDevice = "/dev/ttyACM0";
@@ -79,7 +98,21 @@ static constexpr auto kDefaultBaudRate = 921600;
 
 //! Maximum buffer size with padding for CRC bytes (280 + padding)
 static constexpr ssize_t MAX_SIZE = MAVLINK_MAX_PACKET_LEN + 16;
-static constexpr size_t MAX_TXQ_SIZE = 1000;
+//! Frames queued for the serial link, bounds its latency to a few frame times
+static constexpr size_t kSerialTxSlots = 64;
+
+//! Datagrams fetched per recvmmsg() call and the size of each receive slot
+static constexpr unsigned kRxBatchSize = 32;
+static constexpr size_t kRxDatagramSize = 2048;
+//! Default cap on datagrams consumed per world step
+static constexpr unsigned kDefaultMaxRxDatagramsPerStep = 256;
+//! Frames collected per step before they are flushed with one sendmmsg()
+static constexpr unsigned kTxBatchSize = 64;
+//! Frames buffered between the simulation and the MAVLink I/O thread
+static constexpr size_t kTxRingSize = 256;
+static constexpr size_t kRxRingSize = 64;
+//! Upper bound on how long the I/O thread sleeps without looking at the socket
+static constexpr int kIoThreadPollMs = 10;
 
 namespace gazebo {
 typedef const boost::shared_ptr<const mav_msgs::msgs::CommandMotorSpeed> CommandMotorSpeedPtr;
@@ -89,8 +122,8 @@ typedef const boost::shared_ptr<const opticalFlow_msgs::msgs::opticalFlow> Optic
 typedef const boost::shared_ptr<const sonarSens_msgs::msgs::sonarSens> SonarSensPtr;
 typedef const boost::shared_ptr<const irlock_msgs::msgs::irlock> IRLockPtr;
 typedef const boost::shared_ptr<const gps_msgs::msgs::SITLGps> GpsPtr;
-typedef const boost::shared_ptr<const gps_msgs::msgs::Groundtruth> GtPtr;
 typedef const boost::shared_ptr<const odom_msgs::msgs::odom> OdomPtr;
+typedef const boost::shared_ptr<const battery_msgs::msgs::Battery> BatteryPtr;
 
 // Default values
 static const std::string kDefaultNamespace = "";
@@ -106,13 +139,21 @@ static const std::string kDefaultSonarTopic = "/sonar_model/link/sonar";
 static const std::string kDefaultIRLockTopic = "/camera/link/irlock";
 static const std::string kDefaultGPSTopic = "/gps";
 static const std::string kDefaultVisionTopic = "/vision_odom";
+static const std::string kDefaultBatteryTopic = "/battery";
+
+//! How an actuator output drives its joint, parsed from <joint_control_type>
+enum JointControlType {
+  kJointControlNone = 0,
+  kJointControlVelocity,
+  kJointControlPosition,
+  kJointControlPositionGztopic,
+  kJointControlPositionKinematic
+};
 
-//! Rx packer framing status. (same as @p mavlink::mavlink_framing_t)
-enum class Framing : uint8_t {
-	incomplete = MAVLINK_FRAMING_INCOMPLETE,
-	ok = MAVLINK_FRAMING_OK,
-	bad_crc = MAVLINK_FRAMING_BAD_CRC,
-	bad_signature = MAVLINK_FRAMING_BAD_SIGNATURE,
+//! Outgoing frame handed to the MAVLink I/O thread
+struct MavlinkTxFrame {
+  mavlink_message_t msg;
+  int destination_port;
 };
 
 class GazeboMavlinkInterface : public ModelPlugin {
@@ -133,6 +174,7 @@ public:
     irlock_sub_topic_(kDefaultIRLockTopic),
     gps_sub_topic_(kDefaultGPSTopic),
     vision_sub_topic_(kDefaultVisionTopic),
+    battery_sub_topic_(kDefaultBatteryTopic),
     model_ {},
     world_(nullptr),
     left_elevon_joint_(nullptr),
@@ -147,22 +189,65 @@ public:
     zero_position_disarmed_ {},
     zero_position_armed_ {},
     input_index_ {},
+    joint_control_type_ {},
+    pid_channel_ {},
+    pid_err_ {},
+    pid_cmd_ {},
     groundtruth_lat_rad(0.0),
     groundtruth_lon_rad(0.0),
     groundtruth_altitude(0.0),
     mavlink_udp_port_(kDefaultMavlinkUdpPort),
     qgc_udp_port_(kDefaultMavlinkUdpPort),
+    udp_framer_(mavlinkMsgInfo),
+    serial_framer_(mavlinkMsgInfo),
+    udp_rx_msg_ {},
+    udp_rx_status_ {},
+    serial_rx_msg_ {},
+    serial_rx_status_ {},
     serial_enabled_(false),
-    tx_q {},
+    tx_in_progress(false),
+    serial_tx_free_count_(0),
+    serial_tx_head_(0),
+    serial_tx_count_(0),
+    serial_tx_inflight_(0),
+    serial_tx_dropped_superseded_(0),
+    serial_tx_dropped_other_(0),
     rx_buf {},
-    m_status {},
-    m_buffer {},
     io_service(),
     serial_dev(io_service),
     device_(kDefaultDevice),
     baudrate_(kDefaultBaudRate),
     hil_mode_(false),
-    hil_state_level_(false)
+    hil_state_level_(false),
+    enable_lockstep_(false),
+    lockstep_timeout_ms_(kDefaultLockstepTimeoutMs),
+    awaiting_actuator_controls_(false),
+    pending_sensor_time_usec_(0),
+    lockstep_stall_count_(0),
+    max_rx_datagrams_per_step_(kDefaultMaxRxDatagramsPerStep),
+    rx_datagrams_last_step_(0),
+    rx_datagrams_total_(0),
+    rx_cap_hit_count_(0),
+    rx_iteration_(0),
+    udp_send_batching_(false),
+    tx_batch_count_(0),
+    mavlink_io_thread_enabled_(false),
+    mavlink_io_running_(false),
+    mavlink_io_sleeping_(false),
+    io_wake_pipe_ {-1, -1},
+    tx_ring_dropped_(0),
+    rx_ring_dropped_(0),
+    use_shm_transport_(false),
+    mavlink_protocol_version_(kDefaultMavlinkProtocolVersion),
+    tx_status_ {},
+    mavlink_stats_interval_(0.0),
+    latency_report_interval_(0.0),
+    latency_report_last_(0.0),
+    use_sensor_bus_(false),
+    imu_bus_(nullptr),
+    gps_bus_(nullptr),
+    vision_bus_(nullptr),
+    battery_bus_(nullptr)
     {}
 
   ~GazeboMavlinkInterface();
@@ -172,6 +257,7 @@ public:
 protected:
   void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
   void OnUpdate(const common::UpdateInfo&  /*_info*/);
+  void OnUpdateEnd();
 
 private:
   bool received_first_referenc_;
@@ -184,6 +270,7 @@ private:
 
   transport::NodePtr node_handle_;
   transport::PublisherPtr motor_velocity_reference_pub_;
+  mav_msgs::msgs::CommandMotorSpeed turning_velocities_msg_;
   transport::SubscriberPtr mav_control_sub_;
 
   physics::ModelPtr model_;
@@ -207,24 +294,58 @@ private:
   bool vehicle_is_tailsitter_;
 
   std::vector<physics::JointPtr> joints_;
-  std::vector<common::PID> pids_;
 
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
+  /// \brief Pointer to the update end event connection.
+  event::ConnectionPtr updateEndConnection_;
+  /// \brief Drains the sensor bus once the other plugins updated.
+  event::ConnectionPtr sensorBusConnection_;
 
   boost::thread callback_queue_thread_;
   void QueueThread();
   void ImuCallback(ImuPtr& imu_msg);
   void GpsCallback(GpsPtr& gps_msg);
-  void GroundtruthCallback(GtPtr& groundtruth_msg);
+  void handleImu(const ImuSample& imu);
+  void handleGps(const GpsSample& gps);
+  void handleVision(const VisionSample& vision);
+  void handleBattery(const BatterySample& battery);
+  void drainSensorBus();
   void LidarCallback(LidarPtr& lidar_msg);
   void SonarCallback(SonarSensPtr& sonar_msg);
   void OpticalFlowCallback(OpticalFlowPtr& opticalFlow_msg);
   void IRLockCallback(IRLockPtr& irlock_msg);
   void VisionCallback(OdomPtr& odom_msg);
-  void send_mavlink_message(const mavlink_message_t *message, const int destination_port = 0);
+  void BatteryCallback(BatteryPtr& battery_msg);
+  void send_mavlink_message(mavlink_message_t *message, const int destination_port = 0);
+  void forward_mavlink_frame(const uint8_t *frame, size_t len, uint32_t msgid, const int destination_port = 0);
+  void decode_mavlink_frame(mavlink_message_t *rx_msg, mavlink_status_t *rx_status, const uint8_t *frame, size_t len);
   void handle_message(mavlink_message_t *msg);
+  void handle_actuator_controls(const mavlink_hil_actuator_controls_t &controls);
   void pollForMAVLinkMessages(double _dt, uint32_t _timeoutMs);
+  void onMAVLinkSocketReadable();
+  unsigned receiveMAVLinkDatagrams(unsigned max_datagrams);
+  void parseMAVLinkDatagram(const uint8_t *buf, size_t len);
+  static bool mavlinkMsgInfo(uint32_t msgid, uint8_t *crc_extra, uint8_t *max_len);
+  void flushMAVLinkTxBatch();
+  void flushMAVLinkTxBatchLocked();
+  void queueMAVLinkTxFrameLocked(const mavlink_message_t *message, const int destination_port);
+  void queueMAVLinkTxBytesLocked(const uint8_t *frame, size_t len, const int destination_port);
+  void onLockstepStall(uint32_t _timeoutMs);
+
+  // MAVLink I/O thread
+  void MavlinkIoThread();
+  void wakeMavlinkIoThread();
+  void sendQueuedMAVLinkFrames();
+  void pollActuatorControlsRing(uint32_t _timeoutMs);
+
+  // Shared memory transport
+  void pollShmTransport(uint32_t _timeoutMs);
+
+  // Output accounting
+  void countTxFrame(uint32_t msgid, size_t bytes);
+  void reportTxStats();
+  void reportLatency();
 
   // Serial interface
   void open();
@@ -232,6 +353,11 @@ private:
   void do_read();
   void parse_buffer(const boost::system::error_code& err, std::size_t bytes_t);
   void do_write(bool check_tx_state);
+  struct SerialTxSlot;
+  SerialTxSlot *serialTxAllocLocked(uint32_t msgid);
+  bool serialTxMakeRoomLocked(uint32_t incoming_msgid);
+  void serialTxRemoveLocked(size_t pos);
+  void serialTxReleaseInflightLocked();
   inline bool is_open(){
     return serial_dev.is_open();
   }
@@ -243,12 +369,32 @@ private:
 
   double input_offset_[n_out_max];
   double input_scaling_[n_out_max];
-  std::string joint_control_type_[n_out_max];
-  std::string gztopic_[n_out_max];
   double zero_position_disarmed_[n_out_max];
   double zero_position_armed_[n_out_max];
   int input_index_[n_out_max];
+  JointControlType joint_control_type_[n_out_max];
+  std::string gztopic_[n_out_max];
+
+  // Channel table compiled in Load(), handle_control() only walks these.
+  // Velocity and position channels share one PID bank, slot k drives
+  // channel pid_channel_[k].
+  JointPidBank<n_out_max> pid_bank_;
+  int pid_channel_[n_out_max];
+  double pid_err_[n_out_max];
+  double pid_cmd_[n_out_max];
+  std::vector<int> gztopic_channels_;
+  std::vector<int> kinematic_channels_;
+  // Each gztopic target goes out on its own topic, and all of them in one
+  // message per step where each entry carries the channel's gztopic so
+  // consumers pick out their own channels
   transport::PublisherPtr joint_control_pub_[n_out_max];
+#if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
+  gazebo::msgs::Any joint_control_msg_;
+#else
+  gazebo::msgs::GzString joint_control_msg_;
+#endif
+  transport::PublisherPtr joint_command_pub_;
+  joint_msgs::msgs::JointCommand joint_command_msg_;
 
   transport::SubscriberPtr imu_sub_;
   transport::SubscriberPtr lidar_sub_;
@@ -256,8 +402,8 @@ private:
   transport::SubscriberPtr opticalFlow_sub_;
   transport::SubscriberPtr irlock_sub_;
   transport::SubscriberPtr gps_sub_;
-  transport::SubscriberPtr groundtruth_sub_;
   transport::SubscriberPtr vision_sub_;
+  transport::SubscriberPtr battery_sub_;
 
   std::string imu_sub_topic_;
   std::string lidar_sub_topic_;
@@ -265,13 +411,16 @@ private:
   std::string sonar_sub_topic_;
   std::string irlock_sub_topic_;
   std::string gps_sub_topic_;
-  std::string groundtruth_sub_topic_;
   std::string vision_sub_topic_;
+  std::string battery_sub_topic_;
 
   common::Time last_time_;
   common::Time last_imu_time_;
   common::Time last_actuator_time_;
 
+  // true position of the vehicle, reprojected from the model pose when a
+  // message needs it
+  LocalTangentFrame home_frame_;
   double groundtruth_lat_rad;
   double groundtruth_lon_rad;
   double groundtruth_altitude;
@@ -284,15 +433,19 @@ private:
   math::Vector3 velocity_prev_W_;
   math::Vector3 mag_d_;
 
-  std::default_random_engine rand_;
-  std::normal_distribution<float> randn_;
+  NoiseGenerator noise_;
 
-  int _fd;
+  int _fd = -1;
   struct sockaddr_in _myaddr;     ///< The locally bound address
   struct sockaddr_in _srcaddr;    ///< SITL instance
   socklen_t _addrlen;
-  unsigned char _buf[65535];
-  struct pollfd fds[1];
+  // Preallocated receive batch, drained with recvmmsg() every step
+  uint8_t rx_bufs_[kRxBatchSize][kRxDatagramSize];
+  struct sockaddr_in rx_addrs_[kRxBatchSize];
+#if defined(__linux__)
+  struct iovec rx_iovecs_[kRxBatchSize];
+  struct mmsghdr rx_msgs_[kRxBatchSize];
+#endif
 
   struct sockaddr_in _srcaddr_2;  ///< MAVROS
 
@@ -308,8 +461,15 @@ private:
   int qgc_udp_port_;
 
   // Serial interface
-  mavlink_status_t m_status;
-  mavlink_message_t m_buffer;
+  // Raw frame boundaries of the two incoming streams, only handled ids get decoded
+  MavlinkFramer udp_framer_;
+  MavlinkFramer serial_framer_;
+  // Decoder state of each stream, the MAVLINK_COMM_n channels are process
+  // wide and shared with the other vehicles and plugins in gzserver
+  mavlink_message_t udp_rx_msg_;
+  mavlink_status_t udp_rx_status_;
+  mavlink_message_t serial_rx_msg_;
+  mavlink_status_t serial_rx_status_;
   bool serial_enabled_;
   std::thread io_thread;
   std::string device_;
@@ -317,12 +477,115 @@ private:
   std::recursive_mutex mutex;
   unsigned int baudrate_;
   std::atomic<bool> tx_in_progress;
-  std::deque<MsgBuffer> tx_q;
+
+  // Serial tx ring, guarded by mutex. Frames live in preallocated slots; the
+  // order ring holds slot indices so a superseded frame can be dropped from
+  // the middle. The first serial_tx_inflight_ entries belong to the
+  // scatter-gather write in progress and are never touched.
+  struct SerialTxSlot {
+    uint32_t msgid;
+    uint16_t len;
+    uint8_t data[MAVLINK_MAX_PACKET_LEN];
+  };
+  SerialTxSlot serial_tx_slots_[kSerialTxSlots];
+  uint16_t serial_tx_free_[kSerialTxSlots];
+  size_t serial_tx_free_count_;
+  uint16_t serial_tx_order_[kSerialTxSlots];
+  size_t serial_tx_head_;
+  size_t serial_tx_count_;
+  size_t serial_tx_inflight_;
+  std::vector<boost::asio::const_buffer> serial_tx_gather_;
+  uint64_t serial_tx_dropped_superseded_;
+  uint64_t serial_tx_dropped_other_;
   boost::asio::io_service io_service;
   boost::asio::serial_port serial_dev;
 
   bool hil_mode_;
   bool hil_state_level_;
 
+  // Lockstep: block the world step until the HIL_ACTUATOR_CONTROLS answering
+  // the last HIL_SENSOR has arrived (or lockstep_timeout_ms_ has elapsed).
+  bool enable_lockstep_;
+  uint32_t lockstep_timeout_ms_;
+  std::atomic<bool> awaiting_actuator_controls_;
+  std::atomic<uint64_t> pending_sensor_time_usec_;
+  uint64_t lockstep_stall_count_;
+
+  // Receive path statistics, the cap keeps a datagram flood from stalling physics
+  unsigned max_rx_datagrams_per_step_;
+  unsigned rx_datagrams_last_step_;
+  uint64_t rx_datagrams_total_;
+  uint64_t rx_cap_hit_count_;
+  uint64_t rx_iteration_;
+
+  // Outgoing frames of one world step, sent in order with sendmmsg() at WorldUpdateEnd
+  bool udp_send_batching_;
+  std::mutex tx_batch_mutex_;
+  unsigned tx_batch_count_;
+  uint8_t tx_bufs_[kTxBatchSize][MAVLINK_MAX_PACKET_LEN];
+  struct sockaddr_in tx_addrs_[kTxBatchSize];
+#if defined(__linux__)
+  struct iovec tx_iovecs_[kTxBatchSize];
+  struct mmsghdr tx_msgs_[kTxBatchSize];
+#else
+  size_t tx_msgs_len_[kTxBatchSize];
+#endif
+
+  // Optional dedicated socket thread. Sensor callbacks and physics only push
+  // frames into tx_ring_ and pop decoded actuator controls from rx_ring_.
+  bool mavlink_io_thread_enabled_;
+  std::thread mavlink_io_thread_;
+  std::atomic<bool> mavlink_io_running_;
+  std::atomic<bool> mavlink_io_sleeping_;
+  int io_wake_pipe_[2];
+  std::mutex tx_ring_push_mutex_;   ///< serializes the sensor callbacks, the only producers
+  SpscRing<MavlinkTxFrame, kTxRingSize> tx_ring_;
+  SpscRing<mavlink_hil_actuator_controls_t, kRxRingSize> rx_ring_;
+  std::mutex rx_ring_wait_mutex_;
+  std::condition_variable rx_ring_cv_;
+  std::atomic<uint64_t> tx_ring_dropped_;
+  std::atomic<uint64_t> rx_ring_dropped_;
+
+  // Same-host alternative to the UDP socket, selected with <transport>shm</transport>
+  bool use_shm_transport_;
+  std::string shm_name_;
+  MavlinkShmTransport shm_transport_;
+
+  // MAVLink 2 drops trailing zero bytes of the payload, MAVLink 1 always sends it whole
+  int mavlink_protocol_version_;
+  // Wire format and sequence numbers of this vehicle's output. Messages are
+  // encoded on the shared MAVLINK_COMM_0 and finalized again against this.
+  std::mutex tx_status_mutex_;
+  mavlink_status_t tx_status_;
+
+  // Frames and bytes sent per message id, reported every mavlink_stats_interval_ seconds
+  struct TxMsgStats {
+    uint64_t msgs;
+    uint64_t bytes;
+  };
+  double mavlink_stats_interval_;
+  std::mutex tx_stats_mutex_;
+  std::map<uint32_t, TxMsgStats> tx_stats_;
+  std::chrono::steady_clock::time_point tx_stats_start_;
+
+  // Skips outgoing messages, and the work behind them, that are not due yet
+  MavlinkRateScheduler output_rates_;
+
+  // HIL_SENSOR to HIL_ACTUATOR_CONTROLS round trip, reported every
+  // latency_report_interval_ seconds of sim time, 0 disables it
+  double latency_report_interval_;
+  double latency_report_last_;
+  HilLatencyTracker latency_tracker_;
+  transport::PublisherPtr latency_pub_;
+  std::ofstream latency_csv_;
+
+  // IMU, GPS, vision and battery straight from the plugins of this
+  // vehicle instead of over Gazebo transport, see sensor_bus.h
+  bool use_sensor_bus_;
+  ImuSlot* imu_bus_;
+  GpsSlot* gps_bus_;
+  VisionSlot* vision_bus_;
+  BatterySlot* battery_bus_;
+
   };
 }
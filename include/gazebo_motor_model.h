@@ -29,6 +29,7 @@
 #include <gazebo/common/common.hh>
 #include <gazebo/common/Plugin.hh>
 #include <rotors_model/motor_model.hpp>
+#include <rotor_table.h>
 #include "CommandMotorSpeed.pb.h"
 #include "gazebo/math/Vector3.hh"
 #include "gazebo/transport/transport.hh"
@@ -69,6 +70,8 @@ static constexpr double kDefaulMaxRotVelocity = 838.0;
 static constexpr double kDefaultRotorDragCoefficient = 1.0e-4;
 static constexpr double kDefaultRollingMomentCoefficient = 1.0e-6;
 static constexpr double kDefaultRotorVelocitySlowdownSim = 10.0;
+static constexpr double kDefaultRotorDiameter = 0.254;
+static constexpr double kDefaultAirDensity = 1.225;
 
 class GazeboMotorModel : public MotorModel, public ModelPlugin {
  public:
@@ -90,6 +93,8 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
         rolling_moment_coefficient_(kDefaultRollingMomentCoefficient),
         rotor_drag_coefficient_(kDefaultRotorDragCoefficient),
         rotor_velocity_slowdown_sim_(kDefaultRotorVelocitySlowdownSim),
+        rotor_diameter_(kDefaultRotorDiameter),
+        air_density_(kDefaultAirDensity),
         time_constant_down_(kDefaultTimeConstantDown),
         time_constant_up_(kDefaultTimeConstantUp) {
   }
@@ -134,6 +139,12 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
   double time_constant_down_;
   double time_constant_up_;
 
+  // optional tabulated thrust and torque, replaces motor_constant_ and
+  // moment_constant_ when rotorTable names a file
+  RotorTable rotor_table_;
+  double rotor_diameter_;
+  double air_density_;
+
   transport::NodePtr node_handle_;
   transport::PublisherPtr motor_velocity_pub_;
   transport::SubscriberPtr command_sub_;
@@ -91,5 +91,6 @@ class GazeboMultirotorBasePlugin : public ModelPlugin {
 
   transport::NodePtr node_handle_;
   transport::PublisherPtr motor_pub_;
+  mav_msgs::msgs::MotorSpeed motor_speed_msg_;
 };
 }
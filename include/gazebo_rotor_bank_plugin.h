@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Rotor bank plugin
+ *
+ * Vehicle level replacement for one GazeboMotorModel per rotor. Same rotor
+ * model (thrust, rotor drag, drag torque, rolling moment, first order motor
+ * response and motor failure), all rotors updated in one pass from one
+ * world update connection. Each rotor is a <rotor> element with jointName,
+ * linkName, motorNumber and turningDirection; the coefficients can be set
+ * once on the plugin and overridden per rotor, with the GazeboMotorModel
+ * element names and defaults.
+ *
+ * The rotor model itself is in rotor_kernel.h. The parent link and the
+ * rotor axis expressed in the parent frame are resolved at Load. A rotor
+ * spins about its link z axis, so that direction is fixed in the parent
+ * frame and the per step pose differences of the per-motor plugin are not
+ * needed.
+ *
+ * With rotorTable set, thrust and drag torque of every rotor come from the
+ * tabulated coefficients (see rotor_table.h) instead of the motor and
+ * moment constants and the linear thrust fade with speed.
+ *
+ * With a <battery> element the rotors are driven through a battery, ESC and
+ * motor electrical model (see electric_drive.h): the motor response follows
+ * the speed the motor reaches at the present battery voltage, and the
+ * battery state is published on batteryPubTopic and the sensor bus for the
+ * MAVLink interface. Negative speed commands are clamped to 0 on this path,
+ * the ESCs do not reverse.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include "gazebo/transport/transport.hh"
+#include "gazebo/msgs/msgs.hh"
+#include "CommandMotorSpeed.pb.h"
+#include "MotorSpeed.pb.h"
+#include "Battery.pb.h"
+
+#include "common.h"
+#include "electric_drive.h"
+#include "gazebo_motor_model.h"
+#include "rotor_kernel.h"
+#include "rotor_table.h"
+#include "sensor_bus.h"
+
+namespace gazebo {
+
+static const std::string kDefaultRotorSpeedsPubTopic = "/motor_speeds";
+static const std::string kDefaultBatteryPubTopic = "/battery";
+static constexpr double kDefaultBatteryPubRate = 10.0;
+
+class GazeboRotorBankPlugin : public ModelPlugin {
+ public:
+  //! Rotors one plugin can drive
+  static constexpr int kMaxRotors = RotorSet::kMaxRotors;
+
+  GazeboRotorBankPlugin();
+  ~GazeboRotorBankPlugin();
+
+ protected:
+  void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
+  void OnUpdate(const common::UpdateInfo& _info);
+
+ private:
+  void UpdateFilterCoefficients(double dt);
+  void UpdateForcesAndMoments(double dt);
+  void UpdateMotorFail();
+  void PublishBattery(double now);
+  void VelocityCallback(CommandMotorSpeedPtr& rot_velocities);
+  void MotorFailureCallback(const boost::shared_ptr<const msgs::Int>& fail_msg);
+
+  std::string namespace_;
+  std::string command_sub_topic_;
+  std::string motor_failure_sub_topic_;
+  std::string motor_speed_pub_topic_;
+  std::string battery_pub_topic_;
+
+  physics::ModelPtr model_;
+  event::ConnectionPtr updateConnection_;
+
+  transport::NodePtr node_handle_;
+  transport::SubscriberPtr command_sub_;
+  transport::SubscriberPtr motor_failure_sub_;
+  transport::PublisherPtr motor_speed_pub_;
+  mav_msgs::msgs::MotorSpeed motor_speed_msg_;
+  transport::PublisherPtr battery_pub_;
+  battery_msgs::msgs::Battery battery_msg_;
+  BatterySlot* battery_bus_;
+
+  // motor speed publish rate [Hz], 0 publishes every step
+  double motor_speed_pub_rate_;
+  double last_pub_time_;
+  double prev_sim_time_;
+
+  int motor_Failure_Number_;  ///< motor number + 1 of the failed motor, 0 for none
+  int failed_motor_printed_;  ///< motor number + 1 reported as failed
+
+  // links the rotors are mounted on, usually just the base link, torques
+  // of all rotors on the same parent are applied as one
+  int parent_count_;
+  physics::LinkPtr parents_[kMaxRotors];
+
+  // rotor state and parameters, one entry per rotor
+  int rotor_count_;
+  physics::JointPtr joint_[kMaxRotors];
+  physics::LinkPtr link_[kMaxRotors];
+  int parent_index_[kMaxRotors];
+  math::Vector3 axis_parent_[kMaxRotors];  ///< joint axis in the parent CoG frame
+  math::Vector3 spin_parent_[kMaxRotors];  ///< rotor link z axis in the parent CoG frame
+  int motor_number_[kMaxRotors];
+  int turning_direction_[kMaxRotors];
+  double max_rot_velocity_[kMaxRotors];
+  double rotor_velocity_slowdown_sim_[kMaxRotors];
+  double time_constant_up_[kMaxRotors];
+  double time_constant_down_[kMaxRotors];
+  double ref_motor_rot_vel_[kMaxRotors];   ///< commanded, written by the transport thread
+  double filtered_rot_vel_[kMaxRotors];    ///< first order filter state
+
+  // coefficients, per step inputs and outputs of the rotor model
+  RotorSet rotors_;
+  RotorTable rotor_table_;
+
+  // filter coefficients for filter_dt_
+  double filter_dt_;
+  double alpha_up_[kMaxRotors];
+  double alpha_down_[kMaxRotors];
+
+  // electrical model, only with a <battery> element
+  bool electric_;
+  ElectricDrive drive_;
+  double battery_pub_rate_;
+  double last_battery_pub_time_;
+};
+}
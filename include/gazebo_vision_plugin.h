@@ -43,6 +43,8 @@
 
 #include <math.h>
 #include <common.h>
+#include <noise_generator.h>
+#include <sensor_bus.h>
 #include <sdf/sdf.hh>
 
 #include <gazebo/common/Plugin.hh>
@@ -81,6 +83,7 @@ private:
 
   transport::NodePtr _nh;
   transport::PublisherPtr _pub_odom;
+  VisionSlot* _vision_bus;
 
   common::Time _last_pub_time;
   common::Time _last_time;
@@ -95,8 +98,7 @@ private:
 
   math::Vector3 _bias;
 
-  std::default_random_engine _rand;
-  std::normal_distribution<float> _randn;
+  NoiseGenerator _noise;
 
 };     // class GAZEBO_VISIBLE VisionPlugin
 }      // namespace gazebo
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief WGS84 local tangent frame
+ *
+ * Converts between a local ENU (Gazebo world) or NED frame anchored at the
+ * home position and geodetic coordinates on the WGS84 ellipsoid, through
+ * ECEF. Everything that only depends on home is computed once. Geodetic
+ * latitude comes from Bowring's formula with one iteration, without
+ * iterating per point. Against a converged solution the latitude is off
+ * by under 0.02 mm up to 40 km of altitude and 6 mm at 1000 km, the
+ * altitude by nanometres (benchmarks/geodesy_check.cpp).
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+namespace gazebo {
+
+class LocalTangentFrame {
+public:
+  static constexpr double kSemiMajorAxis = 6378137.0;             // a [m]
+  static constexpr double kFlattening = 1.0 / 298.257223563;      // f
+  static constexpr double kSemiMinorAxis = kSemiMajorAxis * (1.0 - kFlattening);
+  static constexpr double kE2 = kFlattening * (2.0 - kFlattening);            // first eccentricity^2
+  static constexpr double kEp2 = kE2 / ((1.0 - kFlattening) * (1.0 - kFlattening));  // second eccentricity^2
+
+  LocalTangentFrame() { SetHome(0.0, 0.0, 0.0); }
+
+  LocalTangentFrame(double lat_rad, double lon_rad, double alt) { SetHome(lat_rad, lon_rad, alt); }
+
+  /// \brief Anchor the frame at a geodetic position, altitude above the ellipsoid.
+  void SetHome(double lat_rad, double lon_rad, double alt)
+  {
+    lat_home_ = lat_rad;
+    lon_home_ = lon_rad;
+    alt_home_ = alt;
+    sin_lat_ = std::sin(lat_rad);
+    cos_lat_ = std::cos(lat_rad);
+    sin_lon_ = std::sin(lon_rad);
+    cos_lon_ = std::cos(lon_rad);
+    GeodeticToEcef(sin_lat_, cos_lat_, sin_lon_, cos_lon_, alt, home_ecef_);
+  }
+
+  double LatHome() const { return lat_home_; }
+  double LonHome() const { return lon_home_; }
+  double AltHome() const { return alt_home_; }
+
+  /// \brief Local east, north, up [m] to latitude, longitude [rad] and altitude [m].
+  void EnuToGeodetic(double east, double north, double up, double *lat_rad, double *lon_rad, double *alt) const
+  {
+    const double ecef[3] = {
+      home_ecef_[0] - sin_lon_ * east - sin_lat_ * cos_lon_ * north + cos_lat_ * cos_lon_ * up,
+      home_ecef_[1] + cos_lon_ * east - sin_lat_ * sin_lon_ * north + cos_lat_ * sin_lon_ * up,
+      home_ecef_[2] + cos_lat_ * north + sin_lat_ * up
+    };
+    EcefToGeodetic(ecef, lat_rad, lon_rad, alt);
+  }
+
+  void NedToGeodetic(double north, double east, double down, double *lat_rad, double *lon_rad, double *alt) const
+  {
+    EnuToGeodetic(east, north, -down, lat_rad, lon_rad, alt);
+  }
+
+  /// \brief Batch form, count points of interleaved east, north, up to
+  /// interleaved latitude, longitude, altitude.
+  void EnuToGeodetic(const double *enu, double *lla, int count) const
+  {
+    for (int i = 0; i < count; ++i) {
+      EnuToGeodetic(enu[3 * i], enu[3 * i + 1], enu[3 * i + 2], &lla[3 * i], &lla[3 * i + 1], &lla[3 * i + 2]);
+    }
+  }
+
+  /// \brief Latitude, longitude [rad] and altitude [m] to local east, north, up [m].
+  void GeodeticToEnu(double lat_rad, double lon_rad, double alt, double *east, double *north, double *up) const
+  {
+    double ecef[3];
+    GeodeticToEcef(std::sin(lat_rad), std::cos(lat_rad), std::sin(lon_rad), std::cos(lon_rad), alt, ecef);
+    const double dx = ecef[0] - home_ecef_[0];
+    const double dy = ecef[1] - home_ecef_[1];
+    const double dz = ecef[2] - home_ecef_[2];
+    *east = -sin_lon_ * dx + cos_lon_ * dy;
+    *north = -sin_lat_ * cos_lon_ * dx - sin_lat_ * sin_lon_ * dy + cos_lat_ * dz;
+    *up = cos_lat_ * cos_lon_ * dx + cos_lat_ * sin_lon_ * dy + sin_lat_ * dz;
+  }
+
+  static void GeodeticToEcef(double sin_lat, double cos_lat, double sin_lon, double cos_lon, double alt,
+                             double ecef[3])
+  {
+    const double n = kSemiMajorAxis / std::sqrt(1.0 - kE2 * sin_lat * sin_lat);
+    ecef[0] = (n + alt) * cos_lat * cos_lon;
+    ecef[1] = (n + alt) * cos_lat * sin_lon;
+    ecef[2] = (n * (1.0 - kE2) + alt) * sin_lat;
+  }
+
+  static void EcefToGeodetic(const double ecef[3], double *lat_rad, double *lon_rad, double *alt)
+  {
+    const double p = std::sqrt(ecef[0] * ecef[0] + ecef[1] * ecef[1]);
+    const double z = ecef[2];
+
+    // parametric latitude, as sine and cosine
+    const double ta = z * kSemiMajorAxis;
+    const double tb = p * kSemiMinorAxis;
+    const double tr = std::sqrt(ta * ta + tb * tb);
+    const double sin_u = ta / tr;
+    const double cos_u = tb / tr;
+
+    const double num = z + kEp2 * kSemiMinorAxis * sin_u * sin_u * sin_u;
+    const double den = p - kE2 * kSemiMajorAxis * cos_u * cos_u * cos_u;
+    const double r = std::sqrt(num * num + den * den);
+    const double sin_lat = num / r;
+    const double cos_lat = den / r;
+
+    *lat_rad = std::atan2(num, den);
+    *lon_rad = std::atan2(ecef[1], ecef[0]);
+    // valid at the poles too, unlike p / cos(lat) - N
+    *alt = p * cos_lat + z * sin_lat - kSemiMajorAxis * std::sqrt(1.0 - kE2 * sin_lat * sin_lat);
+  }
+
+private:
+  double lat_home_;
+  double lon_home_;
+  double alt_home_;
+  double sin_lat_;
+  double cos_lat_;
+  double sin_lon_;
+  double cos_lon_;
+  double home_ecef_[3];
+};
+
+// Zurich Irchel Park, home of the SITL worlds unless the environment
+// variables PX4_HOME_LAT, PX4_HOME_LON and PX4_HOME_ALT say otherwise.
+// Seattle downtown (15 deg declination): 47.592182, -122.316031, 86m
+// Moscow downtown: 55.753395, 37.625427, 155m
+static constexpr double kDefaultHomeLatitude = 47.397742;   // deg
+static constexpr double kDefaultHomeLongitude = 8.545594;   // deg
+static constexpr double kDefaultHomeAltitude = 488.0;       // m
+
+/// \brief Home frame from the environment, the defaults for what is unset.
+inline LocalTangentFrame HomeFrameFromEnvironment()
+{
+  const char *env_lat = std::getenv("PX4_HOME_LAT");
+  const char *env_lon = std::getenv("PX4_HOME_LON");
+  const char *env_alt = std::getenv("PX4_HOME_ALT");
+
+  const double lat = env_lat ? std::stod(env_lat) : kDefaultHomeLatitude;
+  const double lon = env_lon ? std::stod(env_lon) : kDefaultHomeLongitude;
+  const double alt = env_alt ? std::stod(env_alt) : kDefaultHomeAltitude;
+  return LocalTangentFrame(lat * M_PI / 180.0, lon * M_PI / 180.0, alt);
+}
+
+}  // namespace gazebo
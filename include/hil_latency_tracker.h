@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief HIL loop round-trip latency tracker
+ *
+ * Remembers the timestamps of the last HIL_SENSOR messages that went out
+ * and pairs each incoming HIL_ACTUATOR_CONTROLS with the newest sensor
+ * message it can be an answer to. The autopilot stamps its controls with
+ * the time of the sensor data it ran on, so controls.time_usec >=
+ * sensor.time_usec identifies the cause. Latencies go into log-linear
+ * histograms, in wall clock and in sim time.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+namespace gazebo {
+
+/// \brief Histogram of microsecond values, 16 buckets per power of two (~6% resolution).
+class LatencyHistogram {
+public:
+  static constexpr int kSubBits = 4;
+  static constexpr int kSub = 1 << kSubBits;
+  static constexpr int kBuckets = kSub + (32 - kSubBits) * kSub;
+
+  LatencyHistogram() { Reset(); }
+
+  void Reset()
+  {
+    memset(counts_, 0, sizeof(counts_));
+    total_ = 0;
+    max_ = 0;
+  }
+
+  void Add(uint64_t us)
+  {
+    const uint32_t v = us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us);
+    ++counts_[Index(v)];
+    ++total_;
+    if (v > max_) {
+      max_ = v;
+    }
+  }
+
+  uint64_t Count() const { return total_; }
+  uint32_t Max() const { return max_; }
+
+  /// \brief Value below which the fraction p of the samples fall, 0 if empty.
+  double Percentile(double p) const
+  {
+    if (total_ == 0) {
+      return 0.0;
+    }
+    const uint64_t rank = static_cast<uint64_t>(p * (total_ - 1));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen > rank) {
+        // middle of the bucket, but never beyond what was actually seen
+        const double mid = Lower(i) + (Width(i) - 1) * 0.5;
+        return mid < max_ ? mid : max_;
+      }
+    }
+    return max_;
+  }
+
+private:
+  static int Index(uint32_t v)
+  {
+    if (v < kSub) {
+      return v;
+    }
+    const int k = 31 - __builtin_clz(v);
+    return kSub + (k - kSubBits) * kSub + ((v >> (k - kSubBits)) & (kSub - 1));
+  }
+
+  static double Lower(int i)
+  {
+    if (i < kSub) {
+      return i;
+    }
+    const int k = (i - kSub) / kSub + kSubBits;
+    const int sub = (i - kSub) % kSub;
+    return static_cast<double>((uint64_t(kSub) + sub) << (k - kSubBits));
+  }
+
+  static double Width(int i)
+  {
+    return i < kSub ? 1.0 : static_cast<double>(uint64_t(1) << ((i - kSub) / kSub));
+  }
+
+  uint64_t counts_[kBuckets];
+  uint64_t total_;
+  uint32_t max_;
+};
+
+class HilLatencyTracker {
+public:
+  //! Sensor messages remembered while waiting for their answer
+  static constexpr int kInFlight = 64;
+
+  struct Summary {
+    uint32_t samples;
+    uint32_t unmatched;
+    uint32_t unanswered;
+    double wall_p50_us;
+    double wall_p99_us;
+    double wall_max_us;
+    double sim_p50_us;
+    double sim_p99_us;
+    double sim_max_us;
+  };
+
+  HilLatencyTracker() : head_(0), count_(0), unmatched_(0), unanswered_(0) {}
+
+  /// \brief A HIL_SENSOR stamped time_usec has just been handed to the transport.
+  void OnSensorSent(uint64_t time_usec)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (count_ > 0 && time_usec <= At(count_ - 1).time_usec) {
+      // sim time went backwards, the world was reset
+      unanswered_ += count_;
+      count_ = 0;
+    }
+
+    if (count_ == kInFlight) {
+      ++unanswered_;
+      head_ = (head_ + 1) % kInFlight;
+      --count_;
+    }
+
+    Entry &e = At(count_++);
+    e.time_usec = time_usec;
+    e.wall = std::chrono::steady_clock::now();
+  }
+
+  /// \brief HIL_ACTUATOR_CONTROLS stamped time_usec is being applied at sim time sim_now_usec.
+  void OnActuatorControls(uint64_t time_usec, uint64_t sim_now_usec)
+  {
+    const auto wall_now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // newest sensor message this can be the answer to
+    int match = -1;
+    for (int i = count_ - 1; i >= 0; --i) {
+      if (At(i).time_usec <= time_usec) {
+        match = i;
+        break;
+      }
+    }
+
+    if (match < 0) {
+      // either a repeated answer or the autopilot does not echo sensor time
+      ++unmatched_;
+      return;
+    }
+
+    const Entry &e = At(match);
+    wall_.Add(std::chrono::duration_cast<std::chrono::microseconds>(wall_now - e.wall).count());
+    sim_.Add(sim_now_usec > e.time_usec ? sim_now_usec - e.time_usec : 0);
+
+    // older ones were superseded by the matched message
+    unanswered_ += match;
+    head_ = (head_ + match + 1) % kInFlight;
+    count_ -= match + 1;
+  }
+
+  /// \brief Statistics since the previous call, starts a new window.
+  Summary Report()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Summary s;
+    s.samples = static_cast<uint32_t>(wall_.Count());
+    s.unmatched = unmatched_;
+    s.unanswered = unanswered_;
+    s.wall_p50_us = wall_.Percentile(0.50);
+    s.wall_p99_us = wall_.Percentile(0.99);
+    s.wall_max_us = wall_.Max();
+    s.sim_p50_us = sim_.Percentile(0.50);
+    s.sim_p99_us = sim_.Percentile(0.99);
+    s.sim_max_us = sim_.Max();
+
+    wall_.Reset();
+    sim_.Reset();
+    unmatched_ = 0;
+    unanswered_ = 0;
+    return s;
+  }
+
+private:
+  struct Entry {
+    uint64_t time_usec;
+    std::chrono::steady_clock::time_point wall;
+  };
+
+  Entry &At(int i) { return in_flight_[(head_ + i) % kInFlight]; }
+
+  std::mutex mutex_;
+  Entry in_flight_[kInFlight];
+  int head_;
+  int count_;
+  uint32_t unmatched_;
+  uint32_t unanswered_;
+  LatencyHistogram wall_;
+  LatencyHistogram sim_;
+};
+
+}  // namespace gazebo
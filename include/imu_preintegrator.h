@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief IMU delta-angle / delta-velocity integrator
+ *
+ * Accumulates body rate and specific force samples taken at physics rate
+ * into one delta angle and one delta velocity per output interval, the
+ * way an IMU FIFO does. Coning and sculling corrections follow the
+ * recursive forms of Savage, "Strapdown Inertial Navigation Integration
+ * Algorithm Design", J. Guidance 21(1), 1998, with the same 1/6 previous
+ * increment weighting PX4 uses in its gyro integrator.
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace gazebo {
+
+class ImuPreintegrator {
+public:
+  ImuPreintegrator() { Reset(); }
+
+  void Reset()
+  {
+    alpha_.setZero();
+    beta_.setZero();
+    last_dalpha_.setZero();
+    nu_.setZero();
+    sculling_.setZero();
+    last_dnu_.setZero();
+    dt_ = 0.0;
+  }
+
+  /// \brief Add one sample held constant over dt.
+  void Add(const Eigen::Vector3d &angular_velocity, const Eigen::Vector3d &linear_acceleration, double dt)
+  {
+    const Eigen::Vector3d dalpha = angular_velocity * dt;
+    const Eigen::Vector3d dnu = linear_acceleration * dt;
+
+    // coning, computed from the angle integrated before this sample
+    beta_ += 0.5 * (alpha_ + last_dalpha_ / 6.0).cross(dalpha);
+    // sculling, the velocity counterpart of the same term
+    sculling_ += 0.5 * ((alpha_ + last_dalpha_ / 6.0).cross(dnu) + (nu_ + last_dnu_ / 6.0).cross(dalpha));
+
+    alpha_ += dalpha;
+    nu_ += dnu;
+    last_dalpha_ = dalpha;
+    last_dnu_ = dnu;
+    dt_ += dt;
+  }
+
+  /// \brief Time covered since the last Reset().
+  double IntegratedTime() const { return dt_; }
+
+  /// \brief Coning corrected rotation over the interval.
+  Eigen::Vector3d DeltaAngle() const { return alpha_ + beta_; }
+
+  /// \brief Sculling corrected velocity change over the interval, in the body
+  /// frame at the start of the interval.
+  Eigen::Vector3d DeltaVelocity() const { return nu_ + 0.5 * alpha_.cross(nu_) + sculling_; }
+
+private:
+  Eigen::Vector3d alpha_;
+  Eigen::Vector3d beta_;
+  Eigen::Vector3d last_dalpha_;
+  Eigen::Vector3d nu_;
+  Eigen::Vector3d sculling_;
+  Eigen::Vector3d last_dnu_;
+  double dt_;
+};
+
+}  // namespace gazebo
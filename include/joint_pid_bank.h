@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Structure-of-arrays bank of joint PID controllers
+ *
+ * Same control law as gazebo::common::PID, gains and state of all
+ * controllers kept in parallel arrays so one call updates every channel.
+ */
+
+#pragma once
+
+#include <cmath>
+
+namespace gazebo {
+
+template <int Capacity>
+class JointPidBank {
+public:
+  JointPidBank() : size_(0) {}
+
+  int Size() const { return size_; }
+
+  void Clear() { size_ = 0; }
+
+  /// \brief Append a controller, returns its slot or -1 when the bank is full.
+  int Add(double p, double i, double d, double i_max, double i_min, double cmd_max, double cmd_min)
+  {
+    if (size_ == Capacity) {
+      return -1;
+    }
+    const int k = size_++;
+    p_gain_[k] = p;
+    i_gain_[k] = i;
+    d_gain_[k] = d;
+    i_max_[k] = i_max;
+    i_min_[k] = i_min;
+    // common::PID treats a zero limit as no limit
+    cmd_max_[k] = std::fabs(cmd_max) > 1e-6 ? cmd_max : INFINITY;
+    cmd_min_[k] = std::fabs(cmd_min) > 1e-6 ? cmd_min : -INFINITY;
+    p_err_last_[k] = 0.0;
+    i_err_[k] = 0.0;
+    return k;
+  }
+
+  /// \brief cmd[k] = -(P + I + D) of err[k] for every controller in the bank.
+  ///
+  /// Like common::PID only a zero dt yields a zero command, a negative dt
+  /// (time going backwards after a reset) is integrated as given.
+  void Update(const double *err, double *cmd, double dt)
+  {
+    if (dt == 0.0) {
+      for (int k = 0; k < size_; ++k) {
+        cmd[k] = 0.0;
+      }
+      return;
+    }
+
+    const double inv_dt = 1.0 / dt;
+    for (int k = 0; k < size_; ++k) {
+      const double e = err[k];
+      if (!std::isfinite(e)) {
+        cmd[k] = 0.0;
+        continue;
+      }
+
+      double i_err = i_err_[k] + dt * e;
+      double i_term = i_gain_[k] * i_err;
+      if (i_term > i_max_[k]) {
+        i_term = i_max_[k];
+        i_err = i_term / i_gain_[k];
+      } else if (i_term < i_min_[k]) {
+        i_term = i_min_[k];
+        i_err = i_term / i_gain_[k];
+      }
+      i_err_[k] = i_err;
+
+      const double d_term = d_gain_[k] * (e - p_err_last_[k]) * inv_dt;
+      p_err_last_[k] = e;
+
+      double c = -p_gain_[k] * e - i_term - d_term;
+      c = c > cmd_max_[k] ? cmd_max_[k] : c;
+      c = c < cmd_min_[k] ? cmd_min_[k] : c;
+      cmd[k] = c;
+    }
+  }
+
+private:
+  int size_;
+  double p_gain_[Capacity];
+  double i_gain_[Capacity];
+  double d_gain_[Capacity];
+  double i_max_[Capacity];
+  double i_min_[Capacity];
+  double cmd_max_[Capacity];
+  double cmd_min_[Capacity];
+  double p_err_last_[Capacity];
+  double i_err_[Capacity];
+};
+
+}  // namespace gazebo
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Tabulated aerodynamic surface coefficients
+ *
+ * Lift, drag and pitching moment coefficients of a lifting surface over the
+ * full envelope: angle of attack from -180 to 180 deg, sideslip (the sweep
+ * angle of LiftDragPlugin) and control surface deflection. Coefficients are
+ * referenced to the full dynamic pressure 0.5 rho V^2 and the surface area.
+ * Lift is along span x inflow, drag against the inflow and a positive
+ * moment pitches the leading edge up, about the span direction. Tables are
+ * generated offline, see scripts/aero_table_gen.py.
+ *
+ * File layout, little endian:
+ *   char[4]  "ATBL"
+ *   uint32   version (1)
+ *   uint32   number of angles of attack, sideslip angles, deflections
+ *   float64  angle of attack min, max, sideslip min, max, deflection min, max [rad]
+ *   float32  (CL, CD, CM) triples, angle of attack major, deflection minor
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace gazebo {
+
+class AeroTable {
+public:
+  AeroTable() : n_alpha_(0), n_beta_(0), n_delta_(0) {}
+
+  bool Empty() const { return data_.empty(); }
+
+  /// \brief Read a table file, on failure the table stays empty and error says why.
+  bool Load(const std::string &path, std::string *error)
+  {
+    data_.clear();
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+      *error = "cannot open " + path;
+      return false;
+    }
+
+    char magic[4];
+    uint32_t version, n[3];
+    double range[6];
+    bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "ATBL", 4) == 0
+        && fread(&version, sizeof(version), 1, file) == 1 && version == 1
+        && fread(n, sizeof(uint32_t), 3, file) == 3
+        && fread(range, sizeof(double), 6, file) == 6
+        && n[0] >= 2 && n[1] >= 2 && n[2] >= 2 && uint64_t(n[0]) * n[1] * n[2] <= (1u << 24)
+        && range[1] > range[0] && range[3] > range[2] && range[5] > range[4];
+    if (ok) {
+      data_.resize(3 * n[0] * n[1] * n[2]);
+      ok = fread(data_.data(), sizeof(float), data_.size(), file) == data_.size();
+    }
+    fclose(file);
+
+    if (!ok) {
+      data_.clear();
+      *error = path + " is not a version 1 aerodynamic coefficient table";
+      return false;
+    }
+
+    n_alpha_ = n[0];
+    n_beta_ = n[1];
+    n_delta_ = n[2];
+    for (int i = 0; i < 3; ++i) {
+      min_[i] = range[2 * i];
+      scale_[i] = (n[i] - 1) / (range[2 * i + 1] - range[2 * i]);
+    }
+    return true;
+  }
+
+  /// \brief Trilinear lookup, clamped to the table range.
+  void Lookup(double alpha, double beta, double delta, double *cl, double *cd, double *cm) const
+  {
+    double fa, fb, fd;
+    const int ia = Cell(alpha, min_[0], scale_[0], n_alpha_, &fa);
+    const int ib = Cell(beta, min_[1], scale_[1], n_beta_, &fb);
+    const int id = Cell(delta, min_[2], scale_[2], n_delta_, &fd);
+
+    // corner (a, b, d) is at base + a * stride_a + b * stride_b + d * 3
+    const int stride_b = 3 * n_delta_;
+    const int stride_a = stride_b * n_beta_;
+    const float *base = &data_[ia * stride_a + ib * stride_b + id * 3];
+    const double w[8] = {
+      (1 - fa) * (1 - fb) * (1 - fd), (1 - fa) * (1 - fb) * fd,
+      (1 - fa) * fb * (1 - fd),       (1 - fa) * fb * fd,
+      fa * (1 - fb) * (1 - fd),       fa * (1 - fb) * fd,
+      fa * fb * (1 - fd),             fa * fb * fd
+    };
+    const int offset[8] = {
+      0, 3, stride_b, stride_b + 3,
+      stride_a, stride_a + 3, stride_a + stride_b, stride_a + stride_b + 3
+    };
+
+    double c[3] = {0.0, 0.0, 0.0};
+    for (int corner = 0; corner < 8; ++corner) {
+      const float *v = base + offset[corner];
+      c[0] += w[corner] * v[0];
+      c[1] += w[corner] * v[1];
+      c[2] += w[corner] * v[2];
+    }
+    *cl = c[0];
+    *cd = c[1];
+    *cm = c[2];
+  }
+
+private:
+  static int Cell(double x, double min, double scale, int n, double *frac)
+  {
+    double u = (x - min) * scale;
+    // NaN fails every comparison, it must not reach the cast
+    if (!(u >= 0.0)) {
+      u = 0.0;
+    }
+    u = u > n - 1 ? n - 1 : u;
+    int i = static_cast<int>(u);
+    i = i < n - 2 ? i : n - 2;
+    *frac = u - i;
+    return i;
+  }
+
+  int n_alpha_;
+  int n_beta_;
+  int n_delta_;
+  double min_[3];
+  double scale_[3];
+  std::vector<float> data_;
+};
+
+}  // namespace gazebo
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Lift drag bank plugin
+ *
+ * Vehicle level replacement for one LiftDragPlugin per aerodynamic surface.
+ * Each surface is a <surface> element taking the LiftDragPlugin elements
+ * (link_name, a0, cla, cda, alpha_stall, cla_stall, cda_stall, cp, forward,
+ * upward, area, air_density, radial_symmetry, control_joint_name,
+ * control_joint_rad_to_cl, coefficient_table) with the same defaults, so a
+ * model is converted by moving the contents of its LiftDragPlugin elements
+ * into <surface> elements of one plugin.
+ *
+ * Per step the state of every link carrying surfaces is read once, the
+ * velocities of all centres of pressure follow from it, all surfaces are
+ * evaluated in one kernel (see liftdrag_kernel.h) and the forces are
+ * applied as one force and one torque per link.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "gazebo/common/Plugin.hh"
+#include "gazebo/physics/physics.hh"
+
+#include "liftdrag_plugin/liftdrag_kernel.h"
+
+namespace gazebo {
+
+class GAZEBO_VISIBLE LiftDragBankPlugin : public ModelPlugin {
+ public:
+  static constexpr int kMaxSurfaces = LiftDragSurfaces::kMaxSurfaces;
+
+  LiftDragBankPlugin();
+  ~LiftDragBankPlugin();
+
+ protected:
+  void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
+  void OnUpdate();
+
+ private:
+  physics::ModelPtr model_;
+  event::ConnectionPtr updateConnection_;
+
+  // links carrying surfaces, usually just the base link
+  int link_count_;
+  physics::LinkPtr links_[kMaxSurfaces];
+
+  // surface geometry in the link frame, one entry per surface
+  int link_index_[kMaxSurfaces];
+  math::Vector3 cp_cog_[kMaxSurfaces];   ///< centre of pressure relative to the link CoG
+  math::Vector3 forward_[kMaxSurfaces];
+  math::Vector3 upward_[kMaxSurfaces];
+  physics::JointPtr control_joint_[kMaxSurfaces];
+
+  // coefficient tables by file, each loaded once however many surfaces use it
+  std::map<std::string, AeroTable> tables_;
+
+  LiftDragSurfaces surfaces_;
+};
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Lift and drag of many aerodynamic surfaces in one pass
+ *
+ * The LiftDragPlugin model (same angle of attack, sweep and stall handling,
+ * cm still left out) over structure of arrays buffers, so the loop has no
+ * calls and no data dependent branches and the compiler can vectorize it.
+ * acos is a polynomial with an error below 1e-7 rad, and the angle of
+ * attack is wrapped to +/-90 deg with one select instead of a loop. Sweep
+ * only enters through its sine, so no asin is needed. Users are built with
+ * -fno-math-errno -fno-trapping-math, sqrt and the selects keep the loop
+ * scalar otherwise.
+ *
+ * Surfaces with a coefficient table (see aero_table.h) get the same
+ * geometry from the vectorized loop and their coefficients from the table
+ * in a second, scalar pass, over the unwrapped angle of attack, the
+ * sideslip and the control deflection.
+ *
+ * Inputs and outputs are in the world frame.
+ */
+
+#pragma once
+
+#include <cmath>
+
+#include "liftdrag_plugin/aero_table.h"
+
+namespace gazebo {
+
+struct LiftDragSurfaces {
+  static constexpr int kMaxSurfaces = 32;
+
+  int count;
+
+  // parameters, see LiftDragPlugin
+  double alpha0[kMaxSurfaces];
+  double cla[kMaxSurfaces];
+  double cda[kMaxSurfaces];
+  double alpha_stall[kMaxSurfaces];
+  double cla_stall[kMaxSurfaces];
+  double cda_stall[kMaxSurfaces];
+  double control_to_cl[kMaxSurfaces];
+  double half_rho_area[kMaxSurfaces];  ///< 0.5 * air density * area
+  double radial[kMaxSurfaces];         ///< 1 for radially symmetric bodies, else 0
+  const AeroTable *table[kMaxSurfaces];  ///< coefficient table, null for the analytic model
+
+  // per step inputs
+  double vel[3][kMaxSurfaces];         ///< velocity of the centre of pressure
+  double forward[3][kMaxSurfaces];     ///< unit forward direction
+  double upward[3][kMaxSurfaces];      ///< unit upward direction, unused if radial
+  double control[kMaxSurfaces];        ///< control surface deflection [rad]
+
+  // outputs
+  double force[3][kMaxSurfaces];       ///< lift plus drag at the centre of pressure
+  double moment[3][kMaxSurfaces];      ///< pitching moment, table surfaces only
+
+  // geometry handed from the vectorized loop to the table pass
+  double inflow[3][kMaxSurfaces];      ///< unit inflow direction
+  double span[3][kMaxSurfaces];        ///< unit normal of the lift drag plane
+  double alpha_full[kMaxSurfaces];     ///< angle of attack in [-180, 180] deg
+  double sin_sideslip[kMaxSurfaces];
+  double q_area[kMaxSurfaces];         ///< full dynamic pressure times area
+};
+
+/// \brief acos(x) for x in [-1, 1], Abramowitz and Stegun 4.4.46.
+inline double LiftDragAcos(double x)
+{
+  const double a = std::fabs(x);
+  const double p = 1.5707963050 + a * (-0.2145988016 + a * (0.0889789874 + a * (-0.0501743046
+      + a * (0.0308918810 + a * (-0.0170881256 + a * (0.0066700901 + a * -0.0012624911))))));
+  const double r = std::sqrt(1.0 - a) * p;
+  return x < 0.0 ? M_PI - r : r;
+}
+
+/// \brief Inverse length for normalizing, leaves near zero vectors
+/// unchanged like math::Vector3::Normalize.
+inline double LiftDragInvLength(double x, double y, double z)
+{
+  const double length = std::sqrt(x * x + y * y + z * z);
+  // select the divisor, not the quotient, so the division is unconditional
+  return 1.0 / (length > 1e-6 ? length : 1.0);
+}
+
+inline void ComputeLiftDrag(LiftDragSurfaces *s)
+{
+  const int n = s->count;
+  for (int i = 0; i < n; ++i) {
+    const double vx = s->vel[0][i], vy = s->vel[1][i], vz = s->vel[2][i];
+    const double fx = s->forward[0][i], fy = s->forward[1][i], fz = s->forward[2][i];
+
+    const double speed = std::sqrt(vx * vx + vy * vy + vz * vz);
+    const double inv_speed = 1.0 / (speed > 1e-6 ? speed : 1.0);
+    const double ux = vx * inv_speed, uy = vy * inv_speed, uz = vz * inv_speed;
+
+    // radially symmetric: upward is the inflow component perpendicular to forward
+    const double tx = fy * uz - fz * uy, ty = fz * ux - fx * uz, tz = fx * uy - fy * ux;
+    double rx = fy * tz - fz * ty, ry = fz * tx - fx * tz, rz = fx * ty - fy * tx;
+    const double inv_r = LiftDragInvLength(rx, ry, rz);
+    rx *= inv_r;
+    ry *= inv_r;
+    rz *= inv_r;
+    const double radial = s->radial[i];
+    const double upx = radial * rx + (1.0 - radial) * s->upward[0][i];
+    const double upy = radial * ry + (1.0 - radial) * s->upward[1][i];
+    const double upz = radial * rz + (1.0 - radial) * s->upward[2][i];
+
+    // normal to the lift drag plane
+    double sx = fy * upz - fz * upy, sy = fz * upx - fx * upz, sz = fx * upy - fy * upx;
+    const double inv_s = LiftDragInvLength(sx, sy, sz);
+    sx *= inv_s;
+    sy *= inv_s;
+    sz *= inv_s;
+
+    double sin_sweep = sx * ux + sy * uy + sz * uz;
+    sin_sweep = sin_sweep < -1.0 ? -1.0 : sin_sweep > 1.0 ? 1.0 : sin_sweep;
+    // the square of the cosine, as LiftDragPlugin has it
+    const double cos_sweep = 1.0 - sin_sweep * sin_sweep;
+
+    // velocity in the lift drag plane, the spanwise part is removed along
+    // the inflow direction, as LiftDragPlugin has it
+    const double v_span = vx * sx + vy * sy + vz * sz;
+    const double px = vx - v_span * ux, py = vy - v_span * uy, pz = vz - v_span * uz;
+    const double inv_p = LiftDragInvLength(px, py, pz);
+    const double dx = -px * inv_p, dy = -py * inv_p, dz = -pz * inv_p;
+
+    double lx = sy * pz - sz * py, ly = sz * px - sx * pz, lz = sx * py - sy * px;
+    const double inv_l = LiftDragInvLength(lx, ly, lz);
+    lx *= inv_l;
+    ly *= inv_l;
+    lz *= inv_l;
+
+    // angle of attack, positive if lift leans forward, wrapped to +/-90 deg
+    double cos_alpha = lx * upx + ly * upy + lz * upz;
+    cos_alpha = cos_alpha < -1.0 ? -1.0 : cos_alpha > 1.0 ? 1.0 : cos_alpha;
+    const double sign = (lx * fx + ly * fy + lz * fz) >= 0.0 ? 1.0 : -1.0;
+    double alpha = s->alpha0[i] + sign * LiftDragAcos(cos_alpha);
+    alpha -= alpha > M_PI ? 2.0 * M_PI : alpha < -M_PI ? -2.0 * M_PI : 0.0;
+    s->alpha_full[i] = alpha;
+    // one wrap is enough as long as |alpha0| < 90 deg
+    alpha -= alpha > 0.5 * M_PI ? M_PI : alpha < -0.5 * M_PI ? -M_PI : 0.0;
+
+    // linear up to stall, then the stall slopes from the stall point on
+    const double stall = s->alpha_stall[i];
+    const double alpha_linear = alpha < -stall ? -stall : alpha > stall ? stall : alpha;
+    const double alpha_stalled = alpha - alpha_linear;
+
+    double cl = (s->cla[i] * alpha_linear + s->cla_stall[i] * alpha_stalled) * cos_sweep;
+    // past stall the lift keeps the sign it had at the stall point
+    cl = alpha_stalled > 0.0 ? (cl > 0.0 ? cl : 0.0) : alpha_stalled < 0.0 ? (cl < 0.0 ? cl : 0.0) : cl;
+    cl += s->control_to_cl[i] * s->control[i];
+
+    const double cd = std::fabs((s->cda[i] * alpha_linear + s->cda_stall[i] * alpha_stalled) * cos_sweep);
+
+    const double p2 = px * px + py * py + pz * pz;
+    // no force below 1 cm/s, loads stay out of selects or the loop is not if-converted
+    const double qa = s->half_rho_area[i] * (speed > 0.01 ? p2 : 0.0);
+    s->q_area[i] = s->half_rho_area[i] * (speed > 0.01 ? speed * speed : 0.0);
+    s->inflow[0][i] = ux;
+    s->inflow[1][i] = uy;
+    s->inflow[2][i] = uz;
+    s->span[0][i] = sx;
+    s->span[1][i] = sy;
+    s->span[2][i] = sz;
+    s->sin_sideslip[i] = sin_sweep;
+    const double force_x = qa * (cl * lx + cd * dx);
+    const double force_y = qa * (cl * ly + cd * dy);
+    const double force_z = qa * (cl * lz + cd * dz);
+    // nan or inf to zero, like math::Vector3::Correct
+    s->force[0][i] = force_x - force_x == 0.0 ? force_x : 0.0;
+    s->force[1][i] = force_y - force_y == 0.0 ? force_y : 0.0;
+    s->force[2][i] = force_z - force_z == 0.0 ? force_z : 0.0;
+    s->moment[0][i] = 0.0;
+    s->moment[1][i] = 0.0;
+    s->moment[2][i] = 0.0;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    if (!s->table[i]) {
+      continue;
+    }
+    const double ux = s->inflow[0][i], uy = s->inflow[1][i], uz = s->inflow[2][i];
+    const double sx = s->span[0][i], sy = s->span[1][i], sz = s->span[2][i];
+
+    // lift along span x inflow, also where the in plane velocity vanishes
+    double lx = sy * uz - sz * uy, ly = sz * ux - sx * uz, lz = sx * uy - sy * ux;
+    const double inv_l = LiftDragInvLength(lx, ly, lz);
+    lx *= inv_l;
+    ly *= inv_l;
+    lz *= inv_l;
+
+    double cl, cd, cm;
+    const double sideslip = 0.5 * M_PI - LiftDragAcos(s->sin_sideslip[i]);
+    s->table[i]->Lookup(s->alpha_full[i], sideslip, s->control[i], &cl, &cd, &cm);
+
+    const double qa = s->q_area[i];
+    const double force[3] = {
+      qa * (cl * lx - cd * ux),
+      qa * (cl * ly - cd * uy),
+      qa * (cl * lz - cd * uz)
+    };
+    const double moment[3] = {qa * cm * sx, qa * cm * sy, qa * cm * sz};
+    for (int j = 0; j < 3; ++j) {
+      s->force[j][i] = force[j] - force[j] == 0.0 ? force[j] : 0.0;
+      s->moment[j][i] = moment[j] - moment[j] == 0.0 ? moment[j] : 0.0;
+    }
+  }
+}
+
+}  // namespace gazebo
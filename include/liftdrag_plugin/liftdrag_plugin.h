@@ -24,6 +24,8 @@
 #include "gazebo/physics/physics.hh"
 #include "gazebo/transport/TransportTypes.hh"
 
+#include "liftdrag_plugin/aero_table.h"
+
 namespace gazebo
 {
   /// \brief A plugin that simulates lift and drag.
@@ -132,6 +134,11 @@ namespace gazebo
     /// value.
     protected: double controlJointRadToCL;
 
+    /// \brief Optional coefficients over angle of attack, sideslip and
+    /// control deflection, replacing the piecewise linear model and
+    /// controlJointRadToCL when loaded.
+    protected: AeroTable coefficientTable;
+
     /// \brief SDF for this plugin;
     protected: sdf::ElementPtr sdf;
   };
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Minimal MAVLink stream framer
+ *
+ * Splits a byte stream into MAVLink 1/2 frames by reading just the header:
+ * start byte, payload length, incompat flags (signature) and message id.
+ * Frames are only copied when they straddle two chunks. A candidate frame
+ * is checked before it is consumed: against its CRC when the message id is
+ * known to the lookup the framer was given, otherwise the byte after it has
+ * to be a start byte or the end of a datagram. A candidate that fails is
+ * not a frame, the framer skips its start byte and resyncs on the next one.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace gazebo {
+
+class MavlinkFramer {
+public:
+  static constexpr uint8_t kStxV1 = 0xFE;
+  static constexpr uint8_t kStxV2 = 0xFD;
+  static constexpr size_t kMaxFrameLen = 280;
+
+  /// \brief CRC extra byte and largest payload of a message id, false if
+  /// the id is unknown.
+  typedef bool (*MsgInfoLookup)(uint32_t msgid, uint8_t *crc_extra, uint8_t *max_len);
+
+  explicit MavlinkFramer(MsgInfoLookup msg_info = nullptr) :
+    msg_info_(msg_info), have_(0), skipped_bytes_(0), bad_frames_(0) {}
+
+  /// \brief Feed the next chunk of a byte stream (serial).
+  /// on_frame(const uint8_t *frame, size_t len, uint32_t msgid) is called for
+  /// every complete frame, pointing into data whenever possible. A frame with
+  /// an unknown id at the end of the chunk waits for the next byte.
+  template <typename Callback>
+  void Push(const uint8_t *data, size_t len, Callback on_frame)
+  {
+    Feed(data, len, kNextPending, on_frame);
+  }
+
+  /// \brief Feed one datagram (UDP, shared memory). Frames never span two
+  /// datagrams, so nothing is carried over from or into another one.
+  template <typename Callback>
+  void PushDatagram(const uint8_t *data, size_t len, Callback on_frame)
+  {
+    Reset();
+    Feed(data, len, kNextEnd, on_frame);
+    Reset();
+  }
+
+  /// \brief Drop a partial frame.
+  void Reset()
+  {
+    skipped_bytes_ += have_;
+    have_ = 0;
+  }
+
+  /// \brief Bytes discarded while looking for a start byte.
+  uint64_t SkippedBytes() const { return skipped_bytes_; }
+
+  /// \brief Candidate frames that failed the CRC or header checks.
+  uint64_t BadFrames() const { return bad_frames_; }
+
+  /// \brief Total frame length, 0 while the header is still incomplete.
+  static size_t FrameLength(const uint8_t *frame, size_t available)
+  {
+    if (frame[0] == kStxV1) {
+      // stx len seq sys comp msgid | payload | crc
+      return available < 2 ? 0 : 6 + frame[1] + 2;
+    }
+    // stx len incompat compat seq sys comp msgid[3] | payload | crc | signature
+    return available < 3 ? 0 : 10 + frame[1] + 2 + ((frame[2] & 0x01) ? 13 : 0);
+  }
+
+  static uint32_t MsgId(const uint8_t *frame)
+  {
+    if (frame[0] == kStxV1) {
+      return frame[5];
+    }
+    return frame[7] | (frame[8] << 8) | (static_cast<uint32_t>(frame[9]) << 16);
+  }
+
+private:
+  // what follows a candidate frame at the end of a chunk
+  static constexpr int kNextPending = -1;   ///< more bytes will come
+  static constexpr int kNextEnd = -2;       ///< end of the datagram
+
+  enum Check { kInvalid, kValid, kUndecided };
+
+  template <typename Callback>
+  void Feed(const uint8_t *data, size_t len, int end, Callback on_frame)
+  {
+    size_t i = 0;
+
+    while (have_ > 0) {
+      // complete the frame that was split over the previous chunk
+      size_t need;
+      while ((need = FrameLength(buf_, have_)) == 0 && i < len) {
+        buf_[have_++] = data[i++];
+      }
+      if (need == 0) {
+        return;
+      }
+
+      const size_t take = std::min(need - have_, len - i);
+      memcpy(buf_ + have_, data + i, take);
+      have_ += take;
+      i += take;
+      if (have_ < need) {
+        return;
+      }
+
+      const Check check = Validate(buf_, i < len ? data[i] : end);
+      if (check == kUndecided) {
+        return;
+      }
+      have_ = 0;
+      if (check == kValid) {
+        on_frame(static_cast<const uint8_t *>(buf_), need, MsgId(buf_));
+      } else {
+        // not a frame after all, everything after its start byte is looked
+        // at again; this may leave a new partial frame in buf_
+        uint8_t rescan[kMaxFrameLen];
+        memcpy(rescan, buf_ + 1, need - 1);
+        ++bad_frames_;
+        ++skipped_bytes_;
+        Feed(rescan, need - 1, kNextPending, on_frame);
+      }
+    }
+
+    while (i < len) {
+      if (data[i] != kStxV1 && data[i] != kStxV2) {
+        ++skipped_bytes_;
+        ++i;
+        continue;
+      }
+
+      const size_t need = FrameLength(data + i, len - i);
+      if (need != 0 && need <= len - i) {
+        const Check check = Validate(data + i, i + need < len ? data[i + need] : end);
+        if (check == kValid) {
+          on_frame(data + i, need, MsgId(data + i));
+          i += need;
+          continue;
+        }
+        if (check == kInvalid) {
+          ++bad_frames_;
+          ++skipped_bytes_;
+          ++i;
+          continue;
+        }
+      }
+
+      // partial or undecided frame at the end of this chunk, keep it for the next one
+      have_ = len - i;
+      memcpy(buf_, data + i, have_);
+      break;
+    }
+  }
+
+  /// \brief next is the byte following the frame or one of kNext*.
+  Check Validate(const uint8_t *frame, int next) const
+  {
+    const bool v1 = frame[0] == kStxV1;
+    // signing is the only incompatibility flag there is
+    if (!v1 && (frame[2] & ~0x01) != 0) {
+      return kInvalid;
+    }
+
+    uint8_t crc_extra, max_len;
+    if (!msg_info_ || !msg_info_(MsgId(frame), &crc_extra, &max_len)) {
+      if (next == kNextPending) {
+        return kUndecided;
+      }
+      return next == kNextEnd || next == kStxV1 || next == kStxV2 ? kValid : kInvalid;
+    }
+    if (frame[1] > max_len) {
+      return kInvalid;
+    }
+
+    // CRC-16/MCRF4XX over everything after the start byte, then CRC extra
+    const size_t crc_pos = (v1 ? 6 : 10) + frame[1];
+    uint16_t crc = 0xffff;
+    for (size_t k = 1; k <= crc_pos; ++k) {
+      uint8_t tmp = (k < crc_pos ? frame[k] : crc_extra) ^ static_cast<uint8_t>(crc & 0xff);
+      tmp ^= static_cast<uint8_t>(tmp << 4);
+      crc = (crc >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4);
+    }
+    return frame[crc_pos] == (crc & 0xff) && frame[crc_pos + 1] == (crc >> 8) ? kValid : kInvalid;
+  }
+
+  MsgInfoLookup msg_info_;
+  uint8_t buf_[kMaxFrameLen];
+  size_t have_;
+  uint64_t skipped_bytes_;
+  uint64_t bad_frames_;
+};
+
+}  // namespace gazebo
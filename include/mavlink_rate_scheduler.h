@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Output rate scheduler for the MAVLink interface
+ *
+ * Decides, per outgoing stream, whether a message is due at a given sim
+ * time, so the caller can skip the work behind it altogether. Rates are
+ * met on average: the next deadline advances by one interval from the
+ * previous one, not from the time the message actually went out.
+ *
+ * Due() is called from the transport callback threads and Report() from
+ * the physics thread, the per-stream state is guarded by a mutex. Rates
+ * are configured at load, before any callback runs.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace gazebo {
+
+class MavlinkRateScheduler {
+public:
+  enum Stream {
+    kHilSensor = 0,
+    kHilStateQuaternion,  ///< ground truth
+    kHilGps,
+    kDistanceSensorLidar,
+    kDistanceSensorSonar,
+    kVisionPositionEstimate,
+    kLandingTarget,
+    kBatteryStatus,
+    kNumStreams
+  };
+
+  //! Every incoming sample is forwarded
+  static constexpr double kUnlimited = -1.0;
+
+  MavlinkRateScheduler() : report_start_(0.0)
+  {
+    for (int i = 0; i < kNumStreams; ++i) {
+      rate_[i] = kUnlimited;
+      next_due_[i] = 0.0;
+      sent_[i] = 0;
+    }
+  }
+
+  /// \brief SDF element name of a stream.
+  static const char *Name(int stream)
+  {
+    static const char *names[kNumStreams] = {
+      "hil_sensor",
+      "hil_state_quaternion",
+      "hil_gps",
+      "distance_sensor_lidar",
+      "distance_sensor_sonar",
+      "vision_position_estimate",
+      "landing_target",
+      "battery_status",
+    };
+    return names[stream];
+  }
+
+  /// \brief Set the target rate in Hz, 0 turns the stream off.
+  void Configure(int stream, double rate_hz)
+  {
+    rate_[stream] = rate_hz < 0 ? kUnlimited : rate_hz;
+  }
+
+  /// \brief True if the stream should send at sim time now, counts it as sent.
+  bool Due(int stream, double now)
+  {
+    const double rate = rate_[stream];
+    if (rate == 0) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rate > 0) {
+      const double interval = 1.0 / rate;
+      double &next = next_due_[stream];
+      if (now + interval < next) {
+        // sim time went backwards, the world was reset
+        next = now;
+      }
+      // tolerate float noise on timestamps that fall exactly on the deadline
+      if (now < next - 1e-6) {
+        return false;
+      }
+      // keep the phase so the average rate is met, unless we fell behind
+      next = (now - next < interval) ? next + interval : now + interval;
+    }
+
+    ++sent_[stream];
+    return true;
+  }
+
+  /// \brief Achieved versus configured rate of every stream since the last report.
+  std::string Report(double now)
+  {
+    uint64_t sent[kNumStreams];
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int i = 0; i < kNumStreams; ++i) {
+        sent[i] = sent_[i];
+        sent_[i] = 0;
+      }
+    }
+
+    const double elapsed = now - report_start_;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+
+    for (int i = 0; i < kNumStreams; ++i) {
+      ss << "  " << Name(i) << ": ";
+      if (rate_[i] == 0) {
+        ss << "off\n";
+      } else {
+        ss << (elapsed > 0 ? sent[i] / elapsed : 0.0) << " Hz";
+        if (rate_[i] > 0) {
+          ss << " / " << rate_[i] << " Hz\n";
+        } else {
+          ss << " (unlimited)\n";
+        }
+      }
+    }
+
+    report_start_ = now;
+    return ss.str();
+  }
+
+private:
+  std::mutex mutex_;
+  double rate_[kNumStreams];
+  double next_due_[kNumStreams];
+  uint64_t sent_[kNumStreams];
+  double report_start_;
+};
+
+}  // namespace gazebo
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief MAVLink socket reactor
+ *
+ * One readiness set (epoll on Linux, poll elsewhere) shared by every MAVLink
+ * socket in the gzserver process. Plugins register their socket together
+ * with a callback that drains it; the reactor is serviced once per world
+ * iteration, so the syscall cost scales with busy sockets, not vehicles.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+namespace gazebo {
+
+class MavlinkReactor {
+public:
+  typedef std::function<void()> ReadyCallback;
+
+  /// \brief The process wide reactor shared by all plugins.
+  static MavlinkReactor& Instance();
+
+  /// \brief Add a socket, callback is invoked whenever it is readable.
+  bool Register(int fd, const ReadyCallback& callback);
+
+  /// \brief Remove a socket, must be called before the socket is closed.
+  /// Waits for a callback of the socket running on another thread, so
+  /// whatever the callback uses may be destroyed once this returns.
+  void Unregister(int fd);
+
+  /// \brief Leave a socket out of the readiness set until the next world
+  /// iteration, for a callback that stops draining at a per-step cap. The
+  /// socket stays readable, so it would otherwise wake every Poll() of the
+  /// iteration without anything being read.
+  void Defer(int fd);
+
+  /// \brief Poll without blocking, at most once per world iteration.
+  /// The first plugin to call this in an iteration services every socket,
+  /// later calls in the same iteration return immediately.
+  void ServiceOnce(uint64_t iteration);
+
+  /// \brief Wait up to timeout_ms for readable sockets and dispatch them.
+  /// \return number of sockets that were dispatched, -1 on error.
+  int Poll(int timeout_ms);
+
+  size_t NumSockets();
+
+private:
+  MavlinkReactor();
+  ~MavlinkReactor();
+  MavlinkReactor(const MavlinkReactor&) = delete;
+  MavlinkReactor& operator=(const MavlinkReactor&) = delete;
+
+  static constexpr int kMaxEvents = 64;
+
+  struct Handler {
+    int fd;
+    bool deferred;
+    ReadyCallback callback;
+    std::thread::id dispatcher;  ///< thread running the callback, if any
+  };
+
+  void Arm(Handler *handler, bool readable);
+
+  std::mutex mutex_;
+  std::condition_variable dispatched_;
+  // handlers keep their address while registered, it is the epoll cookie
+  std::unordered_map<int, std::unique_ptr<Handler>> handlers_;
+  uint64_t last_iteration_;
+  bool serviced_;
+
+  // unregistered while a Poll() may still hold them, freed once none does
+  int polling_;
+  std::vector<std::unique_ptr<Handler>> retired_;
+
+  std::vector<Handler*> deferred_;
+
+  // handlers of the ready sockets, reused to dispatch outside the lock
+  std::vector<Handler*> ready_;
+
+#if defined(__linux__)
+  int epoll_fd_;
+#else
+  std::vector<struct pollfd> fds_;
+#endif
+};
+
+}  // namespace gazebo
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Same-host shared memory MAVLink transport
+ *
+ * A POSIX shared memory segment holding two single-producer/single-consumer
+ * rings of serialized MAVLink frames, one per direction. The simulator
+ * creates the segment, the autopilot opens it by name. A reader that runs
+ * out of frames sleeps on a futex in the ring, so the writer only makes a
+ * syscall when the other side is actually waiting.
+ *
+ * Segment layout (all fields naturally aligned, little endian host):
+ *   MavlinkShmSegment { magic, version, to_autopilot ring, to_simulator ring }
+ * A peer implementation only needs this header.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+namespace gazebo {
+
+static constexpr uint32_t kMavlinkShmMagic = 0x4d41564c;  // "MAVL"
+static constexpr uint32_t kMavlinkShmVersion = 1;
+//! Frames per direction, must be a power of two
+static constexpr uint32_t kMavlinkShmSlots = 256;
+//! Largest MAVLink v2 frame including signature
+static constexpr uint32_t kMavlinkShmFrameSize = 280;
+
+struct MavlinkShmSlot {
+  uint32_t len;
+  uint8_t data[kMavlinkShmFrameSize];
+};
+
+struct MavlinkShmRing {
+  std::atomic<uint32_t> head;         ///< written by the producer
+  uint8_t pad_head[60];
+  std::atomic<uint32_t> tail;         ///< written by the consumer
+  std::atomic<uint32_t> futex;        ///< bumped by the producer on every publish
+  std::atomic<uint32_t> waiting;      ///< non-zero while the consumer sleeps on futex
+  uint8_t pad_tail[52];
+  MavlinkShmSlot slots[kMavlinkShmSlots];
+};
+
+struct MavlinkShmSegment {
+  uint32_t magic;
+  uint32_t version;
+  uint8_t pad[56];
+  MavlinkShmRing to_autopilot;
+  MavlinkShmRing to_simulator;
+};
+
+class MavlinkShmTransport {
+public:
+  MavlinkShmTransport();
+  ~MavlinkShmTransport();
+
+  /// \brief Create (or reset) the named segment, simulator side.
+  bool Create(const std::string& name);
+
+  /// \brief Attach to a segment created by the simulator, autopilot side.
+  bool Open(const std::string& name);
+
+  void Close();
+
+  bool IsOpen() const { return segment_ != nullptr; }
+
+  /// \brief Queue one serialized frame, false if the ring is full.
+  bool Send(const uint8_t* buf, size_t len);
+
+  /// \brief Returned by Receive() for a slot that did not hold a valid
+  /// frame; the slot is consumed, the frames behind it can still be read.
+  static constexpr ssize_t kCorruptSlot = -2;
+
+  /// \brief Copy the next frame into buf without blocking.
+  /// \return frame length, 0 if nothing is pending, kCorruptSlot for a
+  /// skipped slot, -1 if the transport is not open.
+  ssize_t Receive(uint8_t* buf, size_t size);
+
+  /// \brief Sleep until a frame is pending or timeout_ms has elapsed.
+  bool WaitReadable(int timeout_ms);
+
+  uint64_t DroppedFrames() const { return dropped_; }
+  uint64_t CorruptSlots() const { return corrupt_; }
+
+private:
+  MavlinkShmTransport(const MavlinkShmTransport&) = delete;
+  MavlinkShmTransport& operator=(const MavlinkShmTransport&) = delete;
+
+  bool Map(const std::string& name, bool create);
+
+  MavlinkShmSegment* segment_;
+  MavlinkShmRing* tx_;
+  MavlinkShmRing* rx_;
+  std::string name_;
+  bool owner_;
+  uint64_t dropped_;
+  uint64_t corrupt_;
+};
+
+}  // namespace gazebo
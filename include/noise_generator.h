@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Reproducible Gaussian noise for the sensor plugins
+ *
+ * Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+ * numbers: as easy as 1, 2, 3", SC11). The key is derived from the world
+ * seed, the vehicle and the sensor name, so every sensor of every vehicle
+ * draws an independent stream that only depends on those three and on how
+ * many values it consumed. Normals are produced a block at a time with a
+ * branch-free Box-Muller transform over flat arrays.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace gazebo {
+
+class NoiseGenerator {
+public:
+  //! Normals produced per refill, a multiple of the 4 words of a Philox block
+  static constexpr int kBlockSize = 32;
+
+  NoiseGenerator() : counter_(0), next_(kBlockSize)
+  {
+    Seed(0, "", "");
+  }
+
+  /// \brief Select the stream of one sensor on one vehicle and rewind it.
+  void Seed(uint64_t world_seed, const std::string &vehicle, const std::string &sensor)
+  {
+    // FNV-1a over the names, then mixed with the seed
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : vehicle) {
+      h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    h = (h ^ 0xff) * 0x100000001b3ULL;
+    for (char c : sensor) {
+      h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    h = SplitMix64(h ^ SplitMix64(world_seed));
+
+    key_[0] = static_cast<uint32_t>(h);
+    key_[1] = static_cast<uint32_t>(h >> 32);
+    counter_ = 0;
+    next_ = kBlockSize;
+  }
+
+  /// \brief One standard normal sample.
+  double Normal()
+  {
+    if (next_ == kBlockSize) {
+      Refill();
+    }
+    return block_[next_++];
+  }
+
+  /// \brief Fill out[0..count) with standard normals, same stream as Normal().
+  void Normals(double *out, int count)
+  {
+    while (count > 0) {
+      if (next_ == kBlockSize) {
+        Refill();
+      }
+      const int n = count < kBlockSize - next_ ? count : kBlockSize - next_;
+      memcpy(out, block_ + next_, n * sizeof(double));
+      next_ += n;
+      out += n;
+      count -= n;
+    }
+  }
+
+private:
+  static uint64_t SplitMix64(uint64_t x)
+  {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  static void Philox4x32(const uint32_t ctr_in[4], const uint32_t key_in[2], uint32_t out[4])
+  {
+    uint32_t c0 = ctr_in[0], c1 = ctr_in[1], c2 = ctr_in[2], c3 = ctr_in[3];
+    uint32_t k0 = key_in[0], k1 = key_in[1];
+
+    for (int round = 0; round < 10; ++round) {
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+      const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c1 = static_cast<uint32_t>(p1);
+      c3 = static_cast<uint32_t>(p0);
+      c0 = n0;
+      c2 = n2;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+
+  void Refill()
+  {
+    uint32_t bits[kBlockSize];
+    for (int i = 0; i < kBlockSize; i += 4) {
+      const uint32_t ctr[4] = {
+        static_cast<uint32_t>(counter_), static_cast<uint32_t>(counter_ >> 32), 0, 0
+      };
+      Philox4x32(ctr, key_, bits + i);
+      ++counter_;
+    }
+
+    // Box-Muller on pairs, uniforms in (0, 1) so the log never sees zero.
+    // Plain loops over arrays so the compiler can vectorize them.
+    constexpr int kHalf = kBlockSize / 2;
+    constexpr double kScale = 1.0 / 4294967296.0;
+    double radius[kHalf];
+    double angle[kHalf];
+    for (int i = 0; i < kHalf; ++i) {
+      const double u1 = (bits[2 * i] + 0.5) * kScale;
+      const double u2 = (bits[2 * i + 1] + 0.5) * kScale;
+      radius[i] = std::sqrt(-2.0 * std::log(u1));
+      angle[i] = 2.0 * M_PI * u2;
+    }
+    for (int i = 0; i < kHalf; ++i) {
+      block_[i] = radius[i] * std::cos(angle[i]);
+      block_[kHalf + i] = radius[i] * std::sin(angle[i]);
+    }
+
+    next_ = 0;
+  }
+
+  uint32_t key_[2];
+  uint64_t counter_;
+  int next_;
+  double block_[kBlockSize];
+};
+
+}  // namespace gazebo
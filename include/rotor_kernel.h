@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Forces and moments of many rotors in one pass
+ *
+ * The GazeboMotorModel rotor model (thrust with its linear fade over
+ * airspeed, rotor drag, drag torque about the rotor axis and rolling
+ * moment, after Martin and Salaun 2010) over structure of arrays buffers,
+ * free of Gazebo types so it can be checked and timed on its own. With a
+ * rotor table (see rotor_table.h) thrust and drag torque come from the
+ * table and the fade is left out, as in GazeboMotorModel.
+ *
+ * Inputs and outputs are in the world frame. The thrust is a magnitude
+ * along the rotor link z axis, the caller applies it as a relative force.
+ */
+
+#pragma once
+
+#include <cmath>
+
+#include "rotor_table.h"
+
+namespace gazebo {
+
+struct RotorSet {
+  static constexpr int kMaxRotors = 16;
+
+  int count;
+
+  // parameters, see GazeboMotorModel
+  double motor_constant[kMaxRotors];
+  double moment_constant[kMaxRotors];
+  double rotor_drag_coefficient[kMaxRotors];
+  double rolling_moment_coefficient[kMaxRotors];
+  double turning_direction[kMaxRotors];  ///< 1 for ccw, -1 for cw
+  double diameter[kMaxRotors];
+  const RotorTable *table;               ///< shared by all rotors, null for the analytic model
+  double air_density;
+
+  // per step inputs
+  double rot_vel[kMaxRotors];            ///< rotor speed, slowdown undone [rad/s]
+  double vel[3][kMaxRotors];             ///< rotor link velocity
+  double spin[3][kMaxRotors];            ///< rotor link z axis, the thrust direction
+  double axis[3][kMaxRotors];            ///< joint axis
+
+  // outputs
+  double thrust[kMaxRotors];             ///< along spin [N]
+  double drag[3][kMaxRotors];            ///< rotor drag on the rotor link [N]
+  double torque[3][kMaxRotors];          ///< drag torque plus rolling moment on the parent [Nm]
+  double load[kMaxRotors];               ///< drag torque over speed squared [Nm s^2]
+};
+
+inline void ComputeRotorForces(RotorSet *r)
+{
+  const int n = r->count;
+  for (int k = 0; k < n; ++k) {
+    const double w = r->rot_vel[k];
+    const double w_abs = std::fabs(w);
+    const double vx = r->vel[0][k], vy = r->vel[1][k], vz = r->vel[2][k];
+    const double sx = r->spin[0][k], sy = r->spin[1][k], sz = r->spin[2][k];
+
+    double thrust, drag_torque;
+    if (!r->table) {
+      thrust = w * w * r->motor_constant[k];
+      drag_torque = thrust * r->moment_constant[k];
+      r->load[k] = r->motor_constant[k] * r->moment_constant[k];
+      // thrust fades linearly to nothing at 25 m/s, see GazeboMotorModel
+      double scalar = 1.0 - std::sqrt(vx * vx + vy * vy + vz * vz) / 25.0;
+      scalar = scalar < 0.0 ? 0.0 : scalar > 1.0 ? 1.0 : scalar;
+      thrust *= scalar;
+    } else {
+      const double v_axial = vx * sx + vy * sy + vz * sz;
+      const double px = vx - v_axial * sx, py = vy - v_axial * sy, pz = vz - v_axial * sz;
+      const double v_inplane = std::sqrt(px * px + py * py + pz * pz);
+      r->table->Evaluate(w, v_axial, v_inplane, r->air_density, r->diameter[k], &thrust, &drag_torque);
+      // the table gives nothing at standstill, start up on the analytic load
+      r->load[k] = w * w > 1.0 ? drag_torque / (w * w) : r->motor_constant[k] * r->moment_constant[k];
+    }
+    r->thrust[k] = thrust;
+
+    // velocity perpendicular to the joint axis, - \omega * \lambda_1 * V_A^{\perp}
+    const double ax = r->axis[0][k], ay = r->axis[1][k], az = r->axis[2][k];
+    const double v_axis = vx * ax + vy * ay + vz * az;
+    const double qx = vx - v_axis * ax, qy = vy - v_axis * ay, qz = vz - v_axis * az;
+    const double drag = -w_abs * r->rotor_drag_coefficient[k];
+    r->drag[0][k] = drag * qx;
+    r->drag[1][k] = drag * qy;
+    r->drag[2][k] = drag * qz;
+
+    // drag torque against the turning direction about the rotor z axis,
+    // plus the rolling moment - \omega * \mu_1 * V_A^{\perp}
+    const double yaw = -r->turning_direction[k] * drag_torque;
+    const double roll = -w_abs * r->rolling_moment_coefficient[k];
+    r->torque[0][k] = yaw * sx + roll * qx;
+    r->torque[1][k] = yaw * sy + roll * qy;
+    r->torque[2][k] = yaw * sz + roll * qz;
+  }
+}
+
+}  // namespace gazebo
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Tabulated rotor thrust and torque coefficients
+ *
+ * Thrust and torque coefficients
+ *   CT = T / (rho n^2 D^4),  CQ = Q / (rho n^2 D^5)
+ * over the axial and in-plane advance ratios Ja = v_axial / (n D) and
+ * Ji = v_inplane / (n D), the rotor velocity along the thrust axis and its
+ * magnitude across it, both in rotor diameters per revolution. n is in
+ * revolutions per second. Tabulating against the two components directly
+ * keeps the lookup free of the sqrt and atan2 a total advance ratio and
+ * inflow angle would need. Tables are generated offline, see
+ * scripts/rotor_table_gen.py.
+ *
+ * File layout, little endian:
+ *   char[4]  "RTBL"
+ *   uint32   version (2)
+ *   uint32   number of axial, number of in-plane advance ratios
+ *   float64  axial advance ratio min, max, in-plane advance ratio min, max
+ *   float32  (CT, CQ) pairs, axial major, in-plane minor
+ *
+ * The two corners a lookup needs from each row are adjacent in memory.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace gazebo {
+
+class RotorTable {
+public:
+  RotorTable() : n_axial_(0), n_inplane_(0) {}
+
+  bool Empty() const { return data_.empty(); }
+
+  /// \brief Read a table file, on failure the table stays empty and error says why.
+  bool Load(const std::string &path, std::string *error)
+  {
+    data_.clear();
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+      *error = "cannot open " + path;
+      return false;
+    }
+
+    char magic[4];
+    uint32_t version, n_axial, n_inplane;
+    double range[4];
+    bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "RTBL", 4) == 0
+        && fread(&version, sizeof(version), 1, file) == 1 && version == 2
+        && fread(&n_axial, sizeof(n_axial), 1, file) == 1
+        && fread(&n_inplane, sizeof(n_inplane), 1, file) == 1
+        && fread(range, sizeof(double), 4, file) == 4
+        && n_axial >= 2 && n_inplane >= 2 && uint64_t(n_axial) * n_inplane <= (1u << 24)
+        && range[1] > range[0] && range[3] > range[2];
+    if (ok) {
+      data_.resize(2 * uint64_t(n_axial) * n_inplane);
+      ok = fread(data_.data(), sizeof(float), data_.size(), file) == data_.size();
+    }
+    fclose(file);
+
+    if (!ok) {
+      data_.clear();
+      *error = path + " is not a version 2 rotor table";
+      return false;
+    }
+
+    n_axial_ = n_axial;
+    n_inplane_ = n_inplane;
+    axial_min_ = range[0];
+    inplane_min_ = range[2];
+    axial_scale_ = (n_axial_ - 1) / (range[1] - range[0]);
+    inplane_scale_ = (n_inplane_ - 1) / (range[3] - range[2]);
+    return true;
+  }
+
+  /// \brief Bilinear lookup, clamped to the table range.
+  void Lookup(double axial, double inplane, double *ct, double *cq) const
+  {
+    double fa, fi;
+    const int ia = Cell(axial, axial_min_, axial_scale_, n_axial_, &fa);
+    const int ii = Cell(inplane, inplane_min_, inplane_scale_, n_inplane_, &fi);
+
+    const float *row0 = &data_[2 * (ia * n_inplane_ + ii)];
+    const float *row1 = row0 + 2 * n_inplane_;
+    const double w00 = (1.0 - fa) * (1.0 - fi);
+    const double w01 = (1.0 - fa) * fi;
+    const double w10 = fa * (1.0 - fi);
+    const double w11 = fa * fi;
+    *ct = w00 * row0[0] + w01 * row0[2] + w10 * row1[0] + w11 * row1[2];
+    *cq = w00 * row0[1] + w01 * row0[3] + w10 * row1[1] + w11 * row1[3];
+  }
+
+  /// \brief Thrust [N] and torque [Nm] magnitudes of a rotor turning at
+  /// rot_vel [rad/s] while moving with v_axial along its thrust axis and
+  /// v_inplane across it [m/s].
+  void Evaluate(double rot_vel, double v_axial, double v_inplane, double air_density, double diameter,
+                double *thrust, double *torque) const
+  {
+    const double n = std::fabs(rot_vel) / (2.0 * M_PI);
+    const double nd = n * diameter;
+    if (nd < 1e-6) {
+      *thrust = 0.0;
+      *torque = 0.0;
+      return;
+    }
+
+    const double inv_nd = 1.0 / nd;
+    double ct, cq;
+    Lookup(v_axial * inv_nd, v_inplane * inv_nd, &ct, &cq);
+
+    const double q = air_density * nd * nd * diameter * diameter;
+    *thrust = ct * q;
+    *torque = cq * q * diameter;
+  }
+
+private:
+  static int Cell(double x, double min, double scale, int n, double *frac)
+  {
+    double u = (x - min) * scale;
+    // NaN fails every comparison, it must not reach the cast
+    if (!(u >= 0.0)) {
+      u = 0.0;
+    }
+    u = u > n - 1 ? n - 1 : u;
+    int i = static_cast<int>(u);
+    if (i == n - 1) {
+      i = n - 2;
+    }
+    *frac = u - i;
+    return i;
+  }
+
+  int n_axial_;
+  int n_inplane_;
+  double axial_min_;
+  double inplane_min_;
+  double axial_scale_;
+  double inplane_scale_;
+  std::vector<float> data_;
+};
+
+}  // namespace gazebo
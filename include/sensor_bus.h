@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief In-process sensor bus
+ *
+ * Hands sensor samples from the model plugins to the MAVLink interface as
+ * plain structs, without protobuf serialization or the transport thread.
+ * Slots are looked up by the Gazebo topic the sample is also published on
+ * ("~/<model>/<topic>"), so both ends find each other without extra
+ * configuration. Producers only fill a slot once a consumer attached to it.
+ *
+ * The registry lives in its own shared library so that every plugin in the
+ * gzserver process sees the same instance.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <spsc_ring.h>
+
+namespace gazebo {
+
+struct ImuSample {
+  double orientation[4];          ///< w, x, y, z
+  double angular_velocity[3];     ///< [rad/s]
+  double linear_acceleration[3];  ///< [m/s^2]
+};
+
+struct GpsSample {
+  double time;
+  double latitude_deg;
+  double longitude_deg;
+  double altitude;
+  double eph;
+  double epv;
+  double velocity;
+  double velocity_east;
+  double velocity_north;
+  double velocity_up;
+};
+
+struct VisionSample {
+  int32_t usec;
+  float x, y, z;
+  float roll, pitch, yaw;
+};
+
+struct BatterySample {
+  double time;
+  double voltage;    ///< [V]
+  double current;    ///< [A]
+  double consumed;   ///< [mAh]
+  double remaining;  ///< 0 to 1
+  int32_t cells;
+};
+
+/// \brief Single producer, single consumer latest value (triple buffer).
+/// Neither side ever blocks, the reader always gets the newest complete value.
+template <typename T>
+class LatestValue {
+public:
+  LatestValue() : middle_(1), back_(2), front_(0) {}
+
+  void Write(const T &value)
+  {
+    buf_[back_] = value;
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndex;
+  }
+
+  /// \brief Copy the newest value if it has not been read yet.
+  bool Read(T &value)
+  {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+    value = buf_[front_];
+    return true;
+  }
+
+private:
+  static constexpr int kIndex = 0x3;
+  static constexpr int kFresh = 0x4;
+
+  T buf_[3];
+  std::atomic<int> middle_;
+  int back_;   ///< producer only
+  int front_;  ///< consumer only
+};
+
+template <typename T, size_t Capacity>
+struct SensorQueueSlot {
+  SensorQueueSlot() : attached(false), dropped(0) {}
+
+  /// \brief Producer side, a no-op while nobody consumes the slot.
+  void Publish(const T &sample)
+  {
+    if (attached.load(std::memory_order_acquire) && !ring.push(sample)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  SpscRing<T, Capacity> ring;
+  std::atomic<bool> attached;
+  std::atomic<uint64_t> dropped;
+};
+
+template <typename T>
+struct SensorLatestSlot {
+  SensorLatestSlot() : attached(false) {}
+
+  void Publish(const T &sample)
+  {
+    if (attached.load(std::memory_order_acquire)) {
+      value.Write(sample);
+    }
+  }
+
+  LatestValue<T> value;
+  std::atomic<bool> attached;
+};
+
+//! Every IMU sample matters, a physics step produces at most one
+typedef SensorQueueSlot<ImuSample, 16> ImuSlot;
+//! GPS samples leave the delay line in bursts after a pause
+typedef SensorQueueSlot<GpsSample, 16> GpsSlot;
+typedef SensorLatestSlot<VisionSample> VisionSlot;
+typedef SensorLatestSlot<BatterySample> BatterySlot;
+
+class SensorBus {
+public:
+  /// \brief The process wide bus shared by all plugins.
+  static SensorBus &Instance();
+
+  /// \brief Slots by topic, created on first use and never freed, so
+  /// pointers stay valid for the lifetime of the process.
+  ImuSlot *Imu(const std::string &topic);
+  GpsSlot *Gps(const std::string &topic);
+  VisionSlot *Vision(const std::string &topic);
+  BatterySlot *Battery(const std::string &topic);
+
+private:
+  SensorBus() {}
+  SensorBus(const SensorBus &) = delete;
+  SensorBus &operator=(const SensorBus &) = delete;
+
+  template <typename Slot>
+  Slot *Find(std::map<std::string, std::unique_ptr<Slot>> &slots, const std::string &topic)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<Slot> &slot = slots[topic];
+    if (!slot) {
+      slot.reset(new Slot());
+    }
+    return slot.get();
+  }
+
+  std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<ImuSlot>> imu_;
+  std::map<std::string, std::unique_ptr<GpsSlot>> gps_;
+  std::map<std::string, std::unique_ptr<VisionSlot>> vision_;
+  std::map<std::string, std::unique_ptr<BatterySlot>> battery_;
+};
+
+}  // namespace gazebo
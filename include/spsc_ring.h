@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Bounded single-producer/single-consumer ring
+ *
+ * Lock-free ring of preallocated slots. Exactly one thread may push and
+ * exactly one thread may pop at any time; nothing is allocated after
+ * construction.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace gazebo {
+
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() : head_(0), tail_(0), high_water_(0) {}
+
+  /// \brief Copy item into the next free slot, false if the ring is full.
+  bool push(const T& item) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail == Capacity) {
+      return false;
+    }
+    slots_[head & kMask] = item;
+    head_.store(head + 1, std::memory_order_release);
+
+    if (head + 1 - tail > high_water_.load(std::memory_order_relaxed)) {
+      high_water_.store(head + 1 - tail, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  /// \brief Move the oldest item out of the ring, false if it is empty.
+  bool pop(T& item) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t head = head_.load(std::memory_order_acquire);
+    if (head == tail) {
+      return false;
+    }
+    item = slots_[tail & kMask];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /// \brief Highest occupancy seen so far (maintained by the producer).
+  size_t high_water() const {
+    return high_water_.load(std::memory_order_relaxed);
+  }
+
+  static constexpr size_t capacity() {
+    return Capacity;
+  }
+
+private:
+  static constexpr size_t kMask = Capacity - 1;
+  static constexpr size_t kCacheLine = 64;
+
+  // producer and consumer indices live on separate cache lines
+  std::atomic<size_t> head_;
+  char pad_head_[kCacheLine - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail_;
+  char pad_tail_[kCacheLine - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> high_water_;
+
+  T slots_[Capacity];
+};
+
+}  // namespace gazebo
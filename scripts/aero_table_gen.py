@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+"""
+Generate an aerodynamic coefficient table for LiftDragPlugin and
+LiftDragBankPlugin (see include/liftdrag_plugin/aero_table.h).
+
+Coefficients over angle of attack, sideslip and control deflection, against
+the full dynamic pressure and the surface area. Two models:
+
+  flatplate  linear lift and a drag polar blended into flat plate
+             coefficients past stall (Beard and McLain), over the full
+             angle of attack range, with the centre of pressure moving aft
+             past stall. The moment is in Nm per unit q S, so the chord
+             is folded in.
+  liftdrag   the analytic model of LiftDragPlugin from its SDF parameters,
+             including its sweep handling. A surface with this table flies
+             like the analytic one, which makes it the starting point for
+             a model that is then refined and for checking the table path.
+"""
+
+from __future__ import print_function
+import argparse
+import math
+import struct
+
+
+def fold(alpha):
+    """Angle of attack folded to +/-90 deg, as LiftDragPlugin does."""
+    while abs(alpha) > 0.5 * math.pi:
+        alpha = alpha - math.pi if alpha > 0 else alpha + math.pi
+    return alpha
+
+
+def liftdrag(alpha, beta, delta, args):
+    a = fold(alpha)
+    stall = args.alpha_stall
+    sin_sweep = math.sin(beta)
+    cos_sweep = 1.0 - sin_sweep * sin_sweep
+    if a > stall:
+        cl = max(0.0, (args.cla * stall + args.cla_stall * (a - stall)) * cos_sweep)
+        cd = (args.cda * stall + args.cda_stall * (a - stall)) * cos_sweep
+    elif a < -stall:
+        cl = min(0.0, (-args.cla * stall + args.cla_stall * (a + stall)) * cos_sweep)
+        cd = (-args.cda * stall + args.cda_stall * (a + stall)) * cos_sweep
+    else:
+        cl = args.cla * a * cos_sweep
+        cd = args.cda * a * cos_sweep
+    cl += args.control_joint_rad_to_cl * delta
+    cd = abs(cd)
+    # LiftDragPlugin takes the dynamic pressure of v (1 - sin(sweep))
+    scale = (1.0 - sin_sweep) ** 2
+    return cl * scale, cd * scale, 0.0
+
+
+def flatplate(alpha, beta, delta, args):
+    m = args.blend
+    stall = args.alpha_stall
+    e1 = math.exp(-m * (alpha - stall))
+    e2 = math.exp(m * (alpha + stall))
+    sigma = (1.0 + e1 + e2) / ((1.0 + e1) * (1.0 + e2))
+
+    cl_linear = args.cl0 + args.cla * alpha + args.cl_delta * delta
+    cd_linear = args.cd0 + args.cd_k * cl_linear * cl_linear
+    cm_linear = args.cm0 + args.cma * alpha + args.cm_delta * delta
+
+    sin_a = math.sin(alpha)
+    normal = args.cd90 * sin_a
+    cl_plate = normal * math.cos(alpha)
+    cd_plate = args.cd0 + normal * sin_a
+    # centre of pressure from the quarter chord to mid chord at 90 deg
+    cm_plate = -normal * 0.25 * abs(sin_a)
+
+    cl = (1.0 - sigma) * cl_linear + sigma * cl_plate
+    cd = (1.0 - sigma) * cd_linear + sigma * cd_plate
+    cm = ((1.0 - sigma) * cm_linear + sigma * cm_plate) * args.chord
+
+    # only the velocity in the lift drag plane acts on the section
+    c2 = math.cos(beta) ** 2
+    return cl * c2, args.cd0 + (cd - args.cd0) * c2, cm * c2
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('output', help='table file to write')
+    parser.add_argument('--model', choices=['flatplate', 'liftdrag'], default='flatplate')
+    parser.add_argument('--alpha-points', type=int, default=361, help='over -180 to 180 deg')
+    parser.add_argument('--beta-points', type=int, default=37, help='over -90 to 90 deg')
+    parser.add_argument('--delta-points', type=int, default=11)
+    parser.add_argument('--delta-max', type=float, default=0.5, help='control deflection range +/- [rad]')
+    # shared
+    parser.add_argument('--cla', type=float, default=4.752798721, help='lift slope [1/rad]')
+    parser.add_argument('--alpha-stall', type=float, default=0.3391428111, help='[rad]')
+    # flatplate
+    parser.add_argument('--cl0', type=float, default=0.0)
+    parser.add_argument('--cd0', type=float, default=0.02)
+    parser.add_argument('--cd-k', type=float, default=0.05, help='induced drag factor, CD = cd0 + k CL^2')
+    parser.add_argument('--cd90', type=float, default=1.98, help='flat plate drag at 90 deg')
+    parser.add_argument('--cm0', type=float, default=0.0)
+    parser.add_argument('--cma', type=float, default=-0.5, help='[1/rad]')
+    parser.add_argument('--cl-delta', type=float, default=-0.5, help='lift per control deflection [1/rad]')
+    parser.add_argument('--cm-delta', type=float, default=0.0, help='moment per control deflection [1/rad]')
+    parser.add_argument('--chord', type=float, default=0.1, help='mean chord [m]')
+    parser.add_argument('--blend', type=float, default=50.0, help='stall transition rate')
+    # liftdrag, LiftDragPlugin element names
+    parser.add_argument('--cda', type=float, default=0.6417112299)
+    parser.add_argument('--cla-stall', type=float, default=-3.85)
+    parser.add_argument('--cda-stall', type=float, default=-0.9233984055)
+    parser.add_argument('--control-joint-rad-to-cl', type=float, default=-0.5)
+    args = parser.parse_args()
+
+    model = flatplate if args.model == 'flatplate' else liftdrag
+    ranges = [(-math.pi, math.pi), (-0.5 * math.pi, 0.5 * math.pi), (-args.delta_max, args.delta_max)]
+    counts = [args.alpha_points, args.beta_points, args.delta_points]
+    axes = [[lo + (hi - lo) * i / (n - 1) for i in range(n)] for (lo, hi), n in zip(ranges, counts)]
+
+    with open(args.output, 'wb') as f:
+        f.write(b'ATBL')
+        f.write(struct.pack('<IIII', 1, *counts))
+        f.write(struct.pack('<dddddd', *[x for r in ranges for x in r]))
+        for alpha in axes[0]:
+            for beta in axes[1]:
+                for delta in axes[2]:
+                    f.write(struct.pack('<fff', *model(alpha, beta, delta, args)))
+
+    cl, cd, cm = model(0.0, 0.0, 0.0, args)
+    print('{:s}: {:d} x {:d} x {:d}, CL {:.3f} CD {:.4f} CM {:.4f} at zero angles'.format(
+        args.output, counts[0], counts[1], counts[2], cl, cd, cm))
+
+
+if __name__ == '__main__':
+    main()
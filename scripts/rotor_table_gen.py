@@ -0,0 +1,140 @@
+#!/usr/bin/env python
+"""
+Generate a rotor table for the rotor models (see include/rotor_table.h).
+
+Thrust and torque coefficients over the axial and in-plane advance ratios,
+v_axial / (n D) and v_inplane / (n D), from blade element momentum
+theory: blade elements averaged over the rotor azimuth, uniform induced
+velocity from Glauert's momentum relation, linear lift up to stall and
+parabolic drag polar.
+
+With --motor-constant and --moment-constant the table is scaled so that the
+static point reproduces the analytic model of the motor plugins
+(T = k_f w^2, Q = k_m T), keeping existing models tuned the same in hover.
+"""
+
+from __future__ import print_function
+import argparse
+import math
+import struct
+
+
+def blade_loads(v_axial, v_inplane, vi, args):
+    """Thrust and torque of a rotor with D = 1 m, n = 1 rev/s, rho = 1, so
+    the velocities are the advance ratios. v_axial > 0 moves the rotor along
+    its thrust, in climb or tilted nose down in forward flight.
+
+    Without drag, stall and root cutout this matches the uniform inflow
+    closed form CT = sigma a / 2 int (theta (r^2 + mu^2 / 2) - lambda r) dr
+    to 1 % up to mu = 0.2, and 4 % at mu = 0.3 where reverse flow and the
+    small angle assumption of the closed form set in."""
+    radius = 0.5
+    omega = 2.0 * math.pi
+    chord = args.chord_ratio * radius
+    pitch = args.pitch_ratio * 2.0 * radius
+
+    thrust = 0.0
+    torque = 0.0
+    dr = (1.0 - args.root_cutout) * radius / args.radial_stations
+    for i in range(args.radial_stations):
+        r = (args.root_cutout + (i + 0.5) / args.radial_stations * (1.0 - args.root_cutout)) * radius
+        theta = math.atan2(pitch, 2.0 * math.pi * r)
+        for j in range(args.azimuth_stations):
+            psi = 2.0 * math.pi * j / args.azimuth_stations
+            u_t = omega * r + v_inplane * math.sin(psi)
+            if u_t <= 0.0:
+                # reverse flow region, ignored
+                continue
+            u_p = v_axial + vi
+            phi = math.atan2(u_p, u_t)
+            cl = max(-args.cl_max, min(args.cl_max, args.lift_slope * (theta - phi)))
+            cd = args.cd0 + args.cd_k * cl * cl
+            q = 0.5 * (u_t * u_t + u_p * u_p) * chord * dr
+            lift = q * cl
+            drag = q * cd
+            thrust += lift * math.cos(phi) - drag * math.sin(phi)
+            torque += (lift * math.sin(phi) + drag * math.cos(phi)) * r
+    scale = float(args.blades) / args.azimuth_stations
+    return thrust * scale, torque * scale
+
+
+def solve(v_axial, v_inplane, args):
+    """Iterate the induced velocity until blade element and momentum thrust agree."""
+    area = math.pi * 0.25
+    vi = 0.1
+    for _ in range(200):
+        thrust, torque = blade_loads(v_axial, v_inplane, vi, args)
+        # Glauert: T = 2 rho A vi sqrt(v_inplane^2 + (v_axial + vi)^2), solved for vi by bisection
+        target = max(thrust, 0.0)
+        lo, hi = 0.0, 10.0
+        for _ in range(60):
+            mid = 0.5 * (lo + hi)
+            if 2.0 * area * mid * math.hypot(v_inplane, v_axial + mid) < target:
+                lo = mid
+            else:
+                hi = mid
+        new_vi = 0.5 * (lo + hi)
+        if abs(new_vi - vi) < 1e-7:
+            break
+        vi += 0.5 * (new_vi - vi)
+    return blade_loads(v_axial, v_inplane, vi, args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('output', help='table file to write')
+    parser.add_argument('--blades', type=int, default=2)
+    parser.add_argument('--pitch-ratio', type=float, default=0.45, help='geometric pitch / diameter')
+    parser.add_argument('--chord-ratio', type=float, default=0.12, help='chord / radius')
+    parser.add_argument('--root-cutout', type=float, default=0.15, help='blade root / radius')
+    parser.add_argument('--lift-slope', type=float, default=5.7, help='per rad')
+    parser.add_argument('--cl-max', type=float, default=1.2)
+    parser.add_argument('--cd0', type=float, default=0.012)
+    parser.add_argument('--cd-k', type=float, default=0.02)
+    parser.add_argument('--advance-max', type=float, default=1.5,
+                        help='axial advance ratio over +/- this, in-plane over 0 to this')
+    parser.add_argument('--axial-points', type=int, default=31, help='odd, so static is a grid point')
+    parser.add_argument('--inplane-points', type=int, default=16)
+    parser.add_argument('--radial-stations', type=int, default=20)
+    parser.add_argument('--azimuth-stations', type=int, default=24)
+    parser.add_argument('--motor-constant', type=float, help='k_f of the model, thrust = k_f w^2 [N s^2]')
+    parser.add_argument('--moment-constant', type=float, help='k_m of the model, torque = k_m thrust [m]')
+    parser.add_argument('--diameter', type=float, help='rotor diameter [m], needed to match the model')
+    parser.add_argument('--air-density', type=float, default=1.225)
+    args = parser.parse_args()
+
+    if args.axial_points % 2 == 0:
+        parser.error('--axial-points must be odd')
+    ranges = [(-args.advance_max, args.advance_max), (0.0, args.advance_max)]
+    counts = [args.axial_points, args.inplane_points]
+    axial, inplane = [[lo + (hi - lo) * i / (n - 1) for i in range(n)] for (lo, hi), n in zip(ranges, counts)]
+
+    table = [[solve(ja, ji, args) for ji in inplane] for ja in axial]
+    static = args.axial_points // 2
+
+    ct_scale = cq_scale = 1.0
+    if args.motor_constant is not None:
+        if args.diameter is None or args.moment_constant is None:
+            parser.error('--motor-constant needs --moment-constant and --diameter')
+        ct0, cq0 = table[static][0]
+        d = args.diameter
+        # T = k_f (2 pi n)^2 = CT rho n^2 D^4
+        ct_model = args.motor_constant * (2.0 * math.pi) ** 2 / (args.air_density * d ** 4)
+        ct_scale = ct_model / ct0
+        cq_scale = ct_model * args.moment_constant / d / cq0
+
+    with open(args.output, 'wb') as f:
+        f.write(b'RTBL')
+        f.write(struct.pack('<III', 2, *counts))
+        f.write(struct.pack('<dddd', *[x for r in ranges for x in r]))
+        for row in table:
+            for ct, cq in row:
+                f.write(struct.pack('<ff', ct * ct_scale, cq * cq_scale))
+
+    ct0, cq0 = table[static][0]
+    print('{:s}: {:d} x {:d}, static CT {:.4f} CQ {:.5f}'.format(
+        args.output, counts[0], counts[1], ct0 * ct_scale, cq0 * cq_scale))
+
+
+if __name__ == '__main__':
+    main()
@@ -68,13 +68,12 @@ void GazeboControllerInterface::OnUpdate(const common::UpdateInfo& /*_info*/) {
 
   common::Time now = world_->GetSimTime();
 
-  mav_msgs::msgs::CommandMotorSpeed turning_velocities_msg;
-
+  resizeRepeated(turning_velocities_msg_.mutable_motor_speed(), input_reference_.size());
   for (int i = 0; i < input_reference_.size(); i++)
-  turning_velocities_msg.add_motor_speed(input_reference_[i]);
+  turning_velocities_msg_.set_motor_speed(i, input_reference_[i]);
   // Add header timestamp etc
 
-  motor_velocity_reference_pub_->Publish(turning_velocities_msg);
+  motor_velocity_reference_pub_->Publish(turning_velocities_msg_);
 }
 
 void GazeboControllerInterface::CommandMotorCallback(CommandMotorSpeedPtr &input_reference_msg) {
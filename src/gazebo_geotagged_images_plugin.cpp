@@ -35,12 +35,6 @@ using namespace cv;
 
 GZ_REGISTER_SENSOR_PLUGIN(GeotaggedImagesPlugin)
 
-static void* start_thread(void* param) {
-    GeotaggedImagesPlugin* plugin = (GeotaggedImagesPlugin*)param;
-    plugin->cameraThread();
-    return nullptr;
-}
-
 GeotaggedImagesPlugin::GeotaggedImagesPlugin()
     : SensorPlugin()
     , _imageCounter(0)
@@ -58,6 +52,12 @@ GeotaggedImagesPlugin::GeotaggedImagesPlugin()
 
 GeotaggedImagesPlugin::~GeotaggedImagesPlugin()
 {
+    if (_updateConnection) {
+        event::Events::DisconnectWorldUpdateBegin(_updateConnection);
+    }
+    if (_fd >= 0) {
+        MavlinkReactor::Instance().Unregister(_fd);
+    }
     _parentSensor.reset();
     _camera.reset();
 }
@@ -146,9 +146,15 @@ void GeotaggedImagesPlugin::Load(sensors::SensorPtr sensor, sdf::ElementPtr sdf)
     boost::filesystem::create_directory(_storageDir);
 
     if (_init_udp(sdf)) {
-        // Start UDP thread
-        pthread_t threadId;
-        pthread_create(&threadId, NULL, start_thread, this);
+        // The camera socket is serviced by the shared MAVLink reactor once per world step
+#if GAZEBO_MAJOR_VERSION >= 7
+        _world = physics::get_world(_parentSensor->WorldName());
+#else
+        _world = physics::get_world(_parentSensor->GetWorldName());
+#endif
+        MavlinkReactor::Instance().Register(_fd, std::bind(&GeotaggedImagesPlugin::OnSocketReadable, this));
+        _updateConnection = event::Events::ConnectWorldUpdateBegin(
+                                boost::bind(&GeotaggedImagesPlugin::OnWorldUpdate, this, _1));
     }
 }
 
@@ -365,39 +371,41 @@ void GeotaggedImagesPlugin::_send_heartbeat()
     fflush(stderr);
 }
 
-void GeotaggedImagesPlugin::cameraThread() {
-    mavlink_status_t  status;
-    mavlink_message_t msg;
-    unsigned char buffer[16 * 1024];
-    while (true) {
-        ::poll(&_fds[0], (sizeof(_fds[0]) / sizeof(_fds[0])), 1000);
-        if (_fds[0].revents & POLLIN) {
-            struct sockaddr srcaddr;
-            socklen_t addrlen = sizeof(srcaddr);
-            int len = recvfrom(_fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&srcaddr, &addrlen);
-            if (len > 0) {
-                for (unsigned i = 0; i < len; ++i)
-                {
-                    if (mavlink_parse_char(MAVLINK_COMM_1, buffer[i], &msg, &status))
-                    {
-                        // have a message, handle it
-                        _handle_message(&msg, &srcaddr);
-                        memset(&status, 0, sizeof(status));
-                        memset(&msg, 0, sizeof(msg));
-                    }
-                }
-            }
-        }
-        // Heartbeat
+void GeotaggedImagesPlugin::OnWorldUpdate(const common::UpdateInfo& info) {
+    // Service the camera socket (and any other MAVLink socket) once per step
+    MavlinkReactor::Instance().ServiceOnce(_world->GetIterations());
+
+    // Heartbeat
 #if GAZEBO_MAJOR_VERSION >= 8
-        common::Time current_time = _scene->SimTime();
+    common::Time current_time = _scene->SimTime();
 #else
-        common::Time current_time = _scene->GetSimTime();
+    common::Time current_time = _scene->GetSimTime();
 #endif
-        double elapsed = (current_time - _last_heartbeat).Double();
-        if (elapsed > 1.0) {
-            _last_heartbeat = current_time;
-            _send_heartbeat();
+    double elapsed = (current_time - _last_heartbeat).Double();
+    if (elapsed > 1.0) {
+        _last_heartbeat = current_time;
+        _send_heartbeat();
+    }
+}
+
+void GeotaggedImagesPlugin::OnSocketReadable() {
+    unsigned char buffer[16 * 1024];
+    while (true) {
+        struct sockaddr srcaddr;
+        socklen_t addrlen = sizeof(srcaddr);
+        int len = recvfrom(_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&srcaddr, &addrlen);
+        if (len <= 0) {
+            break;
+        }
+        for (unsigned i = 0; i < len; ++i)
+        {
+            if (mavlink_parse_char(MAVLINK_COMM_1, buffer[i], &_msg, &_status))
+            {
+                // have a message, handle it
+                _handle_message(&_msg, &srcaddr);
+                memset(&_status, 0, sizeof(_status));
+                memset(&_msg, 0, sizeof(_msg));
+            }
         }
     }
 }
@@ -438,8 +446,6 @@ bool GeotaggedImagesPlugin::_init_udp(sdf::ElementPtr sdf) {
     _gcsaddr.sin_family = AF_INET;
     _gcsaddr.sin_addr.s_addr = mavlink_addr;
     _gcsaddr.sin_port = htons(14550);
-    _fds[0].fd = _fd;
-    _fds[0].events = POLLIN;
     mavlink_status_t* chan_state = mavlink_get_channel_status(MAVLINK_COMM_1);
     chan_state->flags &= ~(MAVLINK_STATUS_FLAG_OUT_MAVLINK1);
     gzmsg << "Camera on udp port 14530\n";
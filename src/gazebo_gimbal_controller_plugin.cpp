@@ -141,27 +141,32 @@ void GimbalControllerPlugin::Init()
   this->lastUpdateTime = this->model->GetWorld()->GetSimTime();
 
   // receive pitch command via gz transport
-  std::string pitchTopic = std::string("~/") +  this->model->GetName() +
+  this->pitchCmdTopic = std::string("~/") +  this->model->GetName() +
     "/gimbal_pitch_cmd";
-  this->pitchSub = this->node->Subscribe(pitchTopic,
+  this->pitchSub = this->node->Subscribe(this->pitchCmdTopic,
      &GimbalControllerPlugin::OnPitchStringMsg, this);
   // receive roll command via gz transport
-  std::string rollTopic = std::string("~/") +  this->model->GetName() +
+  this->rollCmdTopic = std::string("~/") +  this->model->GetName() +
     "/gimbal_roll_cmd";
-  this->rollSub = this->node->Subscribe(rollTopic,
+  this->rollSub = this->node->Subscribe(this->rollCmdTopic,
      &GimbalControllerPlugin::OnRollStringMsg, this);
   // receive yaw command via gz transport
-  std::string yawTopic = std::string("~/") +  this->model->GetName() +
+  this->yawCmdTopic = std::string("~/") +  this->model->GetName() +
     "/gimbal_yaw_cmd";
-  this->yawSub = this->node->Subscribe(yawTopic,
+  this->yawSub = this->node->Subscribe(this->yawCmdTopic,
      &GimbalControllerPlugin::OnYawStringMsg, this);
+  // the mavlink interface sends its position_gztopic targets batched,
+  // tagged with the topic names above
+  this->jointCommandSub = this->node->Subscribe(std::string("~/") +
+    this->model->GetName() + "/joint_command",
+     &GimbalControllerPlugin::OnJointCommand, this);
 
   // plugin update
   this->connections.push_back(event::Events::ConnectWorldUpdateBegin(
           boost::bind(&GimbalControllerPlugin::OnUpdate, this)));
 
   // publish pitch status via gz transport
-  pitchTopic = std::string("~/") +  this->model->GetName()
+  std::string pitchTopic = std::string("~/") +  this->model->GetName()
     + "/gimbal_pitch_status";
 #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
   /// only gazebo 7.4 and above support Any
@@ -171,7 +176,7 @@ void GimbalControllerPlugin::Init()
 #endif
 
   // publish roll status via gz transport
-  rollTopic = std::string("~/") +  this->model->GetName()
+  std::string rollTopic = std::string("~/") +  this->model->GetName()
     + "/gimbal_roll_status";
 #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
   /// only gazebo 7.4 and above support Any
@@ -181,7 +186,7 @@ void GimbalControllerPlugin::Init()
 #endif
 
   // publish yaw status via gz transport
-  yawTopic = std::string("~/") +  this->model->GetName()
+  std::string yawTopic = std::string("~/") +  this->model->GetName()
     + "/gimbal_yaw_status";
 #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
   /// only gazebo 7.4 and above support Any
@@ -203,6 +208,22 @@ void GimbalControllerPlugin::ImuCallback(ImuPtr& imu_message)
 						 imu_message->orientation().z()).Euler()[2];
 }
 
+/////////////////////////////////////////////////
+void GimbalControllerPlugin::OnJointCommand(JointCommandPtr &_msg)
+{
+  const int n = std::min(_msg->topic_size(), _msg->position_size());
+  for (int i = 0; i < n; ++i)
+  {
+    const std::string &topic = _msg->topic(i);
+    if (topic == this->pitchCmdTopic)
+      this->pitchCommand = _msg->position(i);
+    else if (topic == this->rollCmdTopic)
+      this->rollCommand = _msg->position(i);
+    else if (topic == this->yawCmdTopic)
+      this->yawCommand = _msg->position(i);
+  }
+}
+
 #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
 /// only gazebo 7.4 and above support Any
 /////////////////////////////////////////////////
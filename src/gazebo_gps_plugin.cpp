@@ -35,6 +35,12 @@ GpsPlugin::GpsPlugin() : ModelPlugin()
 GpsPlugin::~GpsPlugin()
 {
   event::Events::DisconnectWorldUpdateBegin(updateConnection_);
+  if (gt_log_.IsOpen()) {
+    gt_log_.Close();
+    if (gt_log_.Dropped() > 0) {
+      gzwarn << "[gazebo_gps_plugin] groundtruth log dropped " << gt_log_.Dropped() << " records.\n";
+    }
+  }
 }
 
 void GpsPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
@@ -46,11 +52,6 @@ void GpsPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
   last_time_ = world_->GetSimTime();
   last_gps_time_ = world_->GetSimTime();
 
-  // Use environment variables if set for home position.
-  const char *env_lat = std::getenv("PX4_HOME_LAT");
-  const char *env_lon = std::getenv("PX4_HOME_LON");
-  const char *env_alt = std::getenv("PX4_HOME_ALT");
-
   // Get noise param
   if (_sdf->HasElement("gpsNoise")) {
     getSdfParam<bool>(_sdf, "gpsNoise", gps_noise_, gps_noise_);
@@ -58,17 +59,21 @@ void GpsPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
     gps_noise_ = false;
   }
 
-  if (env_lat) {
-    gzmsg << "Home latitude is set to " << env_lat << ".\n";
-    lat_home = std::stod(env_lat) * M_PI / 180.0;
-  }
-  if (env_lon) {
-    gzmsg << "Home longitude is set to " << env_lon << ".\n";
-    lon_home = std::stod(env_lon) * M_PI / 180.0;
-  }
-  if (env_alt) {
-    gzmsg << "Home altitude is set to " << env_alt << ".\n";
-    alt_home = std::stod(env_alt);
+  // Use environment variables if set for home position.
+  home_frame_ = HomeFrameFromEnvironment();
+  gzmsg << "Home position is " << home_frame_.LatHome() * 180.0 / M_PI << ", "
+        << home_frame_.LonHome() * 180.0 / M_PI << ", " << home_frame_.AltHome() << ".\n";
+
+  getSdfParam<double>(_sdf, "groundtruthRate", gt_rate_, 50.0);
+  last_gt_time_ = world_->GetSimTime();
+
+  if (_sdf->HasElement("groundtruthLog")) {
+    const std::string path = _sdf->GetElement("groundtruthLog")->Get<std::string>();
+    if (gt_log_.Open(path)) {
+      gzmsg << "[gazebo_gps_plugin] Logging groundtruth to " << path << ".\n";
+    } else {
+      gzerr << "[gazebo_gps_plugin] Could not open groundtruth log " << path << ".\n";
+    }
   }
 
   namespace_.clear();
@@ -87,8 +92,11 @@ void GpsPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
 
   gravity_W_ = world_->GetPhysicsEngine()->GetGravity();
 
+  noise_.Seed(math::Rand::GetSeed(), model_->GetName(), "gps");
+
   gps_pub_ = node_handle_->Advertise<gps_msgs::msgs::SITLGps>("~/" + model_->GetName() + "/gps", 10);
   gt_pub_ = node_handle_->Advertise<gps_msgs::msgs::Groundtruth>("~/" + model_->GetName() + "/groundtruth", 10);
+  gps_bus_ = SensorBus::Instance().Gps("~/" + model_->GetName() + "/gps");
 }
 
 void GpsPlugin::OnUpdate(const common::UpdateInfo&){
@@ -98,9 +106,6 @@ void GpsPlugin::OnUpdate(const common::UpdateInfo&){
   math::Pose T_W_I = model_->GetWorldPose();    // TODO(burrimi): Check tf
   math::Vector3& pos_W_I = T_W_I.pos;           // Use the models' world position for GPS and groundtruth
 
-  // reproject position without noise into geographic coordinates
-  auto latlon_gt = reproject(pos_W_I);
-
   math::Vector3 velocity_current_W = model_->GetWorldLinearVel();    // Use the models' world position for GPS velocity.
 
   math::Vector3 velocity_current_W_xy = velocity_current_W;
@@ -108,15 +113,15 @@ void GpsPlugin::OnUpdate(const common::UpdateInfo&){
 
   // update noise parameters if gps_noise_ is set
   if (gps_noise_) {
-    noise_gps_pos.x = gps_xy_noise_density * sqrt(dt) * randn_(rand_);
-    noise_gps_pos.y = gps_xy_noise_density * sqrt(dt) * randn_(rand_);
-    noise_gps_pos.z = gps_z_noise_density * sqrt(dt) * randn_(rand_);
-    noise_gps_vel.x = gps_vxy_noise_density * sqrt(dt) * randn_(rand_);
-    noise_gps_vel.y = gps_vxy_noise_density * sqrt(dt) * randn_(rand_);
-    noise_gps_vel.z = gps_vz_noise_density * sqrt(dt) * randn_(rand_);
-    random_walk_gps.x = gps_xy_random_walk * sqrt(dt) * randn_(rand_);
-    random_walk_gps.y = gps_xy_random_walk * sqrt(dt) * randn_(rand_);
-    random_walk_gps.z = gps_z_random_walk * sqrt(dt) * randn_(rand_);
+    noise_gps_pos.x = gps_xy_noise_density * sqrt(dt) * noise_.Normal();
+    noise_gps_pos.y = gps_xy_noise_density * sqrt(dt) * noise_.Normal();
+    noise_gps_pos.z = gps_z_noise_density * sqrt(dt) * noise_.Normal();
+    noise_gps_vel.x = gps_vxy_noise_density * sqrt(dt) * noise_.Normal();
+    noise_gps_vel.y = gps_vxy_noise_density * sqrt(dt) * noise_.Normal();
+    noise_gps_vel.z = gps_vz_noise_density * sqrt(dt) * noise_.Normal();
+    random_walk_gps.x = gps_xy_random_walk * sqrt(dt) * noise_.Normal();
+    random_walk_gps.y = gps_xy_random_walk * sqrt(dt) * noise_.Normal();
+    random_walk_gps.z = gps_z_random_walk * sqrt(dt) * noise_.Normal();
   }
   else {
     noise_gps_pos.x = 0.0;
@@ -135,88 +140,92 @@ void GpsPlugin::OnUpdate(const common::UpdateInfo&){
   gps_bias.y += random_walk_gps.y * dt - gps_bias.y / gps_corellation_time;
   gps_bias.z += random_walk_gps.z * dt - gps_bias.z / gps_corellation_time;
 
-  // reproject position with noise into geographic coordinates
+  // reproject position with and without noise into geographic coordinates
   auto pos_with_noise = pos_W_I + noise_gps_pos + gps_bias;
-  auto latlon = reproject(pos_with_noise);
+  const double enu[6] = {
+    pos_with_noise.x, pos_with_noise.y, pos_with_noise.z,
+    pos_W_I.x, pos_W_I.y, pos_W_I.z
+  };
+  double lla[6];
+  home_frame_.EnuToGeodetic(enu, lla, 2);
+  const double* lla_gps = lla;
+  const double* lla_gt = lla + 3;
 
   // standard deviation TODO: add a way of computing this
   std_xy = 1.0;
   std_z = 1.0;
 
-  // fill SITLGps msg
-  gps_msg.set_time(current_time.Double());
-  gps_msg.set_latitude_deg(latlon.first * 180.0 / M_PI);
-  gps_msg.set_longitude_deg(latlon.second * 180.0 / M_PI);
-  gps_msg.set_altitude(pos_W_I.z + alt_home + noise_gps_pos.z + gps_bias.z);
-  gps_msg.set_eph(std_xy);
-  gps_msg.set_epv(std_z);
-  gps_msg.set_velocity(velocity_current_W_xy.GetLength());
-  gps_msg.set_velocity_east(velocity_current_W.x + noise_gps_vel.y);
-  gps_msg.set_velocity_north(velocity_current_W.y + noise_gps_vel.x);
-  gps_msg.set_velocity_up(velocity_current_W.z + noise_gps_vel.z);
-
-  // add msg to buffer
-  gps_delay_buffer.push(gps_msg);
+  // fill GPS sample
+  GpsSample gps_sample;
+  gps_sample.time = current_time.Double();
+  gps_sample.latitude_deg = lla_gps[0] * 180.0 / M_PI;
+  gps_sample.longitude_deg = lla_gps[1] * 180.0 / M_PI;
+  gps_sample.altitude = lla_gps[2];
+  gps_sample.eph = std_xy;
+  gps_sample.epv = std_z;
+  gps_sample.velocity = velocity_current_W_xy.GetLength();
+  gps_sample.velocity_east = velocity_current_W.x + noise_gps_vel.y;
+  gps_sample.velocity_north = velocity_current_W.y + noise_gps_vel.x;
+  gps_sample.velocity_up = velocity_current_W.z + noise_gps_vel.z;
+
+  // add sample to the delay line
+  gps_delay_line_.Push(gps_sample.time, gps_sample);
 
   // apply GPS delay
   if ((current_time - last_gps_time_).Double() > gps_update_interval_) {
     last_gps_time_ = current_time;
 
-    while (true) {
-      gps_msg = gps_delay_buffer.front();
-      double gps_current_delay = current_time.Double() - gps_delay_buffer.front().time();
-      if (gps_delay_buffer.empty()) {
-        // abort if buffer is empty already
-        break;
-      }
-      // remove data that is too old or if buffer size is too large
-      if (gps_current_delay > gps_delay) {
-        gps_delay_buffer.pop();
-        // remove data if buffer too large
-      } else if (gps_delay_buffer.size() > gps_buffer_size_max) {
-        gps_delay_buffer.pop();
-      } else {
-        // if we get here, we have good data, stop
-        break;
-      }
+    const GpsSample* delayed = gps_delay_line_.Delayed(current_time.Double(), gps_delay);
+    if (delayed) {
+      // fill SITLGps msg
+      gps_msg.set_time(delayed->time);
+      gps_msg.set_latitude_deg(delayed->latitude_deg);
+      gps_msg.set_longitude_deg(delayed->longitude_deg);
+      gps_msg.set_altitude(delayed->altitude);
+      gps_msg.set_eph(delayed->eph);
+      gps_msg.set_epv(delayed->epv);
+      gps_msg.set_velocity(delayed->velocity);
+      gps_msg.set_velocity_east(delayed->velocity_east);
+      gps_msg.set_velocity_north(delayed->velocity_north);
+      gps_msg.set_velocity_up(delayed->velocity_up);
+
+      // publish SITLGps msg at 5hz
+      gps_pub_->Publish(gps_msg);
+      gps_bus_->Publish(*delayed);
     }
-    // publish SITLGps msg at 5hz
-    gps_pub_->Publish(gps_msg);
   }
 
-  // fill Groundtruth msg
-  groundtruth_msg.set_time(current_time.Double());
-  groundtruth_msg.set_latitude_rad(latlon_gt.first);
-  groundtruth_msg.set_longitude_rad(latlon_gt.second);
-  groundtruth_msg.set_altitude(-pos_W_I.z + alt_home);
-  groundtruth_msg.set_velocity_east(velocity_current_W.x);
-  groundtruth_msg.set_velocity_north(velocity_current_W.y);
-  groundtruth_msg.set_velocity_up(velocity_current_W.z);
-
-  // publish Groundtruth msg at full rate
-  gt_pub_->Publish(groundtruth_msg);
+  if (gt_log_.IsOpen()) {
+    GroundtruthRecord record;
+    record.time = current_time.Double();
+    record.latitude_rad = lla_gt[0];
+    record.longitude_rad = lla_gt[1];
+    record.altitude = lla_gt[2];
+    record.velocity_east = velocity_current_W.x;
+    record.velocity_north = velocity_current_W.y;
+    record.velocity_up = velocity_current_W.z;
+    gt_log_.Write(record);
+  }
 
-  last_time_ = current_time;
-}
+  // publish Groundtruth msg at gt_rate_, advancing by whole periods so the
+  // rate does not drift with the physics step; resync after a stall
+  if (gt_rate_ > 0.0 && (current_time - last_gt_time_).Double() >= 1.0 / gt_rate_) {
+    const common::Time period(1.0 / gt_rate_);
+    last_gt_time_ += period;
+    if (current_time - last_gt_time_ >= period) {
+      last_gt_time_ = current_time;
+    }
 
-std::pair<double, double> GpsPlugin::reproject(math::Vector3& pos)
-{
-  // reproject local position to gps coordinates
-  double x_rad = pos.y / earth_radius;    // north
-  double y_rad = pos.x / earth_radius;    // east
-  double c = sqrt(x_rad * x_rad + y_rad * y_rad);
-  double sin_c = sin(c);
-  double cos_c = cos(c);
-  double lat_rad, lon_rad;
-
-  if (c != 0.0) {
-    lat_rad = asin(cos_c * sin(lat_home) + (x_rad * sin_c * cos(lat_home)) / c);
-    lon_rad = (lon_home + atan2(y_rad * sin_c, c * cos(lat_home) * cos_c - x_rad * sin(lat_home) * sin_c));
-  } else {
-    lat_rad = lat_home;
-    lon_rad = lon_home;
+    groundtruth_msg.set_time(current_time.Double());
+    groundtruth_msg.set_latitude_rad(lla_gt[0]);
+    groundtruth_msg.set_longitude_rad(lla_gt[1]);
+    groundtruth_msg.set_altitude(lla_gt[2]);
+    groundtruth_msg.set_velocity_east(velocity_current_W.x);
+    groundtruth_msg.set_velocity_north(velocity_current_W.y);
+    groundtruth_msg.set_velocity_up(velocity_current_W.z);
+    gt_pub_->Publish(groundtruth_msg);
   }
 
-  return std::make_pair (lat_rad, lon_rad);
+  last_time_ = current_time;
 }
 }
@@ -93,6 +93,14 @@ void GazeboImuPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   getSdfParam<double>(_sdf, "accelerometerTurnOnBiasSigma",
                       imu_parameters_.accelerometer_turn_on_bias_sigma,
                       imu_parameters_.accelerometer_turn_on_bias_sigma);
+  // 0 publishes every physics step, otherwise samples are integrated and
+  // published as the average over each output interval
+  getSdfParam<double>(_sdf, "outputRate", output_rate_, 0.0);
+  getSdfParam<int>(_sdf, "instances", instances_, 1);
+  if (instances_ < 1 || instances_ > kMaxImuInstances) {
+    gzerr << "[gazebo_imu_plugin] instances must be between 1 and " << kMaxImuInstances << ", using 1.\n";
+    instances_ = 1;
+  }
 
   last_time_ = world_->GetSimTime();
 
@@ -102,7 +110,12 @@ void GazeboImuPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
       event::Events::ConnectWorldUpdateBegin(
           boost::bind(&GazeboImuPlugin::OnUpdate, this, _1));
 
-  imu_pub_ = node_handle_->Advertise<sensor_msgs::msgs::Imu>("~/" + model_->GetName() + imu_topic_, 1);
+  // the first instance keeps the plain topic, the others get their index appended
+  for (int k = 0; k < instances_; ++k) {
+    const std::string topic = "~/" + model_->GetName() + imu_topic_ + (k > 0 ? std::to_string(k) : "");
+    imu_pub_[k] = node_handle_->Advertise<sensor_msgs::msgs::Imu>(topic, 1);
+    imu_bus_[k] = SensorBus::Instance().Imu(topic);
+  }
 
   // Fill imu message.
   // imu_message_.header.frame_id = frame_id_; TODO Add header
@@ -164,76 +177,78 @@ void GazeboImuPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   gravity_W_ = world_->GetPhysicsEngine()->GetGravity();
   imu_parameters_.gravity_magnitude = gravity_W_.GetLength();
 
-  standard_normal_distribution_ = std::normal_distribution<double>(0.0, 1.0);
+  // one stream per IMU link, reproducible for a given gazebo --seed
+  noise_.Seed(math::Rand::GetSeed(), model_->GetName(), "imu/" + link_name_);
 
   double sigma_bon_g = imu_parameters_.gyroscope_turn_on_bias_sigma;
   double sigma_bon_a = imu_parameters_.accelerometer_turn_on_bias_sigma;
-  for (int i = 0; i < 3; ++i) {
-      gyroscope_turn_on_bias_[i] =
-          sigma_bon_g * standard_normal_distribution_(random_generator_);
-      accelerometer_turn_on_bias_[i] =
-          sigma_bon_a * standard_normal_distribution_(random_generator_);
+  turn_on_bias_.setZero();
+  for (int k = 0; k < instances_; ++k) {
+    for (int i = 0; i < 3; ++i) {
+        turn_on_bias_(i, k) =
+            sigma_bon_g * noise_.Normal();
+        turn_on_bias_(3 + i, k) =
+            sigma_bon_a * noise_.Normal();
+    }
   }
 
   // TODO(nikolicj) incorporate steady-state covariance of bias process
-  gyroscope_bias_.setZero();
-  accelerometer_bias_.setZero();
+  bias_.setZero();
+}
+
+/// \brief Discretize the continuous noise model for steps of dt. The step is
+///        fixed by the physics max_step_size, so this normally runs once.
+void GazeboImuPlugin::updateDiscretization(const double dt) {
+  const double density[2] = {imu_parameters_.gyroscope_noise_density,
+                             imu_parameters_.accelerometer_noise_density};
+  const double random_walk[2] = {imu_parameters_.gyroscope_random_walk,
+                                 imu_parameters_.accelerometer_random_walk};
+  const double tau[2] = {imu_parameters_.gyroscope_bias_correlation_time,
+                         imu_parameters_.accelerometer_bias_correlation_time};
+
+  for (int s = 0; s < 2; ++s) {
+    // Discrete-time standard deviation equivalent to an "integrating" sampler
+    // with integration time dt.
+    const double sigma_d = 1 / sqrt(dt) * density[s];
+    // Compute exact covariance of the process after dt [Maybeck 4-114].
+    const double sigma_b_d =
+        sqrt( - random_walk[s] * random_walk[s] * tau[s] / 2.0 *
+        (exp(-2.0 * dt / tau[s]) - 1.0));
+    // Compute state-transition.
+    const double phi_d = exp(-1.0 / tau[s] * dt);
+
+    discretization_.sigma_white.segment<3>(3 * s).setConstant(sigma_d);
+    discretization_.sigma_bias.segment<3>(3 * s).setConstant(sigma_b_d);
+    discretization_.phi_bias.segment<3>(3 * s).setConstant(phi_d);
+  }
+  discretization_.dt = dt;
 }
 
 /// \brief This function adds noise to acceleration and angular rates for
-///        accelerometer and gyroscope measurement simulation.
-void GazeboImuPlugin::addNoise(Eigen::Vector3d* linear_acceleration,
-                               Eigen::Vector3d* angular_velocity,
+///        accelerometer and gyroscope measurement simulation, for all
+///        instances at once.
+void GazeboImuPlugin::addNoise(ImuChannels* measurements,
                                const double dt) {
-  // CHECK(linear_acceleration);
-  // CHECK(angular_velocity);
   assert(dt > 0.0);
 
-  // Gyrosocpe
-  double tau_g = imu_parameters_.gyroscope_bias_correlation_time;
-  // Discrete-time standard deviation equivalent to an "integrating" sampler
-  // with integration time dt.
-  double sigma_g_d = 1 / sqrt(dt) * imu_parameters_.gyroscope_noise_density;
-  double sigma_b_g = imu_parameters_.gyroscope_random_walk;
-  // Compute exact covariance of the process after dt [Maybeck 4-114].
-  double sigma_b_g_d =
-      sqrt( - sigma_b_g * sigma_b_g * tau_g / 2.0 *
-      (exp(-2.0 * dt / tau_g) - 1.0));
-  // Compute state-transition.
-  double phi_g_d = exp(-1.0 / tau_g * dt);
-  // Simulate gyroscope noise processes and add them to the true angular rate.
-  for (int i = 0; i < 3; ++i) {
-    gyroscope_bias_[i] = phi_g_d * gyroscope_bias_[i] +
-        sigma_b_g_d * standard_normal_distribution_(random_generator_);
-    (*angular_velocity)[i] = (*angular_velocity)[i] +
-        gyroscope_bias_[i] +
-        sigma_g_d * standard_normal_distribution_(random_generator_) +
-        gyroscope_turn_on_bias_[i];
-  }
-
-  // Accelerometer
-  double tau_a = imu_parameters_.accelerometer_bias_correlation_time;
-  // Discrete-time standard deviation equivalent to an "integrating" sampler
-  // with integration time dt.
-  double sigma_a_d = 1 / sqrt(dt) * imu_parameters_.accelerometer_noise_density;
-  double sigma_b_a = imu_parameters_.accelerometer_random_walk;
-  // Compute exact covariance of the process after dt [Maybeck 4-114].
-  double sigma_b_a_d =
-      sqrt( - sigma_b_a * sigma_b_a * tau_a / 2.0 *
-      (exp(-2.0 * dt / tau_a) - 1.0));
-  // Compute state-transition.
-  double phi_a_d = exp(-1.0 / tau_a * dt);
-  // Simulate accelerometer noise processes and add them to the true linear
-  // acceleration.
-  for (int i = 0; i < 3; ++i) {
-    accelerometer_bias_[i] = phi_a_d * accelerometer_bias_[i] +
-        sigma_b_a_d * standard_normal_distribution_(random_generator_);
-    (*linear_acceleration)[i] = (*linear_acceleration)[i] +
-        accelerometer_bias_[i] +
-        sigma_a_d * standard_normal_distribution_(random_generator_) +
-        accelerometer_turn_on_bias_[i];
+  if (dt != discretization_.dt) {
+    updateDiscretization(dt);
   }
-
+  const ImuNoiseDiscretization& d = discretization_;
+
+  const int n = instances_;
+  noise_.Normals(bias_noise_.data(), 6 * n);
+  noise_.Normals(white_noise_.data(), 6 * n);
+
+  // Propagate the bias processes and add them, the turn on bias and white
+  // noise to the true rates and specific forces.
+  bias_.leftCols(n).array() =
+      bias_.leftCols(n).array().colwise() * d.phi_bias.array() +
+      bias_noise_.leftCols(n).array().colwise() * d.sigma_bias.array();
+  measurements->leftCols(n).array() +=
+      bias_.leftCols(n).array() +
+      white_noise_.leftCols(n).array().colwise() * d.sigma_white.array() +
+      turn_on_bias_.leftCols(n).array();
 }
 
 // This gets called by the world update start event.
@@ -246,8 +261,8 @@ void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
   math::Pose T_W_I = link_->GetWorldPose(); //TODO(burrimi): Check tf.
   math::Quaternion C_W_I = T_W_I.rot;
 
-  // Copy math::Quaternion to gazebo::msgs::Quaternion
-  gazebo::msgs::Quaternion* orientation = new gazebo::msgs::Quaternion();
+  // Copy math::Quaternion to gazebo::msgs::Quaternion, in place
+  gazebo::msgs::Quaternion* orientation = imu_message_.mutable_orientation();
   orientation->set_x(C_W_I.x);
   orientation->set_y(C_W_I.y);
   orientation->set_z(C_W_I.z);
@@ -276,26 +291,30 @@ void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
 
   math::Vector3 angular_vel_I = link_->GetRelativeAngularVel();
 
-  Eigen::Vector3d linear_acceleration_I(acceleration_I.x,
-                                        acceleration_I.y,
-                                        acceleration_I.z);
-  Eigen::Vector3d angular_velocity_I(angular_vel_I.x,
-                                     angular_vel_I.y,
-                                     angular_vel_I.z);
-
-  addNoise(&linear_acceleration_I, &angular_velocity_I, dt);
+  // all instances sit on the same link and see the same true motion
+  ImuChannels measurements;
+  for (int k = 0; k < instances_; ++k) {
+    measurements.col(k) << angular_vel_I.x, angular_vel_I.y, angular_vel_I.z,
+                           acceleration_I.x, acceleration_I.y, acceleration_I.z;
+  }
 
-  // Copy Eigen::Vector3d to gazebo::msgs::Vector3d
-  gazebo::msgs::Vector3d* linear_acceleration = new gazebo::msgs::Vector3d();
-  linear_acceleration->set_x(linear_acceleration_I[0]);
-  linear_acceleration->set_y(linear_acceleration_I[1]);
-  linear_acceleration->set_z(linear_acceleration_I[2]);
+  addNoise(&measurements, dt);
 
-  // Copy Eigen::Vector3d to gazebo::msgs::Vector3d
-  gazebo::msgs::Vector3d* angular_velocity = new gazebo::msgs::Vector3d();
-  angular_velocity->set_x(angular_velocity_I[0]);
-  angular_velocity->set_y(angular_velocity_I[1]);
-  angular_velocity->set_z(angular_velocity_I[2]);
+  if (output_rate_ > 0.0) {
+    for (int k = 0; k < instances_; ++k) {
+      preintegrator_[k].Add(measurements.col(k).head<3>(), measurements.col(k).tail<3>(), dt);
+    }
+    const double interval = preintegrator_[0].IntegratedTime();
+    if (interval < 1.0 / output_rate_ - 1e-9) {
+      return;
+    }
+    // mean rates over the interval, as read from an IMU FIFO
+    for (int k = 0; k < instances_; ++k) {
+      measurements.col(k).head<3>() = preintegrator_[k].DeltaAngle() / interval;
+      measurements.col(k).tail<3>() = preintegrator_[k].DeltaVelocity() / interval;
+      preintegrator_[k].Reset();
+    }
+  }
 
   // Fill IMU message.
   // ADD HEaders
@@ -307,13 +326,26 @@ void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
   // imu_message_.orientation.x = 0;
   // imu_message_.orientation.y = 0;
   // imu_message_.orientation.z = 0;
-  
-  imu_message_.set_allocated_orientation(orientation);
-  imu_message_.set_allocated_linear_acceleration(linear_acceleration);
-  imu_message_.set_allocated_angular_velocity(angular_velocity);
 
-  // gzerr << "publishing: " << imu_message_.linear_acceleration().z() << "\n";
-  imu_pub_->Publish(imu_message_);
+  ImuSample sample;
+  sample.orientation[0] = C_W_I.w;
+  sample.orientation[1] = C_W_I.x;
+  sample.orientation[2] = C_W_I.y;
+  sample.orientation[3] = C_W_I.z;
+
+  for (int k = 0; k < instances_; ++k) {
+    setVector3d(imu_message_.mutable_linear_acceleration(), measurements.col(k).tail<3>());
+    setVector3d(imu_message_.mutable_angular_velocity(), measurements.col(k).head<3>());
+
+    imu_pub_[k]->Publish(imu_message_);
+
+    // same sample to an in-process consumer, if one attached
+    for (int i = 0; i < 3; ++i) {
+      sample.angular_velocity[i] = measurements(i, k);
+      sample.linear_acceleration[i] = measurements(3 + i, k);
+    }
+    imu_bus_[k]->Publish(sample);
+  }
 }
 
 
@@ -24,8 +24,53 @@
 namespace gazebo {
 GZ_REGISTER_MODEL_PLUGIN(GazeboMavlinkInterface);
 
+// Message ids handle_message() consumes, everything else is only forwarded
+static bool is_handled_message(uint32_t msgid)
+{
+  return msgid == MAVLINK_MSG_ID_HIL_ACTUATOR_CONTROLS;
+}
+
+static const struct {
+  const char *name;
+  JointControlType type;
+} kJointControlTypes[] = {
+  {"velocity", kJointControlVelocity},
+  {"position", kJointControlPosition},
+  {"position_gztopic", kJointControlPositionGztopic},
+  {"position_kinematic", kJointControlPositionKinematic},
+};
+
 GazeboMavlinkInterface::~GazeboMavlinkInterface() {
+  if (mavlink_io_thread_.joinable()) {
+    mavlink_io_running_ = false;
+    const uint8_t wake = 1;
+    ssize_t ret = ::write(io_wake_pipe_[1], &wake, 1);
+    (void)ret;
+    mavlink_io_thread_.join();
+
+    gzdbg << "[gazebo_mavlink_interface] MAVLink I/O thread: tx ring high water "
+          << tx_ring_.high_water() << "/" << tx_ring_.capacity() << ", " << tx_ring_dropped_
+          << " dropped; rx ring high water " << rx_ring_.high_water() << "/" << rx_ring_.capacity()
+          << ", " << rx_ring_dropped_ << " dropped.\n";
+  }
+  for (int fd : io_wake_pipe_) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  MavlinkReactor::Instance().Unregister(_fd);
   event::Events::DisconnectWorldUpdateBegin(updateConnection_);
+  if (updateEndConnection_) {
+    event::Events::DisconnectWorldUpdateEnd(updateEndConnection_);
+  }
+  if (sensorBusConnection_) {
+    event::Events::DisconnectWorldUpdateEnd(sensorBusConnection_);
+    imu_bus_->attached = false;
+    gps_bus_->attached = false;
+    vision_bus_->attached = false;
+    battery_bus_->attached = false;
+  }
 }
 
 void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
@@ -33,6 +78,10 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
   model_ = _model;
 
   world_ = model_->GetWorld();
+  // same home as the GPS plugin
+  home_frame_ = HomeFrameFromEnvironment();
+
+  noise_.Seed(math::Rand::GetSeed(), model_->GetName(), "mavlink_interface");
 
   const char *env_alt = std::getenv("PX4_HOME_ALT");
   if (env_alt) {
@@ -59,18 +108,19 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
       opticalFlow_sub_topic_, opticalFlow_sub_topic_);
   getSdfParam<std::string>(_sdf, "sonarSubTopic", sonar_sub_topic_, sonar_sub_topic_);
   getSdfParam<std::string>(_sdf, "irlockSubTopic", irlock_sub_topic_, irlock_sub_topic_);
-  groundtruth_sub_topic_ = "/groundtruth";
+  getSdfParam<std::string>(_sdf, "batterySubTopic", battery_sub_topic_, battery_sub_topic_);
 
   // set input_reference_ from inputs.control
   input_reference_.resize(n_out_max);
   joints_.resize(n_out_max);
-  pids_.resize(n_out_max);
   for (int i = 0; i < n_out_max; ++i)
   {
-    pids_[i].Init(0, 0, 0, 0, 0, 0, 0);
     input_reference_[i] = 0;
   }
 
+  // p, i, d, iMax, iMin, cmdMax, cmdMin of every channel
+  double pid_gains[n_out_max][7] = {};
+
   if (_sdf->HasElement("control_channels")) {
     sdf::ElementPtr control_channels = _sdf->GetElement("control_channels");
     sdf::ElementPtr channel = control_channels->GetElement("channel");
@@ -87,18 +137,28 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
           zero_position_armed_[index] = channel->Get<double>("zero_position_armed");
           if (channel->HasElement("joint_control_type"))
           {
-            joint_control_type_[index] = channel->Get<std::string>("joint_control_type");
+            const std::string type = channel->Get<std::string>("joint_control_type");
+            joint_control_type_[index] = kJointControlNone;
+            for (const auto &entry : kJointControlTypes) {
+              if (type == entry.name) {
+                joint_control_type_[index] = entry.type;
+              }
+            }
+            if (joint_control_type_[index] == kJointControlNone) {
+              gzerr << "joint_control_type[" << type << "] undefined, no joint control for channel["
+                    << index << "].\n";
+            }
           }
           else
           {
             gzwarn << "joint_control_type[" << index << "] not specified, using velocity.\n";
-            joint_control_type_[index] = "velocity";
+            joint_control_type_[index] = kJointControlVelocity;
           }
 
-          // start gz transport node handle
-          if (joint_control_type_[index] == "position_gztopic")
+          // the target goes out on its own gztopic, and on
+          // ~/<model>/joint_command under the same name
+          if (joint_control_type_[index] == kJointControlPositionGztopic)
           {
-            // setup publisher handle to topic
             if (channel->HasElement("gztopic"))
               gztopic_[index] = "~/" + model_->GetName() + channel->Get<std::string>("gztopic");
             else
@@ -138,28 +198,11 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
           if (channel->HasElement("joint_control_pid"))
           {
             sdf::ElementPtr pid = channel->GetElement("joint_control_pid");
-            double p = 0;
-            if (pid->HasElement("p"))
-              p = pid->Get<double>("p");
-            double i = 0;
-            if (pid->HasElement("i"))
-              i = pid->Get<double>("i");
-            double d = 0;
-            if (pid->HasElement("d"))
-              d = pid->Get<double>("d");
-            double iMax = 0;
-            if (pid->HasElement("iMax"))
-              iMax = pid->Get<double>("iMax");
-            double iMin = 0;
-            if (pid->HasElement("iMin"))
-              iMin = pid->Get<double>("iMin");
-            double cmdMax = 0;
-            if (pid->HasElement("cmdMax"))
-              cmdMax = pid->Get<double>("cmdMax");
-            double cmdMin = 0;
-            if (pid->HasElement("cmdMin"))
-              cmdMin = pid->Get<double>("cmdMin");
-            pids_[index].Init(p, i, d, iMax, iMin, cmdMax, cmdMin);
+            static const char *gain_names[7] = {"p", "i", "d", "iMax", "iMin", "cmdMax", "cmdMin"};
+            for (int g = 0; g < 7; ++g) {
+              if (pid->HasElement(gain_names[g]))
+                pid_gains[index][g] = pid->Get<double>(gain_names[g]);
+            }
           }
         }
         else
@@ -176,20 +219,78 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     }
   }
 
+  // compile the channel table, channels without a joint are never touched
+  pid_bank_.Clear();
+  gztopic_channels_.clear();
+  kinematic_channels_.clear();
+  joint_command_msg_.Clear();
+  for (int i = 0; i < n_out_max; ++i)
+  {
+    if (!joints_[i]) {
+      continue;
+    }
+    switch (joint_control_type_[i]) {
+      case kJointControlVelocity:
+      case kJointControlPosition: {
+        const double *g = pid_gains[i];
+        pid_channel_[pid_bank_.Add(g[0], g[1], g[2], g[3], g[4], g[5], g[6])] = i;
+        break;
+      }
+      case kJointControlPositionGztopic:
+        gztopic_channels_.push_back(i);
+        joint_command_msg_.add_channel(i);
+        joint_command_msg_.add_position(0.0);
+        joint_command_msg_.add_topic(gztopic_[i]);
+        break;
+      case kJointControlPositionKinematic:
+        kinematic_channels_.push_back(i);
+        break;
+      default:
+        break;
+    }
+  }
+  if (!gztopic_channels_.empty()) {
+    joint_command_pub_ = node_handle_->Advertise<joint_msgs::msgs::JointCommand>(
+        "~/" + model_->GetName() + "/joint_command", 1);
+  }
+
   // Listen to the update event. This event is broadcast every
   // simulation iteration.
   updateConnection_ = event::Events::ConnectWorldUpdateBegin(
       boost::bind(&GazeboMavlinkInterface::OnUpdate, this, _1));
 
+  if(_sdf->HasElement("sensor_bus"))
+  {
+    use_sensor_bus_ = _sdf->GetElement("sensor_bus")->Get<bool>();
+  }
+
   // Subscriber to IMU sensor_msgs::Imu Message and SITL message
-  imu_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + imu_sub_topic_, &GazeboMavlinkInterface::ImuCallback, this);
   lidar_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + lidar_sub_topic_, &GazeboMavlinkInterface::LidarCallback, this);
   opticalFlow_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + opticalFlow_sub_topic_, &GazeboMavlinkInterface::OpticalFlowCallback, this);
   sonar_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + sonar_sub_topic_, &GazeboMavlinkInterface::SonarCallback, this);
   irlock_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + irlock_sub_topic_, &GazeboMavlinkInterface::IRLockCallback, this);
-  gps_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + gps_sub_topic_, &GazeboMavlinkInterface::GpsCallback, this);
-  groundtruth_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + groundtruth_sub_topic_, &GazeboMavlinkInterface::GroundtruthCallback, this);
-  vision_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + vision_sub_topic_, &GazeboMavlinkInterface::VisionCallback, this);
+  if (use_sensor_bus_) {
+    // the model plugins run on the physics thread too, so their samples are
+    // picked up in the step that produced them. Lidar, sonar, IR lock and
+    // optical flow come from the sensor thread and stay on transport.
+    SensorBus& bus = SensorBus::Instance();
+    imu_bus_ = bus.Imu("~/" + model_->GetName() + imu_sub_topic_);
+    gps_bus_ = bus.Gps("~/" + model_->GetName() + gps_sub_topic_);
+    vision_bus_ = bus.Vision("~/" + model_->GetName() + vision_sub_topic_);
+    battery_bus_ = bus.Battery("~/" + model_->GetName() + battery_sub_topic_);
+    drainSensorBus();  // left over from a previous instance of this vehicle
+    imu_bus_->attached = true;
+    gps_bus_->attached = true;
+    vision_bus_->attached = true;
+    battery_bus_->attached = true;
+    sensorBusConnection_ = event::Events::ConnectWorldUpdateEnd(
+        boost::bind(&GazeboMavlinkInterface::drainSensorBus, this));
+  } else {
+    imu_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + imu_sub_topic_, &GazeboMavlinkInterface::ImuCallback, this);
+    gps_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + gps_sub_topic_, &GazeboMavlinkInterface::GpsCallback, this);
+    vision_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + vision_sub_topic_, &GazeboMavlinkInterface::VisionCallback, this);
+    battery_sub_ = node_handle_->Subscribe("~/" + model_->GetName() + battery_sub_topic_, &GazeboMavlinkInterface::BatteryCallback, this);
+  }
 
   // Publish gazebo's motor_speed message
   motor_velocity_reference_pub_ = node_handle_->Advertise<mav_msgs::msgs::CommandMotorSpeed>("~/" + model_->GetName() + motor_velocity_reference_pub_topic_, 1);
@@ -230,6 +331,112 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     serial_enabled_ = _sdf->GetElement("serialEnabled")->Get<bool>();
   }
 
+  if(_sdf->HasElement("enable_lockstep"))
+  {
+    enable_lockstep_ = _sdf->GetElement("enable_lockstep")->Get<bool>();
+  }
+
+  if(_sdf->HasElement("lockstep_timeout_ms"))
+  {
+    lockstep_timeout_ms_ = _sdf->GetElement("lockstep_timeout_ms")->Get<int>();
+  }
+
+  if(_sdf->HasElement("max_rx_datagrams_per_step"))
+  {
+    max_rx_datagrams_per_step_ = std::max(1, _sdf->GetElement("max_rx_datagrams_per_step")->Get<int>());
+  }
+
+  if(_sdf->HasElement("udp_send_batching"))
+  {
+    udp_send_batching_ = _sdf->GetElement("udp_send_batching")->Get<bool>();
+  }
+
+  if(_sdf->HasElement("mavlink_io_thread"))
+  {
+    mavlink_io_thread_enabled_ = _sdf->GetElement("mavlink_io_thread")->Get<bool>();
+  }
+
+  if(_sdf->HasElement("mavlink_protocol_version"))
+  {
+    mavlink_protocol_version_ = _sdf->GetElement("mavlink_protocol_version")->Get<int>();
+    if (mavlink_protocol_version_ != 1 && mavlink_protocol_version_ != 2) {
+      gzerr << "[gazebo_mavlink_interface] Unsupported mavlink_protocol_version "
+            << mavlink_protocol_version_ << ", using " << kDefaultMavlinkProtocolVersion << ".\n";
+      mavlink_protocol_version_ = kDefaultMavlinkProtocolVersion;
+    }
+  }
+
+  // Per stream output rates in Hz, 0 disables a stream. Optical flow is not
+  // listed: its integrals would be lost with every skipped message.
+  if (_sdf->HasElement("output_rates")) {
+    sdf::ElementPtr rates = _sdf->GetElement("output_rates");
+    for (int i = 0; i < MavlinkRateScheduler::kNumStreams; ++i) {
+      if (rates->HasElement(MavlinkRateScheduler::Name(i))) {
+        output_rates_.Configure(i, rates->Get<double>(MavlinkRateScheduler::Name(i)));
+      }
+    }
+  }
+
+  if(_sdf->HasElement("mavlink_stats_interval"))
+  {
+    mavlink_stats_interval_ = _sdf->GetElement("mavlink_stats_interval")->Get<double>();
+  }
+
+  if(_sdf->HasElement("latency_report_interval"))
+  {
+    latency_report_interval_ = _sdf->GetElement("latency_report_interval")->Get<double>();
+  }
+  if (latency_report_interval_ > 0) {
+    latency_pub_ = node_handle_->Advertise<hil_msgs::msgs::HilLatency>("~/" + model_->GetName() + "/hil_latency", 1);
+
+    if(_sdf->HasElement("latency_csv"))
+    {
+      const std::string path = _sdf->GetElement("latency_csv")->Get<std::string>();
+      latency_csv_.open(path.c_str(), std::ios::out | std::ios::trunc);
+      if (latency_csv_.is_open()) {
+        latency_csv_ << "vehicle,time,samples,unmatched,unanswered,"
+                        "wall_p50_us,wall_p99_us,wall_max_us,sim_p50_us,sim_p99_us,sim_max_us\n";
+      } else {
+        gzerr << "[gazebo_mavlink_interface] Cannot open latency csv " << path << ", publishing only.\n";
+      }
+    }
+  }
+
+  if(_sdf->HasElement("transport"))
+  {
+    std::string transport = _sdf->GetElement("transport")->Get<std::string>();
+    if (transport == "shm") {
+      use_shm_transport_ = true;
+    } else if (transport != "udp") {
+      gzerr << "[gazebo_mavlink_interface] Unknown transport \"" << transport << "\", using udp.\n";
+    }
+  }
+
+  if (use_shm_transport_ && serial_enabled_) {
+    gzwarn << "[gazebo_mavlink_interface] The shm transport replaces the UDP link to SITL, not the serial link, disabling it.\n";
+    use_shm_transport_ = false;
+  }
+
+  if (use_shm_transport_ && mavlink_io_thread_enabled_) {
+    // the shm path makes no syscalls unless the peer sleeps, there is nothing to offload
+    gzwarn << "[gazebo_mavlink_interface] The MAVLink I/O thread is not used with the shm transport.\n";
+    mavlink_io_thread_enabled_ = false;
+  }
+
+  if (mavlink_io_thread_enabled_ && serial_enabled_) {
+    gzwarn << "[gazebo_mavlink_interface] The MAVLink I/O thread is only supported on the UDP link, disabling it.\n";
+    mavlink_io_thread_enabled_ = false;
+  }
+
+  if (enable_lockstep_ && serial_enabled_) {
+    gzwarn << "[gazebo_mavlink_interface] Lockstep is only supported on the UDP link, disabling it.\n";
+    enable_lockstep_ = false;
+  }
+
+  if (enable_lockstep_) {
+    gzmsg << "[gazebo_mavlink_interface] Lockstep enabled, stall timeout " << lockstep_timeout_ms_ << " ms.\n";
+  }
+
   if(serial_enabled_) {
     // Set up serial interface
     if(_sdf->HasElement("serialDevice"))
@@ -240,6 +447,12 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     if (_sdf->HasElement("baudRate")) {
       baudrate_ = _sdf->GetElement("baudRate")->Get<int>();
     }
+
+    for (size_t i = 0; i < kSerialTxSlots; ++i) {
+      serial_tx_free_[i] = kSerialTxSlots - 1 - i;
+    }
+    serial_tx_free_count_ = kSerialTxSlots;
+    serial_tx_gather_.reserve(kSerialTxSlots);
     io_service.post(std::bind(&GazeboMavlinkInterface::do_read, this));
 
     // run io_service for async io
@@ -281,17 +494,41 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     qgc_udp_port_ = _sdf->GetElement("qgc_udp_port")->Get<int>();
   }
 
+  if(_sdf->HasElement("vehicle_is_tailsitter"))
+  {
+    vehicle_is_tailsitter_ = _sdf->GetElement("vehicle_is_tailsitter")->Get<bool>();
+  }
+
+  // COMM_0 is shared by every vehicle in gzserver, the wire format is set
+  // on this instance's own status, see send_mavlink_message()
+  if (mavlink_protocol_version_ == 1) {
+    tx_status_.flags |= MAVLINK_STATUS_FLAG_OUT_MAVLINK1;
+  } else {
+    tx_status_.flags &= ~MAVLINK_STATUS_FLAG_OUT_MAVLINK1;
+    gzmsg << "[gazebo_mavlink_interface] Sending MAVLink 2 frames.\n";
+  }
+
+  tx_stats_start_ = std::chrono::steady_clock::now();
+
+  if (use_shm_transport_) {
+    // one segment per vehicle, keyed like the UDP port the autopilot would use
+    shm_name_ = "/sitl_gazebo_mavlink_" + std::to_string(mavlink_udp_port_);
+    getSdfParam<std::string>(_sdf, "shm_name", shm_name_, shm_name_);
+
+    if (!shm_transport_.Create(shm_name_)) {
+      gzerr << "[gazebo_mavlink_interface] Failed to create shared memory transport " << shm_name_ << ".\n";
+      return;
+    }
+    gzmsg << "[gazebo_mavlink_interface] MAVLink over shared memory " << shm_name_ << ".\n";
+    return;
+  }
+
   // try to setup udp socket for communcation
   if ((_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
     printf("create socket failed\n");
     return;
   }
 
-  if(_sdf->HasElement("vehicle_is_tailsitter"))
-  {
-    vehicle_is_tailsitter_ = _sdf->GetElement("vehicle_is_tailsitter")->Get<bool>();
-  }
-
   memset((char *)&_myaddr, 0, sizeof(_myaddr));
   _myaddr.sin_family = AF_INET;
   _srcaddr.sin_family = AF_INET;
@@ -319,11 +556,53 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     return;
   }
 
-  fds[0].fd = _fd;
-  fds[0].events = POLLIN;
+  // the reactor owns readiness for every vehicle's socket in this gzserver,
+  // unless this vehicle has a socket thread of its own
+  if (!mavlink_io_thread_enabled_ && !MavlinkReactor::Instance().Register(_fd,
+      std::bind(&GazeboMavlinkInterface::onMAVLinkSocketReadable, this))) {
+    gzerr << "[gazebo_mavlink_interface] Failed to register MAVLink socket with the reactor.\n";
+  }
+
+  if (udp_send_batching_ && !mavlink_io_thread_enabled_) {
+    updateEndConnection_ = event::Events::ConnectWorldUpdateEnd(
+        boost::bind(&GazeboMavlinkInterface::OnUpdateEnd, this));
+  }
+
+#if defined(__linux__)
+  // the send batch works the same way, filled during the step and flushed at its end
+  memset(tx_msgs_, 0, sizeof(tx_msgs_));
+  for (unsigned i = 0; i < kTxBatchSize; ++i) {
+    tx_iovecs_[i].iov_base = tx_bufs_[i];
+    tx_msgs_[i].msg_hdr.msg_iov = &tx_iovecs_[i];
+    tx_msgs_[i].msg_hdr.msg_iovlen = 1;
+    tx_msgs_[i].msg_hdr.msg_name = &tx_addrs_[i];
+    tx_msgs_[i].msg_hdr.msg_namelen = sizeof(tx_addrs_[i]);
+  }
+
+  // the receive batch points into preallocated buffers, only lengths change per call
+  memset(rx_msgs_, 0, sizeof(rx_msgs_));
+  for (unsigned i = 0; i < kRxBatchSize; ++i) {
+    rx_iovecs_[i].iov_base = rx_bufs_[i];
+    rx_iovecs_[i].iov_len = kRxDatagramSize;
+    rx_msgs_[i].msg_hdr.msg_iov = &rx_iovecs_[i];
+    rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+    rx_msgs_[i].msg_hdr.msg_name = &rx_addrs_[i];
+  }
+#endif
 
-  mavlink_status_t* chan_state = mavlink_get_channel_status(MAVLINK_COMM_0);
-  chan_state->flags |= MAVLINK_STATUS_FLAG_OUT_MAVLINK1;
+  if (mavlink_io_thread_enabled_) {
+    // the pipe only wakes the I/O thread early when frames are queued
+    if (pipe(io_wake_pipe_) < 0) {
+      gzerr << "[gazebo_mavlink_interface] Failed to create I/O thread wake pipe: " << strerror(errno) << "\n";
+      return;
+    }
+    fcntl(io_wake_pipe_[0], F_SETFL, O_NONBLOCK);
+    fcntl(io_wake_pipe_[1], F_SETFL, O_NONBLOCK);
+
+    mavlink_io_running_ = true;
+    mavlink_io_thread_ = std::thread(&GazeboMavlinkInterface::MavlinkIoThread, this);
+    gzmsg << "[gazebo_mavlink_interface] MAVLink socket I/O runs on a dedicated thread.\n";
+  }
 }
 
 // This gets called by the world update start event.
@@ -331,32 +610,67 @@ void GazeboMavlinkInterface::OnUpdate(const common::UpdateInfo&  /*_info*/) {
   common::Time current_time = world_->GetSimTime();
   double dt = (current_time - last_time_).Double();
 
-  pollForMAVLinkMessages(dt, 1000);
+  // whatever the plugins updated after us last step, before we wait on the autopilot
+  if (use_sensor_bus_) {
+    drainSensorBus();
+  }
+
+  if (use_shm_transport_) {
+    pollShmTransport(enable_lockstep_ ? lockstep_timeout_ms_ : 0);
+  } else if (mavlink_io_thread_enabled_) {
+    // the socket belongs to the I/O thread, we only pick up decoded commands
+    pollActuatorControlsRing(enable_lockstep_ ? lockstep_timeout_ms_ : 0);
+  } else {
+    // Frames produced after the last WorldUpdateEnd must be out before we wait on the answer.
+    if (udp_send_batching_) {
+      flushMAVLinkTxBatch();
+    }
+
+    // Without lockstep the physics runs open-loop and only drains what is pending.
+    pollForMAVLinkMessages(dt, enable_lockstep_ ? lockstep_timeout_ms_ : 0);
+  }
+
+  if (mavlink_stats_interval_ > 0) {
+    reportTxStats();
+  }
+
+  if (latency_report_interval_ > 0) {
+    reportLatency();
+  }
 
   handle_control(dt);
 
   if (received_first_referenc_) {
-    mav_msgs::msgs::CommandMotorSpeed turning_velocities_msg;
+    resizeRepeated(turning_velocities_msg_.mutable_motor_speed(), input_reference_.size());
+    const bool stale = last_actuator_time_ == 0 || (current_time - last_actuator_time_).Double() > 0.2;
 
     for (int i = 0; i < input_reference_.size(); i++) {
-      if (last_actuator_time_ == 0 || (current_time - last_actuator_time_).Double() > 0.2) {
-        turning_velocities_msg.add_motor_speed(0);
-      } else {
-        turning_velocities_msg.add_motor_speed(input_reference_[i]);
-      }
+      turning_velocities_msg_.set_motor_speed(i, stale ? 0 : input_reference_[i]);
     }
     // TODO Add timestamp and Header
     // turning_velocities_msg->header.stamp.sec = current_time.sec;
     // turning_velocities_msg->header.stamp.nsec = current_time.nsec;
 
-    motor_velocity_reference_pub_->Publish(turning_velocities_msg);
+    motor_velocity_reference_pub_->Publish(turning_velocities_msg_);
   }
 
   last_time_ = current_time;
 }
 
-void GazeboMavlinkInterface::send_mavlink_message(const mavlink_message_t *message, const int destination_port)
+void GazeboMavlinkInterface::send_mavlink_message(mavlink_message_t *message, const int destination_port)
 {
+  // finalize again with this vehicle's protocol version and sequence, the
+  // payload is still whole in the message, only its length was trimmed
+  const mavlink_msg_entry_t *entry = mavlink_get_msg_entry(message->msgid);
+  if (entry) {
+    std::lock_guard<std::mutex> lock(tx_status_mutex_);
+    mavlink_finalize_message_buffer(message, message->sysid, message->compid, &tx_status_,
+        entry->min_len, entry->max_len, entry->crc_extra);
+  }
+
+  if (mavlink_stats_interval_ > 0) {
+    countTxFrame(message->msgid, mavlink_msg_get_send_buffer_length(message));
+  }
 
   if(serial_enabled_ && destination_port == 0) {
     assert(message != nullptr);
@@ -367,15 +681,63 @@ void GazeboMavlinkInterface::send_mavlink_message(const mavlink_message_t *messa
 
     {
       lock_guard lock(mutex);
-
-      if (tx_q.size() >= MAX_TXQ_SIZE) {
-//         gzwarn << "TX queue overflow. \n";
+      SerialTxSlot *slot = serialTxAllocLocked(message->msgid);
+      if (!slot) {
+        return;
       }
-      tx_q.emplace_back(message);
+      slot->len = mavlink_msg_to_send_buffer(slot->data, message);
     }
     io_service.post(std::bind(&GazeboMavlinkInterface::do_write, this, true));
   }
 
+  else if (use_shm_transport_) {
+    uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
+    int packetlen = mavlink_msg_to_send_buffer(buffer, message);
+
+    bool queued;
+    {
+      // the sensor callbacks may run on different threads, the ring has one producer
+      std::lock_guard<std::mutex> lock(tx_ring_push_mutex_);
+      queued = shm_transport_.Send(buffer, packetlen);
+    }
+
+    if (!queued && shm_transport_.DroppedFrames() % 100 == 1) {
+      gzwarn << "[gazebo_mavlink_interface] Shared memory ring full, dropped "
+             << shm_transport_.DroppedFrames() << " frames.\n";
+    }
+  }
+
+  else if (mavlink_io_thread_enabled_) {
+    MavlinkTxFrame frame;
+    frame.msg = *message;
+    frame.destination_port = destination_port;
+
+    bool queued;
+    {
+      std::lock_guard<std::mutex> lock(tx_ring_push_mutex_);
+      queued = tx_ring_.push(frame);
+    }
+
+    if (!queued) {
+      if (tx_ring_dropped_++ % 100 == 0) {
+        gzwarn << "[gazebo_mavlink_interface] MAVLink tx ring full, dropped "
+               << tx_ring_dropped_ << " frames.\n";
+      }
+      return;
+    }
+    wakeMavlinkIoThread();
+  }
+
+  else if (udp_send_batching_) {
+    std::lock_guard<std::mutex> lock(tx_batch_mutex_);
+
+    // keep ordering: a full batch goes out before this frame is queued
+    if (tx_batch_count_ >= kTxBatchSize) {
+      flushMAVLinkTxBatchLocked();
+    }
+    queueMAVLinkTxFrameLocked(message, destination_port);
+  }
+
   else {
     uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
     int packetlen = mavlink_msg_to_send_buffer(buffer, message);
@@ -387,29 +749,290 @@ void GazeboMavlinkInterface::send_mavlink_message(const mavlink_message_t *messa
       dest_addr.sin_port = htons(destination_port);
     }
 
-    ssize_t len = sendto(_fd, buffer, packetlen, 0, (struct sockaddr *)&_srcaddr, sizeof(_srcaddr));
+    ssize_t len = sendto(_fd, buffer, packetlen, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+
+    if (len <= 0) {
+      printf("Failed sending mavlink message\n");
+    }
+  }
+
+}
+
+// Pass-through for the serial <-> GCS bridge: the frame goes out byte for
+// byte, it is never decoded and re-encoded. Serial mode only uses the
+// serial ring and the UDP batch or immediate paths.
+void GazeboMavlinkInterface::forward_mavlink_frame(const uint8_t *frame, size_t len, uint32_t msgid, const int destination_port)
+{
+  if (mavlink_stats_interval_ > 0) {
+    countTxFrame(msgid, len);
+  }
+
+  if(serial_enabled_ && destination_port == 0) {
+    if (!is_open()) {
+      return;
+    }
+
+    {
+      lock_guard lock(mutex);
+      SerialTxSlot *slot = serialTxAllocLocked(msgid);
+      if (!slot) {
+        return;
+      }
+      memcpy(slot->data, frame, len);
+      slot->len = len;
+    }
+    io_service.post(std::bind(&GazeboMavlinkInterface::do_write, this, true));
+  }
+
+  else if (udp_send_batching_) {
+    std::lock_guard<std::mutex> lock(tx_batch_mutex_);
+
+    if (tx_batch_count_ >= kTxBatchSize) {
+      flushMAVLinkTxBatchLocked();
+    }
+    queueMAVLinkTxBytesLocked(frame, len, destination_port);
+  }
+
+  else {
+    struct sockaddr_in dest_addr;
+    memcpy(&dest_addr, &_srcaddr, sizeof(_srcaddr));
+
+    if (destination_port != 0) {
+      dest_addr.sin_port = htons(destination_port);
+    }
+
+    if (sendto(_fd, frame, len, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) <= 0) {
+      printf("Failed sending mavlink message\n");
+    }
+  }
+}
+
+void GazeboMavlinkInterface::decode_mavlink_frame(mavlink_message_t *rx_msg, mavlink_status_t *rx_status,
+    const uint8_t *frame, size_t len)
+{
+  // a whole frame at a time, already CRC checked by the framer; whatever a
+  // bad frame left in the parser is dropped first
+  rx_status->parse_state = MAVLINK_PARSE_STATE_IDLE;
+  mavlink_message_t msg;
+  mavlink_status_t status;
+  for (size_t i = 0; i < len; ++i) {
+    if (mavlink_frame_char_buffer(rx_msg, rx_status, frame[i], &msg, &status) == MAVLINK_FRAMING_OK) {
+      handle_message(&msg);
+    }
+  }
+}
+
+void GazeboMavlinkInterface::countTxFrame(uint32_t msgid, size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+  TxMsgStats &stats = tx_stats_[msgid];
+  ++stats.msgs;
+  stats.bytes += bytes;
+}
+
+void GazeboMavlinkInterface::reportTxStats()
+{
+  // bandwidth is a property of the real link, so this runs on wall time
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed = std::chrono::duration<double>(now - tx_stats_start_).count();
+  if (elapsed < mavlink_stats_interval_) {
+    return;
+  }
+
+  std::map<uint32_t, TxMsgStats> stats;
+  {
+    std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+    stats.swap(tx_stats_);
+  }
+  tx_stats_start_ = now;
+
+  uint64_t total_bytes = 0;
+  std::stringstream ss;
+  for (const auto &entry : stats) {
+    total_bytes += entry.second.bytes;
+    ss << "  msgid " << entry.first << ": " << entry.second.msgs / elapsed << " msg/s, "
+       << entry.second.bytes / elapsed << " B/s\n";
+  }
+
+  gzmsg << "[gazebo_mavlink_interface] MAVLink " << mavlink_protocol_version_ << " output "
+        << total_bytes / elapsed << " B/s over " << elapsed << " s\n" << ss.str()
+        << "[gazebo_mavlink_interface] Achieved / configured output rates (sim time):\n"
+        << output_rates_.Report(world_->GetSimTime().Double());
+}
+
+void GazeboMavlinkInterface::reportLatency()
+{
+  const double now = world_->GetSimTime().Double();
+  if (now < latency_report_last_) {
+    // world reset
+    latency_report_last_ = now;
+  }
+  if (now - latency_report_last_ < latency_report_interval_) {
+    return;
+  }
+  latency_report_last_ = now;
+
+  const HilLatencyTracker::Summary s = latency_tracker_.Report();
+
+  hil_msgs::msgs::HilLatency msg;
+  msg.set_time(now);
+  msg.set_samples(s.samples);
+  msg.set_unmatched(s.unmatched);
+  msg.set_unanswered(s.unanswered);
+  msg.set_wall_p50_us(s.wall_p50_us);
+  msg.set_wall_p99_us(s.wall_p99_us);
+  msg.set_wall_max_us(s.wall_max_us);
+  msg.set_sim_p50_us(s.sim_p50_us);
+  msg.set_sim_p99_us(s.sim_p99_us);
+  msg.set_sim_max_us(s.sim_max_us);
+  latency_pub_->Publish(msg);
+
+  if (latency_csv_.is_open()) {
+    latency_csv_ << model_->GetName() << ',' << now << ',' << s.samples << ',' << s.unmatched << ','
+                 << s.unanswered << ',' << s.wall_p50_us << ',' << s.wall_p99_us << ',' << s.wall_max_us << ','
+                 << s.sim_p50_us << ',' << s.sim_p99_us << ',' << s.sim_max_us << '\n';
+    latency_csv_.flush();
+  }
+}
 
+void GazeboMavlinkInterface::OnUpdateEnd()
+{
+  flushMAVLinkTxBatch();
+}
+
+void GazeboMavlinkInterface::flushMAVLinkTxBatch()
+{
+  std::lock_guard<std::mutex> lock(tx_batch_mutex_);
+  flushMAVLinkTxBatchLocked();
+}
+
+void GazeboMavlinkInterface::queueMAVLinkTxFrameLocked(const mavlink_message_t *message, const int destination_port)
+{
+  const unsigned i = tx_batch_count_++;
+  memcpy(&tx_addrs_[i], &_srcaddr, sizeof(_srcaddr));
+  if (destination_port != 0) {
+    tx_addrs_[i].sin_port = htons(destination_port);
+  }
+#if defined(__linux__)
+  tx_iovecs_[i].iov_len = mavlink_msg_to_send_buffer(tx_bufs_[i], message);
+#else
+  tx_msgs_len_[i] = mavlink_msg_to_send_buffer(tx_bufs_[i], message);
+#endif
+}
+
+void GazeboMavlinkInterface::queueMAVLinkTxBytesLocked(const uint8_t *frame, size_t len, const int destination_port)
+{
+  const unsigned i = tx_batch_count_++;
+  memcpy(&tx_addrs_[i], &_srcaddr, sizeof(_srcaddr));
+  if (destination_port != 0) {
+    tx_addrs_[i].sin_port = htons(destination_port);
+  }
+  memcpy(tx_bufs_[i], frame, len);
+#if defined(__linux__)
+  tx_iovecs_[i].iov_len = len;
+#else
+  tx_msgs_len_[i] = len;
+#endif
+}
+
+void GazeboMavlinkInterface::flushMAVLinkTxBatchLocked()
+{
+  unsigned sent = 0;
+
+  while (sent < tx_batch_count_) {
+#if defined(__linux__)
+    int n = sendmmsg(_fd, &tx_msgs_[sent], tx_batch_count_ - sent, 0);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      // drop the frame that failed and keep the rest of the batch in order
+      printf("Failed sending mavlink message\n");
+      ++sent;
+      continue;
+    }
+    sent += n;
+#else
+    ssize_t len = sendto(_fd, tx_bufs_[sent], tx_msgs_len_[sent], 0,
+        (struct sockaddr *)&tx_addrs_[sent], sizeof(tx_addrs_[sent]));
     if (len <= 0) {
       printf("Failed sending mavlink message\n");
     }
+    ++sent;
+#endif
   }
 
+  tx_batch_count_ = 0;
+}
+
+void GazeboMavlinkInterface::drainSensorBus()
+{
+  ImuSample imu;
+  while (imu_bus_->ring.pop(imu)) {
+    handleImu(imu);
+  }
+
+  GpsSample gps;
+  while (gps_bus_->ring.pop(gps)) {
+    handleGps(gps);
+  }
+
+  VisionSample vision;
+  if (vision_bus_->value.Read(vision)) {
+    handleVision(vision);
+  }
+
+  BatterySample battery;
+  if (battery_bus_->value.Read(battery)) {
+    handleBattery(battery);
+  }
 }
 
 void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
+  ImuSample imu;
+  imu.orientation[0] = imu_message->orientation().w();
+  imu.orientation[1] = imu_message->orientation().x();
+  imu.orientation[2] = imu_message->orientation().y();
+  imu.orientation[3] = imu_message->orientation().z();
+  imu.angular_velocity[0] = imu_message->angular_velocity().x();
+  imu.angular_velocity[1] = imu_message->angular_velocity().y();
+  imu.angular_velocity[2] = imu_message->angular_velocity().z();
+  imu.linear_acceleration[0] = imu_message->linear_acceleration().x();
+  imu.linear_acceleration[1] = imu_message->linear_acceleration().y();
+  imu.linear_acceleration[2] = imu_message->linear_acceleration().z();
+  handleImu(imu);
+}
+
+void GazeboMavlinkInterface::handleImu(const ImuSample& imu) {
   common::Time current_time = world_->GetSimTime();
   double dt = (current_time - last_imu_time_).Double();
 
+  // decide up front which messages go out, the work behind the others is skipped
+  const bool send_sensor = (!hil_mode_ || !hil_state_level_)
+      && imu_update_interval_ != 0 && dt >= imu_update_interval_
+      && output_rates_.Due(MavlinkRateScheduler::kHilSensor, current_time.Double());
+  const bool send_state = (!hil_mode_ || hil_state_level_)
+      && output_rates_.Due(MavlinkRateScheduler::kHilStateQuaternion, current_time.Double());
+
+  if (!send_sensor && !send_state) {
+    return;
+  }
+
+    // both messages carry the true position, reproject it once
+    const math::Vector3 pos_W = model_->GetWorldPose().pos;
+    home_frame_.EnuToGeodetic(pos_W.x, pos_W.y, pos_W.z,
+        &groundtruth_lat_rad, &groundtruth_lon_rad, &groundtruth_altitude);
+
     // frames
     // g - gazebo (ENU), east, north, up
     // r - rotors imu frame (FLU), forward, left, up
     // b - px4 (FRD) forward, right down
     // n - px4 (NED) north, east, down
     math::Quaternion q_gr = math::Quaternion(
-      imu_message->orientation().w(),
-      imu_message->orientation().x(),
-      imu_message->orientation().y(),
-      imu_message->orientation().z());
+      imu.orientation[0],
+      imu.orientation[1],
+      imu.orientation[2],
+      imu.orientation[3]);
 
     // q_br
     /*
@@ -439,6 +1062,10 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
     math::Quaternion q_gb = q_gr*q_br.GetInverse();
     math::Quaternion q_nb = q_ng*q_gb;
 
+    math::Vector3 vel_b = q_br.RotateVector(model_->GetRelativeLinearVel());
+
+  if (send_sensor)
+  {
     math::Vector3 pos_g = model_->GetWorldPose().pos;
     math::Vector3 pos_n = q_ng.RotateVector(pos_g);
 
@@ -447,27 +1074,22 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
     math::Quaternion q_dn(0.0, 0.0, declination);
     math::Vector3 mag_n = q_dn.RotateVector(mag_d_);
 
-    math::Vector3 vel_b = q_br.RotateVector(model_->GetRelativeLinearVel());
-    math::Vector3 vel_n = q_ng.RotateVector(model_->GetWorldLinearVel());
-    math::Vector3 omega_nb_b = q_br.RotateVector(model_->GetRelativeAngularVel());
-
-    math::Vector3 mag_noise_b(
-      0.01 * randn_(rand_),
-      0.01 * randn_(rand_),
-      0.01 * randn_(rand_));
+    // one draw per statement, argument evaluation order is unspecified
+    math::Vector3 mag_noise_b;
+    mag_noise_b.x = 0.01 * noise_.Normal();
+    mag_noise_b.y = 0.01 * noise_.Normal();
+    mag_noise_b.z = 0.01 * noise_.Normal();
 
     math::Vector3 accel_b = q_br.RotateVector(math::Vector3(
-      imu_message->linear_acceleration().x(),
-      imu_message->linear_acceleration().y(),
-      imu_message->linear_acceleration().z()));
+      imu.linear_acceleration[0],
+      imu.linear_acceleration[1],
+      imu.linear_acceleration[2]));
     math::Vector3 gyro_b = q_br.RotateVector(math::Vector3(
-      imu_message->angular_velocity().x(),
-      imu_message->angular_velocity().y(),
-      imu_message->angular_velocity().z()));
+      imu.angular_velocity[0],
+      imu.angular_velocity[1],
+      imu.angular_velocity[2]));
     math::Vector3 mag_b = q_nb.RotateVectorReverse(mag_n) + mag_noise_b;
 
-  if (imu_update_interval_!=0 && dt >= imu_update_interval_)
-  {
     mavlink_hil_sensor_t sensor_msg;
     sensor_msg.time_usec = world_->GetSimTime().Double() * 1e6;
     sensor_msg.xacc = accel_b.x;
@@ -489,20 +1111,8 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
     const float pressure_msl = 101325.0f; // pressure at MSL
     sensor_msg.abs_pressure = pressure_msl / pressure_ratio;
 
-    // generate Gaussian noise sequence using polar form of Box-Muller transformation
-    // http://www.design.caltech.edu/erik/Misc/Gaussian.html
-    double x1, x2, w, y1, y2;
-    do {
-     x1 = 2.0 * (rand() * (1.0 / (double)RAND_MAX)) - 1.0;
-     x2 = 2.0 * (rand() * (1.0 / (double)RAND_MAX)) - 1.0;
-     w = x1 * x1 + x2 * x2;
-    } while ( w >= 1.0 );
-    w = sqrt( (-2.0 * log( w ) ) / w );
-    y1 = x1 * w;
-    y2 = x2 * w;
-
     // Apply 1 Pa RMS noise
-    float abs_pressure_noise = 1.0f * (float)w;
+    float abs_pressure_noise = 1.0f * (float)noise_.Normal();
     sensor_msg.abs_pressure += abs_pressure_noise;
 
     // convert to hPa
@@ -538,19 +1148,25 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
 
     mavlink_message_t msg;
     mavlink_msg_hil_sensor_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &sensor_msg);
-    if (hil_mode_) {
-      if (!hil_state_level_){
-        send_mavlink_message(&msg);
-      }
+    send_mavlink_message(&msg);
+
+    if (latency_report_interval_ > 0) {
+      latency_tracker_.OnSensorSent(sensor_msg.time_usec);
     }
 
-    else {
-      send_mavlink_message(&msg);
+    // only wait for the autopilot once it is actually answering
+    if (!hil_mode_ && enable_lockstep_ && received_first_referenc_) {
+      pending_sensor_time_usec_ = sensor_msg.time_usec;
+      awaiting_actuator_controls_ = true;
     }
     last_imu_time_ = current_time;
   }
 
+  if (send_state)
+  {
     // ground truth
+    math::Vector3 vel_n = q_ng.RotateVector(model_->GetWorldLinearVel());
+    math::Vector3 omega_nb_b = q_br.RotateVector(model_->GetRelativeAngularVel());
     math::Vector3 accel_true_b = q_br.RotateVector(model_->GetRelativeLinearAccel());
 
     // send ground truth
@@ -584,33 +1200,46 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
 
     mavlink_message_t msg;
     mavlink_msg_hil_state_quaternion_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &hil_state_quat);
-    if (hil_mode_) {
-      if (hil_state_level_){
-        send_mavlink_message(&msg);
-      }
-    }
-
-    else {
-      send_mavlink_message(&msg);
-    }
+    send_mavlink_message(&msg);
+  }
 }
 
 void GazeboMavlinkInterface::GpsCallback(GpsPtr& gps_msg){
+  GpsSample gps;
+  gps.time = gps_msg->time();
+  gps.latitude_deg = gps_msg->latitude_deg();
+  gps.longitude_deg = gps_msg->longitude_deg();
+  gps.altitude = gps_msg->altitude();
+  gps.eph = gps_msg->eph();
+  gps.epv = gps_msg->epv();
+  gps.velocity = gps_msg->velocity();
+  gps.velocity_east = gps_msg->velocity_east();
+  gps.velocity_north = gps_msg->velocity_north();
+  gps.velocity_up = gps_msg->velocity_up();
+  handleGps(gps);
+}
+
+void GazeboMavlinkInterface::handleGps(const GpsSample& gps){
+  if ((hil_mode_ && hil_state_level_) ||
+      !output_rates_.Due(MavlinkRateScheduler::kHilGps, world_->GetSimTime().Double())) {
+    return;
+  }
+
   // fill HIL GPS Mavlink msg
   mavlink_hil_gps_t hil_gps_msg;
-  hil_gps_msg.time_usec = gps_msg->time() * 1e6;
+  hil_gps_msg.time_usec = gps.time * 1e6;
   hil_gps_msg.fix_type = 3;
-  hil_gps_msg.lat = gps_msg->latitude_deg() * 1e7;
-  hil_gps_msg.lon = gps_msg->longitude_deg() * 1e7;
-  hil_gps_msg.alt = gps_msg->altitude() * 1000.0;
-  hil_gps_msg.eph = gps_msg->eph() * 100.0;
-  hil_gps_msg.epv = gps_msg->epv() * 100.0;
-  hil_gps_msg.vel = gps_msg->velocity() * 100.0;
-  hil_gps_msg.vn = gps_msg->velocity_north() * 100.0;
-  hil_gps_msg.ve = gps_msg->velocity_east() * 100.0;
-  hil_gps_msg.vd = -gps_msg->velocity_up() * 100.0;
+  hil_gps_msg.lat = gps.latitude_deg * 1e7;
+  hil_gps_msg.lon = gps.longitude_deg * 1e7;
+  hil_gps_msg.alt = gps.altitude * 1000.0;
+  hil_gps_msg.eph = gps.eph * 100.0;
+  hil_gps_msg.epv = gps.epv * 100.0;
+  hil_gps_msg.vel = gps.velocity * 100.0;
+  hil_gps_msg.vn = gps.velocity_north * 100.0;
+  hil_gps_msg.ve = gps.velocity_east * 100.0;
+  hil_gps_msg.vd = -gps.velocity_up * 100.0;
   // MAVLINK_HIL_GPS_T CoG is [0, 360]. math::Angle::Normalize() is [-pi, pi].
-  math::Angle cog(atan2(gps_msg->velocity_east(), gps_msg->velocity_north()));
+  math::Angle cog(atan2(gps.velocity_east, gps.velocity_north));
   cog.Normalize();
   hil_gps_msg.cog = static_cast<uint16_t>(GetDegrees360(cog) * 100.0);
   hil_gps_msg.satellites_visible = 10;
@@ -618,27 +1247,17 @@ void GazeboMavlinkInterface::GpsCallback(GpsPtr& gps_msg){
   // send HIL_GPS Mavlink msg
   mavlink_message_t msg;
   mavlink_msg_hil_gps_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &hil_gps_msg);
-  if (hil_mode_) {
-    if (!hil_state_level_){
-      send_mavlink_message(&msg);
-    }
-  }
-
-  else {
-    send_mavlink_message(&msg);
-  }
-}
-
-void GazeboMavlinkInterface::GroundtruthCallback(GtPtr& groundtruth_msg){
-  // update groundtruth lat_rad, lon_rad and altitude
-  groundtruth_lat_rad = groundtruth_msg->latitude_rad();
-  groundtruth_lon_rad = groundtruth_msg->longitude_rad();
-  groundtruth_altitude = groundtruth_msg->altitude();
-  // the rest of the data is obtained directly on this interface and sent to
-  // the FCU
+  send_mavlink_message(&msg);
 }
 
 void GazeboMavlinkInterface::LidarCallback(LidarPtr& lidar_message) {
+  //distance needed for optical flow message
+  optflow_distance = lidar_message->current_distance();  //[m]
+
+  if (!output_rates_.Due(MavlinkRateScheduler::kDistanceSensorLidar, world_->GetSimTime().Double())) {
+    return;
+  }
+
   mavlink_distance_sensor_t sensor_msg;
   sensor_msg.time_boot_ms = lidar_message->time_msec();
   sensor_msg.min_distance = lidar_message->min_distance() * 100.0;
@@ -649,9 +1268,6 @@ void GazeboMavlinkInterface::LidarCallback(LidarPtr& lidar_message) {
   sensor_msg.orientation = 25;//downward facing
   sensor_msg.covariance = 0;
 
-  //distance needed for optical flow message
-  optflow_distance = lidar_message->current_distance();  //[m]
-
   mavlink_message_t msg;
   mavlink_msg_distance_sensor_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &sensor_msg);
   send_mavlink_message(&msg);
@@ -681,6 +1297,10 @@ void GazeboMavlinkInterface::OpticalFlowCallback(OpticalFlowPtr& opticalFlow_mes
 }
 
 void GazeboMavlinkInterface::SonarCallback(SonarSensPtr& sonar_message) {
+  if (!output_rates_.Due(MavlinkRateScheduler::kDistanceSensorSonar, world_->GetSimTime().Double())) {
+    return;
+  }
+
   mavlink_distance_sensor_t sensor_msg;
   sensor_msg.time_boot_ms = world_->GetSimTime().Double() * 1e3;
   sensor_msg.min_distance = sonar_message->min_distance() * 100.0;
@@ -697,6 +1317,10 @@ void GazeboMavlinkInterface::SonarCallback(SonarSensPtr& sonar_message) {
 }
 
 void GazeboMavlinkInterface::IRLockCallback(IRLockPtr& irlock_message) {
+  if (!output_rates_.Due(MavlinkRateScheduler::kLandingTarget, world_->GetSimTime().Double())) {
+    return;
+  }
+
   mavlink_landing_target_t sensor_msg;
 
   sensor_msg.time_usec = world_->GetSimTime().Double() * 1e6;
@@ -714,15 +1338,31 @@ void GazeboMavlinkInterface::IRLockCallback(IRLockPtr& irlock_message) {
 }
 
 void GazeboMavlinkInterface::VisionCallback(OdomPtr& odom_message) {
+  VisionSample vision;
+  vision.usec = odom_message->usec();
+  vision.x = odom_message->x();
+  vision.y = odom_message->y();
+  vision.z = odom_message->z();
+  vision.roll = odom_message->roll();
+  vision.pitch = odom_message->pitch();
+  vision.yaw = odom_message->yaw();
+  handleVision(vision);
+}
+
+void GazeboMavlinkInterface::handleVision(const VisionSample& vision) {
+  if (!output_rates_.Due(MavlinkRateScheduler::kVisionPositionEstimate, world_->GetSimTime().Double())) {
+    return;
+  }
+
   mavlink_vision_position_estimate_t sensor_msg;
-  sensor_msg.usec = odom_message->usec();
+  sensor_msg.usec = vision.usec;
   // convert from ENU to NED
-  sensor_msg.x = odom_message->y();
-  sensor_msg.y = -odom_message->x();
-  sensor_msg.z = -odom_message->z();
-  sensor_msg.roll = odom_message->pitch();
-  sensor_msg.pitch = -odom_message->roll();
-  sensor_msg.yaw = -odom_message->yaw();
+  sensor_msg.x = vision.y;
+  sensor_msg.y = -vision.x;
+  sensor_msg.z = -vision.z;
+  sensor_msg.roll = vision.pitch;
+  sensor_msg.pitch = -vision.roll;
+  sensor_msg.yaw = -vision.yaw;
 
   // send VISION_POSITION_ESTIMATE Mavlink msg
   mavlink_message_t msg;
@@ -730,6 +1370,43 @@ void GazeboMavlinkInterface::VisionCallback(OdomPtr& odom_message) {
   send_mavlink_message(&msg);
 }
 
+void GazeboMavlinkInterface::BatteryCallback(BatteryPtr& battery_message) {
+  BatterySample battery;
+  battery.time = battery_message->time();
+  battery.voltage = battery_message->voltage();
+  battery.current = battery_message->current();
+  battery.consumed = battery_message->consumed();
+  battery.remaining = battery_message->remaining();
+  battery.cells = battery_message->cells();
+  handleBattery(battery);
+}
+
+void GazeboMavlinkInterface::handleBattery(const BatterySample& battery) {
+  if (!output_rates_.Due(MavlinkRateScheduler::kBatteryStatus, world_->GetSimTime().Double())) {
+    return;
+  }
+
+  mavlink_battery_status_t sensor_msg;
+  memset(&sensor_msg, 0, sizeof(sensor_msg));
+  sensor_msg.id = 0;
+  sensor_msg.battery_function = MAV_BATTERY_FUNCTION_ALL;
+  sensor_msg.type = MAV_BATTERY_TYPE_LIPO;
+  sensor_msg.temperature = INT16_MAX;  // unknown
+  // equal cells, the ones the battery does not have are marked unused
+  const int cells = std::max(1, battery.cells);
+  for (int i = 0; i < 10; ++i) {
+    sensor_msg.voltages[i] = i < cells ? battery.voltage / cells * 1000.0 : UINT16_MAX;
+  }
+  sensor_msg.current_battery = battery.current * 100.0;  // [cA]
+  sensor_msg.current_consumed = battery.consumed;        // [mAh]
+  sensor_msg.energy_consumed = -1;
+  sensor_msg.battery_remaining = battery.remaining * 100.0;
+
+  mavlink_message_t msg;
+  mavlink_msg_battery_status_encode_chan(1, 200, MAVLINK_COMM_0, &msg, &sensor_msg);
+  send_mavlink_message(&msg);
+}
+
 /*ssize_t GazeboMavlinkInterface::receive(void *_buf, const size_t _size, uint32_t _timeoutMs)
    {
    fd_set fds;
@@ -751,33 +1428,268 @@ void GazeboMavlinkInterface::VisionCallback(OdomPtr& odom_message) {
 
 void GazeboMavlinkInterface::pollForMAVLinkMessages(double _dt, uint32_t _timeoutMs)
 {
-  // convert timeout in ms to timeval
-  struct timeval tv;
-  tv.tv_sec = _timeoutMs / 1000;
-  tv.tv_usec = (_timeoutMs % 1000) * 1000UL;
+  MavlinkReactor& reactor = MavlinkReactor::Instance();
 
-  // poll
-  ::poll(&fds[0], (sizeof(fds[0]) / sizeof(fds[0])), 0);
+  // In lockstep we block (up to _timeoutMs) until the actuator controls
+  // answering the last HIL_SENSOR are in, otherwise we only look once.
+  const bool lockstep_wait = enable_lockstep_ && awaiting_actuator_controls_;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeoutMs);
 
-  if (fds[0].revents & POLLIN) {
-    int len = recvfrom(_fd, _buf, sizeof(_buf), 0, (struct sockaddr *)&_srcaddr, &_addrlen);
-    if (len > 0) {
-      mavlink_message_t msg;
-      mavlink_status_t status;
-      for (unsigned i = 0; i < len; ++i)
-      {
-        if (mavlink_parse_char(MAVLINK_COMM_0, _buf[i], &msg, &status))
-        {
-          if (serial_enabled_) {
-            // forward message from qgc to serial
-            send_mavlink_message(&msg);
-          }
-          // have a message, handle it
-          handle_message(&msg);
+  // the first vehicle to get here this iteration services every socket
+  reactor.ServiceOnce(world_->GetIterations());
+
+  while (lockstep_wait && awaiting_actuator_controls_) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0 || reactor.Poll(remaining) < 0) {
+      break;
+    }
+  }
+
+  if (lockstep_wait && awaiting_actuator_controls_) {
+    onLockstepStall(_timeoutMs);
+  }
+}
+
+void GazeboMavlinkInterface::onLockstepStall(uint32_t _timeoutMs)
+{
+  // the autopilot did not answer in time, let physics go on without it
+  awaiting_actuator_controls_ = false;
+  if (lockstep_stall_count_++ % 100 == 0) {
+    gzwarn << "[gazebo_mavlink_interface] Lockstep stalled for " << _timeoutMs
+           << " ms waiting for actuator controls (" << lockstep_stall_count_ << " stalls).\n";
+  }
+}
+
+void GazeboMavlinkInterface::pollActuatorControlsRing(uint32_t _timeoutMs)
+{
+  mavlink_hil_actuator_controls_t controls;
+  while (rx_ring_.pop(controls)) {
+    handle_actuator_controls(controls);
+  }
+
+  if (!enable_lockstep_ || !awaiting_actuator_controls_) {
+    return;
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeoutMs);
+  while (awaiting_actuator_controls_) {
+    {
+      std::unique_lock<std::mutex> lock(rx_ring_wait_mutex_);
+      if (!rx_ring_cv_.wait_until(lock, deadline, [this] { return !rx_ring_.empty(); })) {
+        break;
+      }
+    }
+    while (rx_ring_.pop(controls)) {
+      handle_actuator_controls(controls);
+    }
+  }
+
+  if (awaiting_actuator_controls_) {
+    onLockstepStall(_timeoutMs);
+  }
+}
+
+void GazeboMavlinkInterface::pollShmTransport(uint32_t _timeoutMs)
+{
+  const bool lockstep_wait = enable_lockstep_ && awaiting_actuator_controls_;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeoutMs);
+  unsigned received = 0;
+
+  while (true) {
+    // the cap does not hold while waiting, the actuator controls may be queued behind it
+    ssize_t len;
+    while ((received < max_rx_datagrams_per_step_ || (lockstep_wait && awaiting_actuator_controls_)) &&
+        (len = shm_transport_.Receive(rx_bufs_[0], kRxDatagramSize)) != 0 && len != -1) {
+      if (len == MavlinkShmTransport::kCorruptSlot) {
+        // skipped, the frames queued behind it are still good
+        if (shm_transport_.CorruptSlots() % 100 == 1) {
+          gzwarn << "[gazebo_mavlink_interface] Skipped " << shm_transport_.CorruptSlots()
+                 << " corrupt shared memory slots.\n";
         }
+        continue;
+      }
+      parseMAVLinkDatagram(rx_bufs_[0], len);
+      ++received;
+    }
+
+    if (!lockstep_wait || !awaiting_actuator_controls_) {
+      break;
+    }
+
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+      break;
+    }
+    shm_transport_.WaitReadable(remaining);
+  }
+
+  rx_datagrams_total_ += received;
+
+  if (lockstep_wait && awaiting_actuator_controls_) {
+    onLockstepStall(_timeoutMs);
+  }
+}
+
+void GazeboMavlinkInterface::wakeMavlinkIoThread()
+{
+  // pairs with the fence in MavlinkIoThread(): either it sees the frame we
+  // just pushed or we see that it is parked in poll() and write the pipe
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mavlink_io_sleeping_.load(std::memory_order_relaxed)) {
+    const uint8_t wake = 1;
+    // a full pipe already guarantees a wakeup
+    ssize_t ret = ::write(io_wake_pipe_[1], &wake, 1);
+    (void)ret;
+  }
+}
+
+void GazeboMavlinkInterface::sendQueuedMAVLinkFrames()
+{
+  MavlinkTxFrame frame;
+  std::lock_guard<std::mutex> lock(tx_batch_mutex_);
+
+  while (tx_ring_.pop(frame)) {
+    if (tx_batch_count_ >= kTxBatchSize) {
+      flushMAVLinkTxBatchLocked();
+    }
+    queueMAVLinkTxFrameLocked(&frame.msg, frame.destination_port);
+  }
+  flushMAVLinkTxBatchLocked();
+}
+
+void GazeboMavlinkInterface::MavlinkIoThread()
+{
+  struct pollfd fds[2];
+  fds[0].fd = _fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = io_wake_pipe_[0];
+  fds[1].events = POLLIN;
+
+  while (mavlink_io_running_) {
+    sendQueuedMAVLinkFrames();
+
+    // announce that we are about to sleep, then look at the ring once more
+    // so a frame pushed in between is not left waiting for the timeout
+    mavlink_io_sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int ret = ::poll(fds, 2, tx_ring_.empty() ? kIoThreadPollMs : 0);
+    mavlink_io_sleeping_.store(false, std::memory_order_relaxed);
+
+    if (ret <= 0) {
+      continue;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      uint8_t drain[64];
+      while (::read(io_wake_pipe_[0], drain, sizeof(drain)) > 0) {}
+    }
+
+    if (fds[0].revents & POLLIN) {
+      rx_datagrams_total_ += receiveMAVLinkDatagrams(max_rx_datagrams_per_step_);
+    }
+  }
+
+  sendQueuedMAVLinkFrames();
+}
+
+void GazeboMavlinkInterface::onMAVLinkSocketReadable()
+{
+  // the per-step count restarts with every world iteration
+  const uint64_t iteration = world_->GetIterations();
+  if (iteration != rx_iteration_) {
+    rx_iteration_ = iteration;
+    rx_datagrams_last_step_ = 0;
+  }
+
+  // the actuator controls a lockstep wait is blocked on may be queued
+  // behind the cap, so while waiting the cap is lifted one batch at a time
+  const bool lockstep_wait = enable_lockstep_ && awaiting_actuator_controls_;
+  if (rx_datagrams_last_step_ < max_rx_datagrams_per_step_ || lockstep_wait) {
+    // drain everything that queued up since the last step
+    unsigned budget = lockstep_wait ? max_rx_datagrams_per_step_
+        : max_rx_datagrams_per_step_ - rx_datagrams_last_step_;
+    unsigned received = receiveMAVLinkDatagrams(budget);
+    rx_datagrams_last_step_ += received;
+    rx_datagrams_total_ += received;
+  }
+
+  if (rx_datagrams_last_step_ >= max_rx_datagrams_per_step_ && !(enable_lockstep_ && awaiting_actuator_controls_)) {
+    // still readable, keep it out of the readiness set so a lockstep wait
+    // of this or another vehicle does not spin on it for the rest of the step
+    MavlinkReactor::Instance().Defer(_fd);
+    if (rx_cap_hit_count_++ % 100 == 0) {
+      gzwarn << "[gazebo_mavlink_interface] Received more than " << max_rx_datagrams_per_step_
+             << " datagrams in one step, deferring the rest.\n";
+    }
+  }
+}
+
+unsigned GazeboMavlinkInterface::receiveMAVLinkDatagrams(unsigned max_datagrams)
+{
+  unsigned received = 0;
+
+  while (received < max_datagrams) {
+#if defined(__linux__)
+    unsigned batch = std::min(kRxBatchSize, max_datagrams - received);
+    for (unsigned i = 0; i < batch; ++i) {
+      rx_msgs_[i].msg_hdr.msg_namelen = sizeof(rx_addrs_[i]);
+    }
+
+    int n = recvmmsg(_fd, rx_msgs_, batch, MSG_DONTWAIT, nullptr);
+    if (n <= 0) {
+      break;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      if (rx_msgs_[i].msg_hdr.msg_namelen > 0) {
+        memcpy(&_srcaddr, &rx_addrs_[i], sizeof(_srcaddr));
       }
+      parseMAVLinkDatagram(rx_bufs_[i], rx_msgs_[i].msg_len);
+    }
+    received += n;
+
+    // a short batch means the socket is empty
+    if (n < static_cast<int>(batch)) {
+      break;
+    }
+#else
+    int len = recvfrom(_fd, rx_bufs_[0], kRxDatagramSize, MSG_DONTWAIT, (struct sockaddr *)&_srcaddr, &_addrlen);
+    if (len <= 0) {
+      break;
     }
+    parseMAVLinkDatagram(rx_bufs_[0], len);
+    ++received;
+#endif
   }
+
+  return received;
+}
+
+bool GazeboMavlinkInterface::mavlinkMsgInfo(uint32_t msgid, uint8_t *crc_extra, uint8_t *max_len)
+{
+  const mavlink_msg_entry_t *entry = mavlink_get_msg_entry(msgid);
+  if (!entry) {
+    return false;
+  }
+  *crc_extra = entry->crc_extra;
+  *max_len = entry->max_len;
+  return true;
+}
+
+void GazeboMavlinkInterface::parseMAVLinkDatagram(const uint8_t *buf, size_t len)
+{
+  // a truncated frame is not carried into the next datagram
+  udp_framer_.PushDatagram(buf, len, [this] (const uint8_t *frame, size_t frame_len, uint32_t msgid) {
+    if (serial_enabled_) {
+      // forward message from qgc to serial
+      forward_mavlink_frame(frame, frame_len, msgid);
+    }
+    if (is_handled_message(msgid)) {
+      decode_mavlink_frame(&udp_rx_msg_, &udp_rx_status_, frame, frame_len);
+    }
+  });
 }
 
 void GazeboMavlinkInterface::handle_message(mavlink_message_t *msg)
@@ -786,86 +1698,106 @@ void GazeboMavlinkInterface::handle_message(mavlink_message_t *msg)
   case MAVLINK_MSG_ID_HIL_ACTUATOR_CONTROLS:
     mavlink_hil_actuator_controls_t controls;
     mavlink_msg_hil_actuator_controls_decode(msg, &controls);
-    bool armed = false;
-
-    if ((controls.mode & MAV_MODE_FLAG_SAFETY_ARMED) > 0) {
-      armed = true;
-    }
-
-    last_actuator_time_ = world_->GetSimTime();
 
-    for (unsigned i = 0; i < n_out_max; i++) {
-      input_index_[i] = i;
+    if (!mavlink_io_thread_enabled_) {
+      handle_actuator_controls(controls);
+      break;
     }
 
-    // set rotor speeds, controller targets
-    input_reference_.resize(n_out_max);
-    for (int i = 0; i < input_reference_.size(); i++) {
-      if (armed) {
-        input_reference_[i] = (controls.controls[input_index_[i]] + input_offset_[i])
-            * input_scaling_[i] + zero_position_armed_[i];
-      } else {
-        input_reference_[i] = zero_position_disarmed_[i];
+    // on the I/O thread: hand the decoded command over to physics
+    if (!rx_ring_.push(controls)) {
+      if (rx_ring_dropped_++ % 100 == 0) {
+        gzwarn << "[gazebo_mavlink_interface] Actuator controls ring full, dropped "
+               << rx_ring_dropped_ << " commands.\n";
       }
+    } else if (enable_lockstep_) {
+      // taking the lock orders the push before a waiter's predicate check
+      { std::lock_guard<std::mutex> lock(rx_ring_wait_mutex_); }
+      rx_ring_cv_.notify_one();
     }
-
-    received_first_referenc_ = true;
     break;
   }
 }
 
-void GazeboMavlinkInterface::handle_control(double _dt)
+void GazeboMavlinkInterface::handle_actuator_controls(const mavlink_hil_actuator_controls_t &controls)
 {
-  // set joint positions
+  bool armed = false;
+
+  if ((controls.mode & MAV_MODE_FLAG_SAFETY_ARMED) > 0) {
+    armed = true;
+  }
+
+  last_actuator_time_ = world_->GetSimTime();
+
+  if (latency_report_interval_ > 0) {
+    latency_tracker_.OnActuatorControls(controls.time_usec, last_actuator_time_.Double() * 1e6);
+  }
+
+  // this answers the HIL_SENSOR the world step is waiting for
+  if (enable_lockstep_ && controls.time_usec >= pending_sensor_time_usec_) {
+    awaiting_actuator_controls_ = false;
+  }
+
+  for (unsigned i = 0; i < n_out_max; i++) {
+    input_index_[i] = i;
+  }
+
+  // set rotor speeds, controller targets
+  input_reference_.resize(n_out_max);
   for (int i = 0; i < input_reference_.size(); i++) {
-    if (joints_[i]) {
-      double target = input_reference_[i];
-      if (joint_control_type_[i] == "velocity")
-      {
-        double current = joints_[i]->GetVelocity(0);
-        double err = current - target;
-        double force = pids_[i].Update(err, _dt);
-        joints_[i]->SetForce(0, force);
-      }
-      else if (joint_control_type_[i] == "position")
-      {
-        double current = joints_[i]->GetAngle(0).Radian();
+    if (armed) {
+      input_reference_[i] = (controls.controls[input_index_[i]] + input_offset_[i])
+          * input_scaling_[i] + zero_position_armed_[i];
+    } else {
+      input_reference_[i] = zero_position_disarmed_[i];
+    }
+  }
 
-        double err = current - target;
-        double force = pids_[i].Update(err, _dt);
-        joints_[i]->SetForce(0, force);
-      }
-      else if (joint_control_type_[i] == "position_gztopic")
-      {
-     #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
-        /// only gazebo 7.4 and above support Any
-        gazebo::msgs::Any m;
-        m.set_type(gazebo::msgs::Any_ValueType_DOUBLE);
-        m.set_double_value(target);
-     #else
-        std::stringstream ss;
-        gazebo::msgs::GzString m;
-        ss << target;
-        m.set_data(ss.str());
-     #endif
-        joint_control_pub_[i]->Publish(m);
-      }
-      else if (joint_control_type_[i] == "position_kinematic")
-      {
-        /// really not ideal if your drone is moving at all,
-        /// mixing kinematic updates with dynamics calculation is
-        /// non-physical.
-     #if GAZEBO_MAJOR_VERSION >= 6
-        joints_[i]->SetPosition(0, input_reference_[i]);
-     #else
-        joints_[i]->SetAngle(0, input_reference_[i]);
-     #endif
-      }
-      else
-      {
-        gzerr << "joint_control_type[" << joint_control_type_[i] << "] undefined.\n";
-      }
+  received_first_referenc_ = true;
+}
+
+void GazeboMavlinkInterface::handle_control(double _dt)
+{
+  // velocity and position channels: gather errors, one bank update, scatter forces
+  const int n_pid = pid_bank_.Size();
+  for (int k = 0; k < n_pid; ++k) {
+    const int i = pid_channel_[k];
+    const double current = joint_control_type_[i] == kJointControlVelocity ?
+        joints_[i]->GetVelocity(0) : joints_[i]->GetAngle(0).Radian();
+    pid_err_[k] = current - input_reference_[i];
+  }
+  pid_bank_.Update(pid_err_, pid_cmd_, _dt);
+  for (int k = 0; k < n_pid; ++k) {
+    joints_[pid_channel_[k]]->SetForce(0, pid_cmd_[k]);
+  }
+
+  if (!gztopic_channels_.empty()) {
+    for (size_t k = 0; k < gztopic_channels_.size(); ++k) {
+      const int i = gztopic_channels_[k];
+      const double target = input_reference_[i];
+      joint_command_msg_.set_position(k, target);
+   #if GAZEBO_MAJOR_VERSION >= 7 && GAZEBO_MINOR_VERSION >= 4
+      joint_control_msg_.set_type(gazebo::msgs::Any_ValueType_DOUBLE);
+      joint_control_msg_.set_double_value(target);
+   #else
+      std::stringstream ss;
+      ss << target;
+      joint_control_msg_.set_data(ss.str());
+   #endif
+      joint_control_pub_[i]->Publish(joint_control_msg_);
     }
+    joint_command_pub_->Publish(joint_command_msg_);
+  }
+
+  /// really not ideal if your drone is moving at all,
+  /// mixing kinematic updates with dynamics calculation is
+  /// non-physical.
+  for (int i : kinematic_channels_) {
+   #if GAZEBO_MAJOR_VERSION >= 6
+    joints_[i]->SetPosition(0, input_reference_[i]);
+   #else
+    joints_[i]->SetAngle(0, input_reference_[i]);
+   #endif
   }
 }
 
@@ -907,34 +1839,15 @@ void GazeboMavlinkInterface::do_read(void)
 
 // Based on MAVConnInterface::parse_buffer in MAVROS
 void GazeboMavlinkInterface::parse_buffer(const boost::system::error_code& err, std::size_t bytes_t){
-  mavlink_status_t status;
-  mavlink_message_t message;
-  uint8_t *buf = this->rx_buf.data();
-
   assert(rx_buf.size() >= bytes_t);
 
-  for(; bytes_t > 0; bytes_t--)
-  {
-    auto c = *buf++;
-
-    auto msg_received = static_cast<Framing>(mavlink_frame_char_buffer(&m_buffer, &m_status, c, &message, &status));
-    if (msg_received == Framing::bad_crc || msg_received == Framing::bad_signature) {
-      _mav_parse_error(&m_status);
-      m_status.msg_received = MAVLINK_FRAMING_INCOMPLETE;
-      m_status.parse_state = MAVLINK_PARSE_STATE_IDLE;
-      if (c == MAVLINK_STX) {
-        m_status.parse_state = MAVLINK_PARSE_STATE_GOT_STX;
-        m_buffer.len = 0;
-        mavlink_start_checksum(&m_buffer);
-      }
-    }
-
-    if(msg_received != Framing::incomplete){
-      // send to gcs
-      send_mavlink_message(&message, qgc_udp_port_);
-      handle_message(&message);
+  serial_framer_.Push(rx_buf.data(), bytes_t, [this] (const uint8_t *frame, size_t len, uint32_t msgid) {
+    // send to gcs
+    forward_mavlink_frame(frame, len, msgid, qgc_udp_port_);
+    if (is_handled_message(msgid)) {
+      decode_mavlink_frame(&serial_rx_msg_, &serial_rx_status_, frame, len);
     }
-  }
+  });
   do_read();
 }
 
@@ -943,40 +1856,120 @@ void GazeboMavlinkInterface::do_write(bool check_tx_state){
     return;
 
   lock_guard lock(mutex);
-  if (tx_q.empty())
+  if (serial_tx_count_ == 0)
     return;
 
   tx_in_progress = true;
-  auto &buf_ref = tx_q.front();
 
-  serial_dev.async_write_some(
-    boost::asio::buffer(buf_ref.dpos(), buf_ref.nbytes()), [this, &buf_ref] (boost::system::error_code error,   size_t bytes_transferred)
+  // everything queued so far goes out in one scatter-gather write
+  serial_tx_gather_.clear();
+  for (size_t i = 0; i < serial_tx_count_; ++i) {
+    const SerialTxSlot &slot = serial_tx_slots_[serial_tx_order_[(serial_tx_head_ + i) % kSerialTxSlots]];
+    serial_tx_gather_.push_back(boost::asio::buffer(slot.data, slot.len));
+  }
+  serial_tx_inflight_ = serial_tx_count_;
+
+  boost::asio::async_write(serial_dev, serial_tx_gather_,
+    [this] (boost::system::error_code error, size_t /*bytes_transferred*/)
     {
-      assert(bytes_transferred <= buf_ref.len);
-      if(error) {
+      lock_guard lock(mutex);
+      serialTxReleaseInflightLocked();
+
+      if (error) {
         gzerr << "Serial error: " << error.message() << "\n";
-      return;
+        tx_in_progress = false;
+        return;
       }
 
-    lock_guard lock(mutex);
+      if (serial_tx_count_ > 0) {
+        do_write(false);
+      }
+      else {
+        tx_in_progress = false;
+      }
+    });
+}
 
-    if (tx_q.empty()) {
-      tx_in_progress = false;
-      return;
-    }
+// Queues an empty slot for msgid, the caller fills in data and len before
+// releasing the lock. Returns nullptr if the frame has to be dropped.
+GazeboMavlinkInterface::SerialTxSlot *GazeboMavlinkInterface::serialTxAllocLocked(uint32_t msgid)
+{
+  if (serial_tx_free_count_ == 0 && !serialTxMakeRoomLocked(msgid)) {
+    return nullptr;
+  }
 
-    buf_ref.pos += bytes_transferred;
-    if (buf_ref.nbytes() == 0) {
-      tx_q.pop_front();
-    }
+  const uint16_t index = serial_tx_free_[--serial_tx_free_count_];
+  SerialTxSlot &slot = serial_tx_slots_[index];
+  slot.msgid = msgid;
+
+  serial_tx_order_[(serial_tx_head_ + serial_tx_count_) % kSerialTxSlots] = index;
+  ++serial_tx_count_;
+  return &slot;
+}
 
-    if (!tx_q.empty()) {
-      do_write(false);
+// The link is saturated. A state or GPS frame is superseded once a newer
+// one of the same message id is queued behind it or is being enqueued, so
+// the oldest such frame goes first. Otherwise the stalest frame is dropped.
+bool GazeboMavlinkInterface::serialTxMakeRoomLocked(uint32_t incoming_msgid)
+{
+  auto supersedable = [] (uint32_t msgid) {
+    return msgid == MAVLINK_MSG_ID_HIL_STATE_QUATERNION || msgid == MAVLINK_MSG_ID_HIL_GPS;
+  };
+  auto msgid_at = [this] (size_t pos) {
+    return serial_tx_slots_[serial_tx_order_[(serial_tx_head_ + pos) % kSerialTxSlots]].msgid;
+  };
+
+  for (size_t i = serial_tx_inflight_; i < serial_tx_count_; ++i) {
+    const uint32_t msgid = msgid_at(i);
+    if (!supersedable(msgid)) {
+      continue;
     }
-    else {
-      tx_in_progress = false;
+    bool superseded = msgid == incoming_msgid;
+    for (size_t j = i + 1; j < serial_tx_count_ && !superseded; ++j) {
+      superseded = msgid_at(j) == msgid;
     }
-  });
+    if (superseded) {
+      serialTxRemoveLocked(i);
+      if (serial_tx_dropped_superseded_++ % 100 == 0) {
+        gzwarn << "Serial link saturated, dropped " << serial_tx_dropped_superseded_
+               << " superseded state/GPS frames.\n";
+      }
+      return true;
+    }
+  }
+
+  if (serial_tx_inflight_ >= serial_tx_count_) {
+    ++serial_tx_dropped_other_;
+    return false;
+  }
+
+  serialTxRemoveLocked(serial_tx_inflight_);
+  if (serial_tx_dropped_other_++ % 100 == 0) {
+    gzwarn << "Serial link saturated, dropped " << serial_tx_dropped_other_ << " sensor frames.\n";
+  }
+  return true;
+}
+
+void GazeboMavlinkInterface::serialTxRemoveLocked(size_t pos)
+{
+  serial_tx_free_[serial_tx_free_count_++] = serial_tx_order_[(serial_tx_head_ + pos) % kSerialTxSlots];
+
+  // close the gap, only slot indices move
+  for (size_t i = pos + 1; i < serial_tx_count_; ++i) {
+    serial_tx_order_[(serial_tx_head_ + i - 1) % kSerialTxSlots] =
+        serial_tx_order_[(serial_tx_head_ + i) % kSerialTxSlots];
+  }
+  --serial_tx_count_;
+}
+
+void GazeboMavlinkInterface::serialTxReleaseInflightLocked()
+{
+  for (size_t i = 0; i < serial_tx_inflight_; ++i) {
+    serial_tx_free_[serial_tx_free_count_++] = serial_tx_order_[serial_tx_head_];
+    serial_tx_head_ = (serial_tx_head_ + 1) % kSerialTxSlots;
+  }
+  serial_tx_count_ -= serial_tx_inflight_;
+  serial_tx_inflight_ = 0;
 }
 
 }
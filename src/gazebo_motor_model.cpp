@@ -130,6 +130,14 @@ void GazeboMotorModel::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   getSdfParam<double>(_sdf, "timeConstantDown", time_constant_down_, time_constant_down_);
   getSdfParam<double>(_sdf, "rotorVelocitySlowdownSim", rotor_velocity_slowdown_sim_, 10);
 
+  if (_sdf->HasElement("rotorTable")) {
+    std::string error;
+    if (!rotor_table_.Load(_sdf->GetElement("rotorTable")->Get<std::string>(), &error))
+      gzerr << "[gazebo_motor_model] " << error << ", using the motor and moment constants.\n";
+    getSdfParam<double>(_sdf, "rotorDiameter", rotor_diameter_, rotor_diameter_);
+    getSdfParam<double>(_sdf, "airDensity", air_density_, air_density_);
+  }
+
   /*
   std::cout << "Subscribing to: " << motor_test_sub_topic_ << std::endl;
   motor_sub_ = node_handle_->Subscribe<mav_msgs::msgs::MotorSpeed>("~/" + model_->GetName() + motor_test_sub_topic_, &GazeboMotorModel::testProto, this);
@@ -190,16 +198,30 @@ void GazeboMotorModel::UpdateForcesAndMoments() {
     gzerr << "Aliasing on motor [" << motor_number_ << "] might occur. Consider making smaller simulation time steps or raising the rotor_velocity_slowdown_sim_ param.\n";
   }
   double real_motor_velocity = motor_rot_vel_ * rotor_velocity_slowdown_sim_;
-  double force = real_motor_velocity * real_motor_velocity * motor_constant_;
-
-  // scale down force linearly with forward speed
-  // XXX this has to be modelled better
   math::Vector3 body_velocity = link_->GetWorldLinearVel();
-  double vel = body_velocity.GetLength();
-  double scalar = 1 - vel / 25.0; // at 50 m/s the rotor will not produce any force anymore
-  scalar = math::clamp(scalar, 0.0, 1.0);
-  // Apply a force to the link.
-  link_->AddRelativeForce(math::Vector3(0, 0, force * scalar));
+  double force;
+  double drag_torque_magnitude;
+
+  if (rotor_table_.Empty()) {
+    force = real_motor_velocity * real_motor_velocity * motor_constant_;
+    drag_torque_magnitude = force * moment_constant_;
+
+    // scale down force linearly with forward speed
+    // XXX this has to be modelled better
+    double vel = body_velocity.GetLength();
+    double scalar = 1 - vel / 25.0; // at 50 m/s the rotor will not produce any force anymore
+    scalar = math::clamp(scalar, 0.0, 1.0);
+    // Apply a force to the link.
+    link_->AddRelativeForce(math::Vector3(0, 0, force * scalar));
+  } else {
+    // thrust and torque from the table, for the airflow through the rotor disc
+    math::Vector3 thrust_axis = link_->GetWorldPose().rot.RotateVector(math::Vector3(0, 0, 1));
+    double v_axial = body_velocity.Dot(thrust_axis);
+    double v_inplane = (body_velocity - v_axial * thrust_axis).GetLength();
+    rotor_table_.Evaluate(real_motor_velocity, v_axial, v_inplane, air_density_, rotor_diameter_,
+                          &force, &drag_torque_magnitude);
+    link_->AddRelativeForce(math::Vector3(0, 0, force));
+  }
 
   // Forces from Philppe Martin's and Erwan Salaün's
   // 2010 IEEE Conference on Robotics and Automation paper
@@ -216,7 +238,7 @@ void GazeboMotorModel::UpdateForcesAndMoments() {
   physics::Link_V parent_links = link_->GetParentJointsLinks();
   // The tansformation from the parent_link to the link_.
   math::Pose pose_difference = link_->GetWorldCoGPose() - parent_links.at(0)->GetWorldCoGPose();
-  math::Vector3 drag_torque(0, 0, -turning_direction_ * force * moment_constant_);
+  math::Vector3 drag_torque(0, 0, -turning_direction_ * drag_torque_magnitude);
   // Transforming the drag torque into the parent frame to handle arbitrary rotor orientations.
   math::Vector3 drag_torque_parent_frame = pose_difference.rot.RotateVector(drag_torque);
   parent_links.at(0)->AddRelativeTorque(drag_torque_parent_frame);
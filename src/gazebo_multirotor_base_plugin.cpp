@@ -76,15 +76,16 @@ void GazeboMultirotorBasePlugin::Load(physics::ModelPtr _model, sdf::ElementPtr
 void GazeboMultirotorBasePlugin::OnUpdate(const common::UpdateInfo& _info) {
   // Get the current simulation time.
   common::Time now = world_->GetSimTime();
-  mav_msgs::msgs::MotorSpeed msg;
+  resizeRepeated(motor_speed_msg_.mutable_motor_speed(), motor_joints_.size());
   MotorNumberToJointMap::iterator m;
-  for (m = motor_joints_.begin(); m != motor_joints_.end(); ++m) {
+  int i = 0;
+  for (m = motor_joints_.begin(); m != motor_joints_.end(); ++m, ++i) {
     double motor_rot_vel = m->second->GetVelocity(0) * rotor_velocity_slowdown_sim_;
-    msg.add_motor_speed(motor_rot_vel);
+    motor_speed_msg_.set_motor_speed(i, motor_rot_vel);
   }
   // motor_pub_->WaitForConnection();
   // Add time header
-  motor_pub_->Publish(msg);
+  motor_pub_->Publish(motor_speed_msg_);
 }
 
 GZ_REGISTER_MODEL_PLUGIN(GazeboMultirotorBasePlugin);
@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Rotor bank plugin
+ *
+ * @see gazebo_rotor_bank_plugin.h
+ */
+
+#include "gazebo_rotor_bank_plugin.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gazebo {
+
+GazeboRotorBankPlugin::GazeboRotorBankPlugin()
+    : ModelPlugin(),
+      command_sub_topic_(kDefaultCommandSubTopic),
+      motor_failure_sub_topic_(kDefaultMotorFailureNumSubTopic),
+      motor_speed_pub_topic_(kDefaultRotorSpeedsPubTopic),
+      battery_pub_topic_(kDefaultBatteryPubTopic),
+      battery_bus_(nullptr),
+      motor_speed_pub_rate_(0.0),
+      last_pub_time_(0.0),
+      prev_sim_time_(0.0),
+      motor_Failure_Number_(0),
+      failed_motor_printed_(0),
+      parent_count_(0),
+      rotor_count_(0),
+      rotors_(),
+      filter_dt_(-1.0),
+      electric_(false),
+      battery_pub_rate_(kDefaultBatteryPubRate),
+      last_battery_pub_time_(0.0) {
+}
+
+GazeboRotorBankPlugin::~GazeboRotorBankPlugin() {
+  event::Events::DisconnectWorldUpdateBegin(updateConnection_);
+}
+
+void GazeboRotorBankPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
+  model_ = _model;
+
+  namespace_.clear();
+  if (_sdf->HasElement("robotNamespace"))
+    namespace_ = _sdf->GetElement("robotNamespace")->Get<std::string>();
+  else
+    gzerr << "[gazebo_rotor_bank_plugin] Please specify a robotNamespace.\n";
+  node_handle_ = transport::NodePtr(new transport::Node());
+  node_handle_->Init(namespace_);
+
+  getSdfParam<std::string>(_sdf, "commandSubTopic", command_sub_topic_, command_sub_topic_);
+  getSdfParam<std::string>(_sdf, "motorSpeedPubTopic", motor_speed_pub_topic_, motor_speed_pub_topic_);
+  getSdfParam<double>(_sdf, "motorSpeedPubRate", motor_speed_pub_rate_, motor_speed_pub_rate_);
+
+  // plugin wide coefficients, the defaults of every rotor
+  double motor_constant = kDefaultMotorConstant;
+  double moment_constant = kDefaultMomentConstant;
+  double rotor_drag_coefficient = kDefaultRotorDragCoefficient;
+  double rolling_moment_coefficient = kDefaultRollingMomentCoefficient;
+  double max_rot_velocity = kDefaulMaxRotVelocity;
+  double rotor_velocity_slowdown_sim = kDefaultRotorVelocitySlowdownSim;
+  double time_constant_up = kDefaultTimeConstantUp;
+  double time_constant_down = kDefaultTimeConstantDown;
+  getSdfParam<double>(_sdf, "motorConstant", motor_constant, motor_constant);
+  getSdfParam<double>(_sdf, "momentConstant", moment_constant, moment_constant);
+  getSdfParam<double>(_sdf, "rotorDragCoefficient", rotor_drag_coefficient, rotor_drag_coefficient);
+  getSdfParam<double>(_sdf, "rollingMomentCoefficient", rolling_moment_coefficient, rolling_moment_coefficient);
+  getSdfParam<double>(_sdf, "maxRotVelocity", max_rot_velocity, max_rot_velocity);
+  getSdfParam<double>(_sdf, "rotorVelocitySlowdownSim", rotor_velocity_slowdown_sim, rotor_velocity_slowdown_sim);
+  getSdfParam<double>(_sdf, "timeConstantUp", time_constant_up, time_constant_up);
+  getSdfParam<double>(_sdf, "timeConstantDown", time_constant_down, time_constant_down);
+  double rotor_diameter = kDefaultRotorDiameter;
+  getSdfParam<double>(_sdf, "rotorDiameter", rotor_diameter, rotor_diameter);
+  getSdfParam<double>(_sdf, "airDensity", rotors_.air_density, kDefaultAirDensity);
+
+  double motor_kv = kDefaultMotorKv;
+  double motor_resistance = kDefaultMotorResistance;
+  double motor_no_load_current = kDefaultMotorNoLoadCurrent;
+  getSdfParam<double>(_sdf, "motorKv", motor_kv, motor_kv);
+  getSdfParam<double>(_sdf, "motorResistance", motor_resistance, motor_resistance);
+  getSdfParam<double>(_sdf, "motorNoLoadCurrent", motor_no_load_current, motor_no_load_current);
+
+  electric_ = _sdf->HasElement("battery");
+  if (electric_) {
+    sdf::ElementPtr battery = _sdf->GetElement("battery");
+    int cells;
+    double capacity, resistance, cell_voltage_full, cell_voltage_empty, avionics_current;
+    getSdfParam<int>(battery, "cells", cells, kDefaultBatteryCells);
+    getSdfParam<double>(battery, "capacity", capacity, kDefaultBatteryCapacity);
+    getSdfParam<double>(battery, "internalResistance", resistance, kDefaultBatteryResistance);
+    getSdfParam<double>(battery, "cellVoltageFull", cell_voltage_full, kDefaultCellVoltageFull);
+    getSdfParam<double>(battery, "cellVoltageEmpty", cell_voltage_empty, kDefaultCellVoltageEmpty);
+    getSdfParam<double>(battery, "avionicsCurrent", avionics_current, kDefaultAvionicsCurrent);
+    drive_.SetBattery(cells, capacity, resistance, cell_voltage_full, cell_voltage_empty, avionics_current);
+  }
+  getSdfParam<std::string>(_sdf, "batteryPubTopic", battery_pub_topic_, battery_pub_topic_);
+  getSdfParam<double>(_sdf, "batteryPubRate", battery_pub_rate_, battery_pub_rate_);
+
+  if (_sdf->HasElement("rotorTable")) {
+    std::string error;
+    if (!rotor_table_.Load(_sdf->GetElement("rotorTable")->Get<std::string>(), &error))
+      gzerr << "[gazebo_rotor_bank_plugin] " << error << ", using the motor and moment constants.\n";
+  }
+  rotors_.table = rotor_table_.Empty() ? nullptr : &rotor_table_;
+
+  int max_motor_number = -1;
+  for (sdf::ElementPtr rotor = _sdf->HasElement("rotor") ? _sdf->GetElement("rotor") : sdf::ElementPtr();
+       rotor; rotor = rotor->GetNextElement("rotor")) {
+    if (rotor_count_ == kMaxRotors) {
+      gzerr << "[gazebo_rotor_bank_plugin] More than " << kMaxRotors << " rotors, ignoring the rest.\n";
+      break;
+    }
+    const int k = rotor_count_;
+
+    std::string joint_name;
+    if (rotor->HasElement("jointName"))
+      joint_name = rotor->GetElement("jointName")->Get<std::string>();
+    else
+      gzerr << "[gazebo_rotor_bank_plugin] Please specify a jointName for every rotor.\n";
+    joint_[k] = model_->GetJoint(joint_name);
+    if (joint_[k] == NULL)
+      gzthrow("[gazebo_rotor_bank_plugin] Couldn't find specified joint \"" << joint_name << "\".");
+
+    std::string link_name;
+    if (rotor->HasElement("linkName"))
+      link_name = rotor->GetElement("linkName")->Get<std::string>();
+    else
+      gzerr << "[gazebo_rotor_bank_plugin] Please specify a linkName for every rotor.\n";
+    link_[k] = model_->GetLink(link_name);
+    if (link_[k] == NULL)
+      gzthrow("[gazebo_rotor_bank_plugin] Couldn't find specified link \"" << link_name << "\".");
+
+    motor_number_[k] = 0;
+    if (rotor->HasElement("motorNumber"))
+      motor_number_[k] = rotor->GetElement("motorNumber")->Get<int>();
+    else
+      gzerr << "[gazebo_rotor_bank_plugin] Please specify a motorNumber for every rotor.\n";
+    if (motor_number_[k] < 0)
+      gzthrow("[gazebo_rotor_bank_plugin] Negative motorNumber on rotor \"" << link_name << "\".");
+    max_motor_number = std::max(max_motor_number, motor_number_[k]);
+
+    turning_direction_[k] = turning_direction::CW;
+    if (rotor->HasElement("turningDirection")) {
+      std::string turning_direction = rotor->GetElement("turningDirection")->Get<std::string>();
+      if (turning_direction == "cw")
+        turning_direction_[k] = turning_direction::CW;
+      else if (turning_direction == "ccw")
+        turning_direction_[k] = turning_direction::CCW;
+      else
+        gzerr << "[gazebo_rotor_bank_plugin] Please only use 'cw' or 'ccw' as turningDirection.\n";
+    }
+    else
+      gzerr << "[gazebo_rotor_bank_plugin] Please specify a turning direction ('cw' or 'ccw') for every rotor.\n";
+
+    rotors_.turning_direction[k] = turning_direction_[k];
+    getSdfParam<double>(rotor, "motorConstant", rotors_.motor_constant[k], motor_constant);
+    getSdfParam<double>(rotor, "momentConstant", rotors_.moment_constant[k], moment_constant);
+    getSdfParam<double>(rotor, "rotorDragCoefficient", rotors_.rotor_drag_coefficient[k], rotor_drag_coefficient);
+    getSdfParam<double>(rotor, "rollingMomentCoefficient", rotors_.rolling_moment_coefficient[k], rolling_moment_coefficient);
+    getSdfParam<double>(rotor, "maxRotVelocity", max_rot_velocity_[k], max_rot_velocity);
+    getSdfParam<double>(rotor, "rotorVelocitySlowdownSim", rotor_velocity_slowdown_sim_[k], rotor_velocity_slowdown_sim);
+    getSdfParam<double>(rotor, "timeConstantUp", time_constant_up_[k], time_constant_up);
+    getSdfParam<double>(rotor, "timeConstantDown", time_constant_down_[k], time_constant_down);
+    getSdfParam<double>(rotor, "rotorDiameter", rotors_.diameter[k], rotor_diameter);
+    double kv, resistance, no_load_current;
+    getSdfParam<double>(rotor, "motorKv", kv, motor_kv);
+    getSdfParam<double>(rotor, "motorResistance", resistance, motor_resistance);
+    getSdfParam<double>(rotor, "motorNoLoadCurrent", no_load_current, motor_no_load_current);
+    drive_.SetMotor(k, kv, resistance, no_load_current);
+    ref_motor_rot_vel_[k] = 0.0;
+    filtered_rot_vel_[k] = 0.0;
+
+    // Resolve the parent once, GetParentJointsLinks() builds a new vector per call.
+    physics::Link_V parent_links = link_[k]->GetParentJointsLinks();
+    if (parent_links.empty())
+      gzthrow("[gazebo_rotor_bank_plugin] Rotor link \"" << link_name << "\" has no parent link.");
+    int p = 0;
+    while (p < parent_count_ && parents_[p] != parent_links.at(0)) {
+      ++p;
+    }
+    if (p == parent_count_) {
+      parents_[parent_count_++] = parent_links.at(0);
+    }
+    parent_index_[k] = p;
+
+    // Both directions are fixed relative to the parent while the rotor spins.
+    const math::Pose parent_pose = parents_[p]->GetWorldCoGPose();
+    const math::Pose pose_difference = link_[k]->GetWorldCoGPose() - parent_pose;
+    spin_parent_[k] = pose_difference.rot.RotateVector(math::Vector3(0, 0, 1));
+    axis_parent_[k] = parent_pose.rot.RotateVectorReverse(joint_[k]->GetGlobalAxis(0));
+
+#if GAZEBO_MAJOR_VERSION < 5
+    joint_[k]->SetMaxForce(0, kDefaultMaxForce);
+#endif
+    ++rotor_count_;
+  }
+
+  if (rotor_count_ == 0)
+    gzerr << "[gazebo_rotor_bank_plugin] No rotor elements found.\n";
+  rotors_.count = rotor_count_;
+
+  // indexed by motor number, like the command message
+  resizeRepeated(motor_speed_msg_.mutable_motor_speed(), max_motor_number + 1);
+
+  // Listen to the update event. This event is broadcast every
+  // simulation iteration.
+  updateConnection_ = event::Events::ConnectWorldUpdateBegin(boost::bind(&GazeboRotorBankPlugin::OnUpdate, this, _1));
+
+  command_sub_ = node_handle_->Subscribe<mav_msgs::msgs::CommandMotorSpeed>("~/" + model_->GetName() + command_sub_topic_, &GazeboRotorBankPlugin::VelocityCallback, this);
+  motor_failure_sub_ = node_handle_->Subscribe<msgs::Int>(motor_failure_sub_topic_, &GazeboRotorBankPlugin::MotorFailureCallback, this);
+  motor_speed_pub_ = node_handle_->Advertise<mav_msgs::msgs::MotorSpeed>("~/" + model_->GetName() + motor_speed_pub_topic_, 1);
+  if (electric_) {
+    battery_pub_ = node_handle_->Advertise<battery_msgs::msgs::Battery>("~/" + model_->GetName() + battery_pub_topic_, 1);
+    battery_bus_ = SensorBus::Instance().Battery("~/" + model_->GetName() + battery_pub_topic_);
+  }
+}
+
+// This gets called by the world update start event.
+void GazeboRotorBankPlugin::OnUpdate(const common::UpdateInfo& _info) {
+  const double now = _info.simTime.Double();
+  const double sampling_time = now - prev_sim_time_;
+  if (now < prev_sim_time_) {
+    // the world was reset, so is the battery
+    drive_.Reset();
+  }
+  prev_sim_time_ = now;
+
+  UpdateForcesAndMoments(sampling_time);
+  UpdateMotorFail();
+
+  if (motor_speed_pub_rate_ <= 0.0 || now - last_pub_time_ >= 1.0 / motor_speed_pub_rate_
+      || now < last_pub_time_) {
+    last_pub_time_ = now;
+    for (int k = 0; k < rotor_count_; ++k) {
+      motor_speed_msg_.set_motor_speed(motor_number_[k], joint_[k]->GetVelocity(0));
+    }
+    motor_speed_pub_->Publish(motor_speed_msg_);
+  }
+
+  if (electric_) {
+    PublishBattery(now);
+  }
+}
+
+void GazeboRotorBankPlugin::PublishBattery(double now) {
+  if (battery_pub_rate_ > 0.0 && now - last_battery_pub_time_ < 1.0 / battery_pub_rate_
+      && now >= last_battery_pub_time_) {
+    return;
+  }
+  last_battery_pub_time_ = now;
+
+  const BatteryState state = drive_.Battery();
+  BatterySample sample;
+  sample.time = now;
+  sample.voltage = state.voltage;
+  sample.current = state.current;
+  sample.consumed = state.consumed;
+  sample.remaining = state.remaining;
+  sample.cells = state.cells;
+  battery_bus_->Publish(sample);
+
+  battery_msg_.set_time(now);
+  battery_msg_.set_voltage(state.voltage);
+  battery_msg_.set_current(state.current);
+  battery_msg_.set_consumed(state.consumed);
+  battery_msg_.set_remaining(state.remaining);
+  battery_msg_.set_cells(state.cells);
+  battery_pub_->Publish(battery_msg_);
+}
+
+void GazeboRotorBankPlugin::UpdateFilterCoefficients(double dt) {
+  for (int k = 0; k < rotor_count_; ++k) {
+    alpha_up_[k] = exp(- dt / time_constant_up_[k]);
+    alpha_down_[k] = exp(- dt / time_constant_down_[k]);
+  }
+  filter_dt_ = dt;
+}
+
+void GazeboRotorBankPlugin::UpdateForcesAndMoments(double dt) {
+  if (dt != filter_dt_) {
+    UpdateFilterCoefficients(dt);
+  }
+
+  math::Quaternion parent_rot[kMaxRotors];
+  math::Vector3 parent_torque[kMaxRotors];
+  for (int p = 0; p < parent_count_; ++p) {
+    parent_rot[p] = parents_[p]->GetWorldCoGPose().rot;
+    parent_torque[p].Set(0, 0, 0);
+  }
+
+  for (int k = 0; k < rotor_count_; ++k) {
+    const int p = parent_index_[k];
+
+    const double motor_rot_vel = joint_[k]->GetVelocity(0);
+    if (motor_rot_vel / (2 * M_PI) > 1 / (2 * dt)) {
+      gzerr << "Aliasing on motor [" << motor_number_[k] << "] might occur. Consider making smaller simulation time steps or raising the rotor_velocity_slowdown_sim_ param.\n";
+    }
+    rotors_.rot_vel[k] = motor_rot_vel * rotor_velocity_slowdown_sim_[k];
+    const math::Vector3 body_velocity = link_[k]->GetWorldLinearVel();
+    const math::Vector3 spin = parent_rot[p].RotateVector(spin_parent_[k]);
+    const math::Vector3 joint_axis = parent_rot[p].RotateVector(axis_parent_[k]);
+    rotors_.vel[0][k] = body_velocity.x;
+    rotors_.vel[1][k] = body_velocity.y;
+    rotors_.vel[2][k] = body_velocity.z;
+    rotors_.spin[0][k] = spin.x;
+    rotors_.spin[1][k] = spin.y;
+    rotors_.spin[2][k] = spin.z;
+    rotors_.axis[0][k] = joint_axis.x;
+    rotors_.axis[1][k] = joint_axis.y;
+    rotors_.axis[2][k] = joint_axis.z;
+  }
+
+  ComputeRotorForces(&rotors_);
+
+  for (int k = 0; k < rotor_count_; ++k) {
+    link_[k]->AddRelativeForce(math::Vector3(0, 0, rotors_.thrust[k]));
+    link_[k]->AddForce(math::Vector3(rotors_.drag[0][k], rotors_.drag[1][k], rotors_.drag[2][k]));
+    parent_torque[parent_index_[k]] += math::Vector3(rotors_.torque[0][k], rotors_.torque[1][k], rotors_.torque[2][k]);
+  }
+
+  for (int p = 0; p < parent_count_; ++p) {
+    parents_[p]->AddTorque(parent_torque[p]);
+  }
+
+  // first order motor response, towards the commanded speed or, with the
+  // electrical model, the speed the motor reaches at the battery voltage
+  double command[kMaxRotors];
+  double target[kMaxRotors];
+  for (int k = 0; k < rotor_count_; ++k) {
+    command[k] = std::min(ref_motor_rot_vel_[k], max_rot_velocity_[k]);
+    target[k] = command[k];
+  }
+  if (electric_) {
+    for (int k = 0; k < rotor_count_; ++k) {
+      if (motor_number_[k] == motor_Failure_Number_ - 1) {
+        command[k] = 0.0;  // a failed motor draws no current
+      }
+    }
+    drive_.Step(dt, command, filtered_rot_vel_, rotors_.load, target);
+  }
+
+  for (int k = 0; k < rotor_count_; ++k) {
+    const double alpha = target[k] > filtered_rot_vel_[k] ? alpha_up_[k] : alpha_down_[k];
+    filtered_rot_vel_[k] = alpha * filtered_rot_vel_[k] + (1 - alpha) * target[k];
+
+    joint_[k]->SetVelocity(0, turning_direction_[k] * filtered_rot_vel_[k] / rotor_velocity_slowdown_sim_[k]);
+  }
+}
+
+void GazeboRotorBankPlugin::UpdateMotorFail() {
+  for (int k = 0; k < rotor_count_; ++k) {
+    if (motor_number_[k] == motor_Failure_Number_ - 1) {
+      joint_[k]->SetVelocity(0, 0);
+    }
+  }
+
+  if (motor_Failure_Number_ != 0 && failed_motor_printed_ != motor_Failure_Number_) {
+    std::cout << "Motor number [" << motor_Failure_Number_ << "] failed!  [Motor thrust = 0]" << std::endl;
+    failed_motor_printed_ = motor_Failure_Number_;
+  } else if (motor_Failure_Number_ == 0 && failed_motor_printed_ != 0) {
+    std::cout << "Motor number [" << failed_motor_printed_ << "] running! [Motor thrust = (default)]" << std::endl;
+    failed_motor_printed_ = 0;
+  }
+}
+
+void GazeboRotorBankPlugin::VelocityCallback(CommandMotorSpeedPtr& rot_velocities) {
+  for (int k = 0; k < rotor_count_; ++k) {
+    if (rot_velocities->motor_speed_size() <= motor_number_[k]) {
+      std::cout << "You tried to access index " << motor_number_[k]
+        << " of the MotorSpeed message array which is of size " << rot_velocities->motor_speed_size() << "." << std::endl;
+      continue;
+    }
+    ref_motor_rot_vel_[k] = rot_velocities->motor_speed(motor_number_[k]);
+  }
+}
+
+void GazeboRotorBankPlugin::MotorFailureCallback(const boost::shared_ptr<const msgs::Int>& fail_msg) {
+  motor_Failure_Number_ = fail_msg->data();
+}
+
+GZ_REGISTER_MODEL_PLUGIN(GazeboRotorBankPlugin);
+}
@@ -104,6 +104,8 @@ void VisionPlugin::Load(physics::ModelPtr model, sdf::ElementPtr sdf)
   // remember start pose -> VIO should always start with zero
   _pose_model_start = _model->GetWorldPose();
 
+  _noise.Seed(math::Rand::GetSeed(), _model->GetName(), "vision");
+
   _nh = transport::NodePtr(new transport::Node());
   _nh->Init(_namespace);
 
@@ -112,6 +114,7 @@ void VisionPlugin::Load(physics::ModelPtr model, sdf::ElementPtr sdf)
       boost::bind(&VisionPlugin::OnUpdate, this, _1));
 
   _pub_odom = _nh->Advertise<odom_msgs::msgs::odom>("~/" + _model->GetName() + "/vision_odom", 10);
+  _vision_bus = SensorBus::Instance().Vision("~/" + _model->GetName() + "/vision_odom");
 }
 
 void VisionPlugin::OnUpdate(const common::UpdateInfo&)
@@ -137,12 +140,12 @@ void VisionPlugin::OnUpdate(const common::UpdateInfo&)
     // update noise parameters
     math::Vector3 noise;
     math::Vector3 random_walk;
-    noise.x = _noise_density * sqrt(dt) * _randn(_rand);
-    noise.y = _noise_density * sqrt(dt) * _randn(_rand);
-    noise.z = _noise_density * sqrt(dt) * _randn(_rand);
-    random_walk.x = _random_walk * sqrt(dt) * _randn(_rand);
-    random_walk.y = _random_walk * sqrt(dt) * _randn(_rand);
-    random_walk.z = _random_walk * sqrt(dt) * _randn(_rand);
+    noise.x = _noise_density * sqrt(dt) * _noise.Normal();
+    noise.y = _noise_density * sqrt(dt) * _noise.Normal();
+    noise.z = _noise_density * sqrt(dt) * _noise.Normal();
+    random_walk.x = _random_walk * sqrt(dt) * _noise.Normal();
+    random_walk.y = _random_walk * sqrt(dt) * _noise.Normal();
+    random_walk.z = _random_walk * sqrt(dt) * _noise.Normal();
 
     // bias integration
     _bias.x += random_walk.x * dt - _bias.x / _corellation_time;
@@ -163,6 +166,16 @@ void VisionPlugin::OnUpdate(const common::UpdateInfo&)
 
     // publish odom msg
     _pub_odom->Publish(odom_msg);
+
+    VisionSample vision_sample;
+    vision_sample.usec = odom_msg.usec();
+    vision_sample.x = odom_msg.x();
+    vision_sample.y = odom_msg.y();
+    vision_sample.z = odom_msg.z();
+    vision_sample.roll = odom_msg.roll();
+    vision_sample.pitch = odom_msg.pitch();
+    vision_sample.yaw = odom_msg.yaw();
+    _vision_bus->Publish(vision_sample);
   }
 }
 
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Lift drag bank plugin
+ *
+ * @see liftdrag_bank_plugin.h
+ */
+
+#include "liftdrag_plugin/liftdrag_bank_plugin.h"
+
+#include <string>
+
+#include "common.h"
+
+namespace gazebo {
+
+GZ_REGISTER_MODEL_PLUGIN(LiftDragBankPlugin)
+
+LiftDragBankPlugin::LiftDragBankPlugin()
+    : ModelPlugin(),
+      link_count_(0) {
+  surfaces_.count = 0;
+}
+
+LiftDragBankPlugin::~LiftDragBankPlugin() {
+  if (updateConnection_)
+    event::Events::DisconnectWorldUpdateBegin(updateConnection_);
+}
+
+void LiftDragBankPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
+  model_ = _model;
+
+  for (sdf::ElementPtr surface = _sdf->HasElement("surface") ? _sdf->GetElement("surface") : sdf::ElementPtr();
+       surface; surface = surface->GetNextElement("surface")) {
+    if (surfaces_.count == kMaxSurfaces) {
+      gzerr << "[liftdrag_bank_plugin] More than " << kMaxSurfaces << " surfaces, ignoring the rest.\n";
+      break;
+    }
+
+    std::string link_name;
+    getSdfParam<std::string>(surface, "link_name", link_name, link_name);
+    physics::LinkPtr link = model_->GetLink(link_name);
+    if (!link) {
+      gzerr << "[liftdrag_bank_plugin] Link with name[" << link_name << "] not found, "
+            << "skipping the surface.\n";
+      continue;
+    }
+    const int k = surfaces_.count;
+
+    int l = 0;
+    while (l < link_count_ && links_[l] != link) {
+      ++l;
+    }
+    if (l == link_count_) {
+      links_[link_count_++] = link;
+    }
+    link_index_[k] = l;
+
+    // LiftDragPlugin defaults
+    double cla, cda, alpha_stall, cla_stall, cda_stall, area, rho;
+    bool radial_symmetry;
+    getSdfParam<double>(surface, "a0", surfaces_.alpha0[k], 0.0);
+    getSdfParam<double>(surface, "cla", cla, 1.0);
+    getSdfParam<double>(surface, "cda", cda, 0.01);
+    getSdfParam<double>(surface, "alpha_stall", alpha_stall, 0.5 * M_PI);
+    getSdfParam<double>(surface, "cla_stall", cla_stall, 0.0);
+    getSdfParam<double>(surface, "cda_stall", cda_stall, 1.0);
+    getSdfParam<double>(surface, "control_joint_rad_to_cl", surfaces_.control_to_cl[k], 4.0);
+    getSdfParam<double>(surface, "area", area, 1.0);
+    getSdfParam<double>(surface, "air_density", rho, 1.2041);
+    getSdfParam<bool>(surface, "radial_symmetry", radial_symmetry, false);
+    surfaces_.cla[k] = cla;
+    surfaces_.cda[k] = cda;
+    surfaces_.alpha_stall[k] = alpha_stall;
+    surfaces_.cla_stall[k] = cla_stall;
+    surfaces_.cda_stall[k] = cda_stall;
+    surfaces_.half_rho_area[k] = 0.5 * rho * area;
+    surfaces_.radial[k] = radial_symmetry ? 1.0 : 0.0;
+    // cma and cma_stall are accepted but unused, cm is zero as in LiftDragPlugin
+
+    math::Vector3 cp;
+    getSdfParam<math::Vector3>(surface, "cp", cp, math::Vector3(0, 0, 0));
+    getSdfParam<math::Vector3>(surface, "forward", forward_[k], math::Vector3(1, 0, 0));
+    getSdfParam<math::Vector3>(surface, "upward", upward_[k], math::Vector3(0, 0, 1));
+    forward_[k].Normalize();
+    upward_[k].Normalize();
+    // the CoG does not move within the link
+    cp_cog_[k] = cp - link->GetInertial()->GetCoG();
+
+    control_joint_[k].reset();
+    if (surface->HasElement("control_joint_name")) {
+      std::string control_joint_name = surface->Get<std::string>("control_joint_name");
+      control_joint_[k] = model_->GetJoint(control_joint_name);
+      if (!control_joint_[k])
+        gzerr << "[liftdrag_bank_plugin] Joint with name[" << control_joint_name << "] does not exist.\n";
+    }
+    surfaces_.control[k] = 0.0;
+
+    surfaces_.table[k] = nullptr;
+    if (surface->HasElement("coefficient_table")) {
+      const std::string path = surface->Get<std::string>("coefficient_table");
+      std::map<std::string, AeroTable>::iterator table = tables_.find(path);
+      if (table == tables_.end()) {
+        table = tables_.insert(std::make_pair(path, AeroTable())).first;
+        std::string error;
+        if (!table->second.Load(path, &error))
+          gzerr << "[liftdrag_bank_plugin] " << error << ", using the analytic coefficients.\n";
+      }
+      if (!table->second.Empty())
+        surfaces_.table[k] = &table->second;
+    }
+
+    ++surfaces_.count;
+  }
+
+  if (surfaces_.count == 0) {
+    gzerr << "[liftdrag_bank_plugin] No surfaces found, the plugin will not generate forces.\n";
+    return;
+  }
+
+  updateConnection_ = event::Events::ConnectWorldUpdateBegin(boost::bind(&LiftDragBankPlugin::OnUpdate, this));
+}
+
+void LiftDragBankPlugin::OnUpdate() {
+  math::Quaternion rot[kMaxSurfaces];
+  math::Vector3 cog_vel[kMaxSurfaces];
+  math::Vector3 ang_vel[kMaxSurfaces];
+  for (int l = 0; l < link_count_; ++l) {
+    rot[l] = links_[l]->GetWorldPose().rot;
+    cog_vel[l] = links_[l]->GetWorldCoGLinearVel();
+    ang_vel[l] = links_[l]->GetWorldAngularVel();
+  }
+
+  // gather, the velocity of a centre of pressure is that of the CoG plus
+  // the rotation about it, what GetWorldLinearVel(cp) computes per call
+  math::Vector3 arm[kMaxSurfaces];
+  for (int k = 0; k < surfaces_.count; ++k) {
+    const int l = link_index_[k];
+    arm[k] = rot[l].RotateVector(cp_cog_[k]);
+    const math::Vector3 vel = cog_vel[l] + ang_vel[l].Cross(arm[k]);
+    const math::Vector3 forward = rot[l].RotateVector(forward_[k]);
+    const math::Vector3 upward = rot[l].RotateVector(upward_[k]);
+    surfaces_.vel[0][k] = vel.x;
+    surfaces_.vel[1][k] = vel.y;
+    surfaces_.vel[2][k] = vel.z;
+    surfaces_.forward[0][k] = forward.x;
+    surfaces_.forward[1][k] = forward.y;
+    surfaces_.forward[2][k] = forward.z;
+    surfaces_.upward[0][k] = upward.x;
+    surfaces_.upward[1][k] = upward.y;
+    surfaces_.upward[2][k] = upward.z;
+    if (control_joint_[k])
+      surfaces_.control[k] = control_joint_[k]->GetAngle(0).Radian();
+  }
+
+  ComputeLiftDrag(&surfaces_);
+
+  // scatter, forces at the centres of pressure as force and torque about the CoG,
+  // plus the pitching moments of table surfaces
+  math::Vector3 force[kMaxSurfaces];
+  math::Vector3 torque[kMaxSurfaces];
+  for (int k = 0; k < surfaces_.count; ++k) {
+    const int l = link_index_[k];
+    const math::Vector3 f(surfaces_.force[0][k], surfaces_.force[1][k], surfaces_.force[2][k]);
+    force[l] += f;
+    torque[l] += arm[k].Cross(f)
+        + math::Vector3(surfaces_.moment[0][k], surfaces_.moment[1][k], surfaces_.moment[2][k]);
+  }
+  for (int l = 0; l < link_count_; ++l) {
+    links_[l]->AddForce(force[l]);
+    links_[l]->AddTorque(torque[l]);
+  }
+}
+
+}  // namespace gazebo
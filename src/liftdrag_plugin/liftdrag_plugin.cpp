@@ -23,6 +23,7 @@
 #include "gazebo/sensors/SensorManager.hh"
 #include "gazebo/transport/transport.hh"
 #include "gazebo/msgs/msgs.hh"
+#include "liftdrag_plugin/liftdrag_kernel.h"
 #include "liftdrag_plugin/liftdrag_plugin.h"
 
 using namespace gazebo;
@@ -155,6 +156,16 @@ void LiftDragPlugin::Load(physics::ModelPtr _model,
 
   if (_sdf->HasElement("control_joint_rad_to_cl"))
     this->controlJointRadToCL = _sdf->Get<double>("control_joint_rad_to_cl");
+
+  if (_sdf->HasElement("coefficient_table"))
+  {
+    std::string error;
+    if (!this->coefficientTable.Load(
+          _sdf->Get<std::string>("coefficient_table"), &error))
+    {
+      gzerr << error << ", using the analytic coefficients.\n";
+    }
+  }
 }
 
 /////////////////////////////////////////////////
@@ -233,6 +244,42 @@ void LiftDragPlugin::OnUpdate()
   // get direction of moment
   math::Vector3 momentDirection = spanwiseI;
 
+  if (!this->coefficientTable.Empty())
+  {
+    // full envelope: the angle of attack is not folded to +/-90 deg and
+    // the coefficients are against the full dynamic pressure, lift along
+    // spanwiseI x velI also where the velocity in the plane vanishes
+    math::Vector3 liftTableI = spanwiseI.Cross(velI);
+    liftTableI.Normalize();
+    double cosAlphaTable = math::clamp(liftTableI.Dot(upwardI), minRatio, maxRatio);
+    double alphaTable = liftTableI.Dot(forwardI) >= 0.0
+        ? this->alpha0 + LiftDragAcos(cosAlphaTable)
+        : this->alpha0 - LiftDragAcos(cosAlphaTable);
+    if (alphaTable > M_PI)
+      alphaTable -= 2.0 * M_PI;
+    else if (alphaTable < -M_PI)
+      alphaTable += 2.0 * M_PI;
+    this->alpha = alphaTable;
+
+    double controlAngle = 0.0;
+    if (this->controlJoint)
+      controlAngle = this->controlJoint->GetAngle(0).Radian();
+
+    double cl, cd, cm;
+    this->coefficientTable.Lookup(alphaTable, this->sweep, controlAngle,
+        &cl, &cd, &cm);
+
+    double qArea = 0.5 * this->rho * vel.GetSquaredLength() * this->area;
+    math::Vector3 force = qArea * (cl * liftTableI - cd * velI);
+    math::Vector3 torque = qArea * cm * momentDirection;
+
+    force.Correct();
+    torque.Correct();
+    this->link->AddForceAtRelativePosition(force, this->cp);
+    this->link->AddTorque(torque);
+    return;
+  }
+
   // compute angle between upwardI and liftI
   // in general, given vectors a and b:
   //   cos(theta) = a.Dot(b)/(a.Length()*b.Lenghth())
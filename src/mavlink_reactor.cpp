@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief MAVLink socket reactor
+ *
+ * @see mavlink_reactor.h
+ */
+
+#include <mavlink_reactor.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+namespace gazebo {
+
+MavlinkReactor& MavlinkReactor::Instance()
+{
+  static MavlinkReactor reactor;
+  return reactor;
+}
+
+MavlinkReactor::MavlinkReactor() :
+  last_iteration_(0),
+  serviced_(false),
+  polling_(0)
+{
+  ready_.reserve(kMaxEvents);
+#if defined(__linux__)
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    fprintf(stderr, "[mavlink_reactor] epoll_create1 failed: %s\n", strerror(errno));
+  }
+#endif
+}
+
+MavlinkReactor::~MavlinkReactor()
+{
+#if defined(__linux__)
+  if (epoll_fd_ >= 0) {
+    ::close(epoll_fd_);
+  }
+#endif
+}
+
+bool MavlinkReactor::Register(int fd, const ReadyCallback& callback)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (fd < 0 || handlers_.count(fd)) {
+    return false;
+  }
+
+  std::unique_ptr<Handler> handler(new Handler);
+  handler->fd = fd;
+  handler->deferred = false;
+  handler->callback = callback;
+
+#if defined(__linux__)
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = handler.get();
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    fprintf(stderr, "[mavlink_reactor] epoll_ctl add failed: %s\n", strerror(errno));
+    return false;
+  }
+#else
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  fds_.push_back(pfd);
+#endif
+
+  handlers_[fd] = std::move(handler);
+  return true;
+}
+
+void MavlinkReactor::Unregister(int fd)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto it = handlers_.find(fd);
+  if (it == handlers_.end()) {
+    return;
+  }
+
+#if defined(__linux__)
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+  for (auto pfd = fds_.begin(); pfd != fds_.end(); ++pfd) {
+    if (pfd->fd == fd) {
+      fds_.erase(pfd);
+      break;
+    }
+  }
+#endif
+
+  for (auto deferred = deferred_.begin(); deferred != deferred_.end(); ++deferred) {
+    if (*deferred == it->second.get()) {
+      deferred_.erase(deferred);
+      break;
+    }
+  }
+
+  // a Poll() in progress may have returned this handler as ready, it is
+  // skipped from now on. A callback already running on another thread is
+  // waited for; one running on this thread is the caller itself.
+  Handler *handler = it->second.get();
+  handler->fd = -1;
+  dispatched_.wait(lock, [&] {
+    auto found = handlers_.find(fd);
+    return found == handlers_.end() || found->second.get() != handler
+        || handler->dispatcher == std::thread::id()
+        || handler->dispatcher == std::this_thread::get_id();
+  });
+
+  // an Unregister() on another thread got here first
+  it = handlers_.find(fd);
+  if (it == handlers_.end() || it->second.get() != handler) {
+    return;
+  }
+  if (polling_ > 0) {
+    retired_.push_back(std::move(it->second));
+  }
+  handlers_.erase(it);
+}
+
+void MavlinkReactor::Defer(int fd)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = handlers_.find(fd);
+  if (it == handlers_.end() || it->second->deferred) {
+    return;
+  }
+  Arm(it->second.get(), false);
+  deferred_.push_back(it->second.get());
+}
+
+void MavlinkReactor::Arm(Handler *handler, bool readable)
+{
+  handler->deferred = !readable;
+#if defined(__linux__)
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = readable ? EPOLLIN : 0;
+  ev.data.ptr = handler;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, handler->fd, &ev);
+#else
+  for (auto& pfd : fds_) {
+    if (pfd.fd == handler->fd) {
+      pfd.events = readable ? POLLIN : 0;
+      break;
+    }
+  }
+#endif
+}
+
+void MavlinkReactor::ServiceOnce(uint64_t iteration)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (serviced_ && iteration == last_iteration_) {
+      return;
+    }
+    serviced_ = true;
+    last_iteration_ = iteration;
+
+    // a new step, deferred sockets may be drained again
+    for (Handler *handler : deferred_) {
+      Arm(handler, true);
+    }
+    deferred_.clear();
+  }
+
+  Poll(0);
+}
+
+int MavlinkReactor::Poll(int timeout_ms)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_.clear();
+  ++polling_;
+
+#if defined(__linux__)
+  struct epoll_event events[kMaxEvents];
+
+  lock.unlock();
+  int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+  const int poll_errno = errno;
+  lock.lock();
+
+  for (int i = 0; i < n; ++i) {
+    Handler *handler = static_cast<Handler*>(events[i].data.ptr);
+    if (handler->fd >= 0) {
+      ready_.push_back(handler);
+    }
+  }
+#else
+  int n = ::poll(fds_.data(), fds_.size(), timeout_ms);
+  const int poll_errno = errno;
+
+  for (int i = 0; n > 0 && i < static_cast<int>(fds_.size()); ++i) {
+    if (fds_[i].revents & POLLIN) {
+      auto it = handlers_.find(fds_[i].fd);
+      if (it != handlers_.end()) {
+        ready_.push_back(it->second.get());
+      }
+    }
+  }
+#endif
+
+  if (n < 0) {
+    if (--polling_ == 0) {
+      retired_.clear();
+    }
+    return poll_errno == EINTR ? 0 : -1;
+  }
+
+  // callbacks may send or (un)register, so they run without the lock; a
+  // handler unregistered meanwhile is retired, not freed, until polling_
+  // drops to zero, and its callback is no longer run. The vector is
+  // swapped back to keep its capacity.
+  std::vector<Handler*> ready;
+  ready.swap(ready_);
+
+  const std::thread::id self = std::this_thread::get_id();
+  for (Handler *handler : ready) {
+    if (handler->fd < 0) {
+      continue;
+    }
+    handler->dispatcher = self;
+    lock.unlock();
+    handler->callback();
+    lock.lock();
+    handler->dispatcher = std::thread::id();
+    dispatched_.notify_all();
+  }
+
+  ready.clear();
+  ready_.swap(ready);
+  if (--polling_ == 0) {
+    retired_.clear();
+  }
+
+  return n;
+}
+
+size_t MavlinkReactor::NumSockets()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return handlers_.size();
+}
+
+}  // namespace gazebo
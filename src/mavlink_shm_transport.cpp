@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief Same-host shared memory MAVLink transport
+ *
+ * @see mavlink_shm_transport.h
+ */
+
+#include <mavlink_shm_transport.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+namespace gazebo {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "ring indices must be plain 32 bit words to be shared between processes");
+
+namespace {
+
+void futexWake(std::atomic<uint32_t>* word)
+{
+#if defined(__linux__)
+  // the segment is mapped in two processes, so no FUTEX_PRIVATE_FLAG
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+void futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms)
+{
+#if defined(__linux__)
+  struct timespec ts;
+  ts.tv_sec = timeout_ms / 1000;
+  ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+  // no futex, fall back to a short sleep and let the caller re-check
+  (void)word;
+  (void)expected;
+  std::this_thread::sleep_for(std::chrono::microseconds(std::min(timeout_ms * 1000, 100)));
+#endif
+}
+
+}  // namespace
+
+MavlinkShmTransport::MavlinkShmTransport() :
+  segment_(nullptr),
+  tx_(nullptr),
+  rx_(nullptr),
+  owner_(false),
+  dropped_(0),
+  corrupt_(0)
+{
+}
+
+MavlinkShmTransport::~MavlinkShmTransport()
+{
+  Close();
+}
+
+bool MavlinkShmTransport::Create(const std::string& name)
+{
+  if (!Map(name, true)) {
+    return false;
+  }
+
+  memset(static_cast<void*>(segment_), 0, sizeof(*segment_));
+  segment_->version = kMavlinkShmVersion;
+  std::atomic_thread_fence(std::memory_order_release);
+  // the magic goes in last, a peer polling for it sees initialized rings
+  segment_->magic = kMavlinkShmMagic;
+
+  tx_ = &segment_->to_autopilot;
+  rx_ = &segment_->to_simulator;
+  return true;
+}
+
+bool MavlinkShmTransport::Open(const std::string& name)
+{
+  if (!Map(name, false)) {
+    return false;
+  }
+
+  if (segment_->magic != kMavlinkShmMagic || segment_->version != kMavlinkShmVersion) {
+    fprintf(stderr, "[mavlink_shm_transport] %s is not a version %u segment\n",
+            name.c_str(), kMavlinkShmVersion);
+    Close();
+    return false;
+  }
+
+  tx_ = &segment_->to_simulator;
+  rx_ = &segment_->to_autopilot;
+  return true;
+}
+
+bool MavlinkShmTransport::Map(const std::string& name, bool create)
+{
+  Close();
+
+  int fd = shm_open(name.c_str(), create ? (O_RDWR | O_CREAT) : O_RDWR, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "[mavlink_shm_transport] shm_open %s failed: %s\n", name.c_str(), strerror(errno));
+    return false;
+  }
+
+  if (create && ftruncate(fd, sizeof(MavlinkShmSegment)) < 0) {
+    fprintf(stderr, "[mavlink_shm_transport] ftruncate %s failed: %s\n", name.c_str(), strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  void* addr = mmap(nullptr, sizeof(MavlinkShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping keeps the segment alive
+  ::close(fd);
+
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "[mavlink_shm_transport] mmap %s failed: %s\n", name.c_str(), strerror(errno));
+    return false;
+  }
+
+  segment_ = static_cast<MavlinkShmSegment*>(addr);
+  name_ = name;
+  owner_ = create;
+  return true;
+}
+
+void MavlinkShmTransport::Close()
+{
+  if (!segment_) {
+    return;
+  }
+
+  munmap(segment_, sizeof(MavlinkShmSegment));
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+
+  segment_ = nullptr;
+  tx_ = nullptr;
+  rx_ = nullptr;
+  owner_ = false;
+}
+
+bool MavlinkShmTransport::Send(const uint8_t* buf, size_t len)
+{
+  if (!tx_ || len > kMavlinkShmFrameSize) {
+    return false;
+  }
+
+  const uint32_t head = tx_->head.load(std::memory_order_relaxed);
+  const uint32_t tail = tx_->tail.load(std::memory_order_acquire);
+  if (head - tail == kMavlinkShmSlots) {
+    ++dropped_;
+    return false;
+  }
+
+  MavlinkShmSlot& slot = tx_->slots[head & (kMavlinkShmSlots - 1)];
+  slot.len = static_cast<uint32_t>(len);
+  memcpy(slot.data, buf, len);
+  tx_->head.store(head + 1, std::memory_order_release);
+
+  // only pay for the wake syscall when the reader is asleep
+  tx_->futex.fetch_add(1, std::memory_order_seq_cst);
+  if (tx_->waiting.load(std::memory_order_seq_cst)) {
+    futexWake(&tx_->futex);
+  }
+  return true;
+}
+
+ssize_t MavlinkShmTransport::Receive(uint8_t* buf, size_t size)
+{
+  if (!rx_) {
+    return -1;
+  }
+
+  const uint32_t tail = rx_->tail.load(std::memory_order_relaxed);
+  const uint32_t head = rx_->head.load(std::memory_order_acquire);
+  if (head == tail) {
+    return 0;
+  }
+
+  const MavlinkShmSlot& slot = rx_->slots[tail & (kMavlinkShmSlots - 1)];
+  const size_t len = slot.len;
+  const bool corrupt = len == 0 || len > size || len > kMavlinkShmFrameSize;
+  if (!corrupt) {
+    memcpy(buf, slot.data, len);
+  }
+  // a corrupt or oversized slot is skipped rather than wedging the ring
+  rx_->tail.store(tail + 1, std::memory_order_release);
+
+  if (corrupt) {
+    ++corrupt_;
+    return kCorruptSlot;
+  }
+  return static_cast<ssize_t>(len);
+}
+
+bool MavlinkShmTransport::WaitReadable(int timeout_ms)
+{
+  if (!rx_) {
+    return false;
+  }
+
+  const uint32_t seq = rx_->futex.load(std::memory_order_seq_cst);
+  rx_->waiting.store(1, std::memory_order_seq_cst);
+
+  // re-check after announcing ourselves, a frame published in between
+  // either shows up here or bumps the futex word so the wait returns at once
+  if (rx_->head.load(std::memory_order_acquire) == rx_->tail.load(std::memory_order_relaxed)) {
+    futexWait(&rx_->futex, seq, timeout_ms);
+  }
+
+  rx_->waiting.store(0, std::memory_order_relaxed);
+  return rx_->head.load(std::memory_order_acquire) != rx_->tail.load(std::memory_order_relaxed);
+}
+
+}  // namespace gazebo
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 PX4 Pro Development Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @brief In-process sensor bus
+ *
+ * @see sensor_bus.h
+ */
+
+#include <sensor_bus.h>
+
+namespace gazebo {
+
+SensorBus& SensorBus::Instance()
+{
+  static SensorBus bus;
+  return bus;
+}
+
+ImuSlot* SensorBus::Imu(const std::string& topic)
+{
+  return Find(imu_, topic);
+}
+
+GpsSlot* SensorBus::Gps(const std::string& topic)
+{
+  return Find(gps_, topic);
+}
+
+VisionSlot* SensorBus::Vision(const std::string& topic)
+{
+  return Find(vision_, topic);
+}
+
+BatterySlot* SensorBus::Battery(const std::string& topic)
+{
+  return Find(battery_, topic);
+}
+
+}  // namespace gazebo